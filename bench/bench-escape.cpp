@@ -0,0 +1,128 @@
+/**
+ * Benchmark for the implementations of append_pg_escaped(). Uses all tag
+ * keys and values and user names from the OSM file given on the command
+ * line or, without a file, a synthetic set of strings with a similar
+ * distribution: short strings, most of them without anything to escape.
+ *
+ * Usage: bench-escape [OSMFILE]
+ */
+
+#include "util.hpp"
+
+#include <osmium/handler.hpp>
+#include <osmium/io/any_input.hpp>
+#include <osmium/visitor.hpp>
+
+#include <chrono>
+#include <cstddef>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace {
+
+class StringCollector : public osmium::handler::Handler
+{
+
+    std::vector<std::string> *m_strings;
+
+public:
+    explicit StringCollector(std::vector<std::string> *strings)
+    : m_strings(strings)
+    {
+    }
+
+    void osm_object(osmium::OSMObject const &object)
+    {
+        m_strings->emplace_back(object.user());
+        for (auto const &tag : object.tags()) {
+            m_strings->emplace_back(tag.key());
+            m_strings->emplace_back(tag.value());
+        }
+    }
+
+}; // class StringCollector
+
+std::vector<std::string> synthetic_strings()
+{
+    std::mt19937 gen{42}; // NOLINT(cert-msc32-c,cert-msc51-cpp)
+    std::geometric_distribution<int> length_dist{0.1};
+    std::uniform_int_distribution<int> char_dist{0, 999};
+
+    std::vector<std::string> strings;
+    for (int i = 0; i < 1000000; ++i) {
+        std::string str;
+        auto const length = length_dist(gen) + 1;
+        // about one in 50 strings has something to escape
+        bool const special = char_dist(gen) < 20;
+        for (int n = 0; n < length; ++n) {
+            str += static_cast<char>('a' + (n % 26));
+        }
+        if (special) {
+            str[static_cast<std::size_t>(char_dist(gen) % length)] = '\n';
+        }
+        strings.push_back(std::move(str));
+    }
+    return strings;
+}
+
+void run(char const *name, std::vector<std::string> const &strings,
+         void (*func)(std::string &, char const *, std::size_t))
+{
+    constexpr int rounds = 10;
+
+    std::string buffer;
+    std::size_t bytes = 0;
+    auto const start = std::chrono::steady_clock::now();
+    for (int round = 0; round < rounds; ++round) {
+        for (auto const &str : strings) {
+            func(buffer, str.data(), str.size());
+            bytes += str.size();
+            if (buffer.size() > 1024 * 1024) {
+                buffer.clear();
+            }
+        }
+    }
+    std::chrono::duration<double> const duration =
+        std::chrono::steady_clock::now() - start;
+
+    std::cout << name << ": " << duration.count() << " s = "
+              << (static_cast<double>(bytes) / 1024 / 1024 /
+                  duration.count())
+              << " MB/s\n";
+}
+
+} // anonymous namespace
+
+int main(int argc, char *argv[])
+{
+    std::vector<std::string> strings;
+    if (argc > 1) {
+        osmium::io::Reader reader{argv[1], osmium::osm_entity_bits::nwr};
+        StringCollector collector{&strings};
+        osmium::apply(reader, collector);
+        reader.close();
+    } else {
+        strings = synthetic_strings();
+    }
+
+    std::size_t total = 0;
+    for (auto const &str : strings) {
+        total += str.size();
+    }
+    std::cout << strings.size() << " strings with average length "
+              << (static_cast<double>(total) /
+                  static_cast<double>(strings.size()))
+              << '\n';
+
+    run("scalar", strings, detail::append_pg_escaped_scalar);
+#ifdef OPE_X86_SIMD
+    run("SSE2", strings, detail::append_pg_escaped_sse2);
+    if (__builtin_cpu_supports("avx2")) {
+        run("AVX2", strings, detail::append_pg_escaped_avx2);
+    }
+#endif
+
+    return 0;
+}
@@ -0,0 +1,100 @@
+/**
+ * Benchmark for node location indexes. Reads the OSM file given on the
+ * command line into memory, stores all node locations in each of the
+ * location index types given (default: flex_mem and compact) and then looks
+ * up the locations of all way nodes. Prints the time needed for both and
+ * the memory used by the index.
+ *
+ * Usage: bench-locations OSMFILE [INDEX_TYPE...]
+ */
+
+#include "location-store.hpp"
+
+#include <osmium/index/node_locations_map.hpp>
+#include <osmium/io/any_input.hpp>
+#include <osmium/memory/buffer.hpp>
+#include <osmium/osm.hpp>
+
+#include <chrono>
+#include <cstddef>
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace {
+
+using map_factory_type =
+    osmium::index::MapFactory<osmium::unsigned_object_id_type,
+                              osmium::Location>;
+
+void run(std::string const &index_type, osmium::memory::Buffer const &buffer)
+{
+    auto index = map_factory_type::instance().create_map(index_type);
+
+    std::size_t nodes = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (auto const &node : buffer.select<osmium::Node>()) {
+        index->set(node.positive_id(), node.location());
+        ++nodes;
+    }
+    index->sort();
+    std::chrono::duration<double> const set_duration =
+        std::chrono::steady_clock::now() - start;
+
+    std::size_t refs = 0;
+    std::size_t found = 0;
+    start = std::chrono::steady_clock::now();
+    for (auto const &way : buffer.select<osmium::Way>()) {
+        for (auto const &nr : way.nodes()) {
+            if (index->get_noexcept(nr.positive_ref()).valid()) {
+                ++found;
+            }
+            ++refs;
+        }
+    }
+    std::chrono::duration<double> const get_duration =
+        std::chrono::steady_clock::now() - start;
+
+    std::cout << index_type << ":\n";
+    std::cout << "  set: " << nodes << " nodes in " << set_duration.count()
+              << " s = "
+              << (static_cast<double>(nodes) / set_duration.count())
+              << " nodes/s\n";
+    std::cout << "  get: " << refs << " way nodes (" << found << " found) in "
+              << get_duration.count() << " s = "
+              << (static_cast<double>(refs) / get_duration.count())
+              << " lookups/s\n";
+    std::cout << "  memory: "
+              << (static_cast<double>(index->used_memory()) / 1024 / 1024)
+              << " MB = "
+              << (static_cast<double>(index->used_memory()) /
+                  static_cast<double>(nodes))
+              << " bytes/node\n";
+}
+
+} // anonymous namespace
+
+int main(int argc, char *argv[])
+{
+    if (argc < 2) {
+        std::cerr << "Usage: bench-locations OSMFILE [INDEX_TYPE...]\n";
+        return 2;
+    }
+
+    register_compact_location_store();
+
+    auto const buffer =
+        osmium::io::read_file(argv[1], osmium::osm_entity_bits::node |
+                                           osmium::osm_entity_bits::way);
+
+    std::vector<std::string> index_types{argv + 2, argv + argc};
+    if (index_types.empty()) {
+        index_types = {"flex_mem", "compact"};
+    }
+
+    for (auto const &index_type : index_types) {
+        run(index_type, buffer);
+    }
+
+    return 0;
+}
@@ -0,0 +1,102 @@
+/**
+ * Benchmark for the different ways of writing output files. Writes the same
+ * amount of data into a number of files, round-robin in chunks like the
+ * tables do, once with write() and once or twice with io_uring.
+ *
+ * Usage: bench-output [DIR [NUM_FILES [MB_PER_FILE [CHUNK_KB]]]]
+ */
+
+#include "options.hpp"
+#include "sink.hpp"
+#include "uring.hpp"
+
+#include <chrono>
+#include <cstdlib>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+Options opts;
+
+namespace {
+
+using sink_factory = std::function<std::unique_ptr<Sink>(std::string const &)>;
+
+void run(char const *name, sink_factory const &create, std::string const &dir,
+         std::size_t num_files, std::size_t mb_per_file,
+         std::string const &chunk)
+{
+    auto const start = std::chrono::steady_clock::now();
+
+    std::vector<std::unique_ptr<Sink>> sinks;
+    for (std::size_t n = 0; n < num_files; ++n) {
+        sinks.push_back(create(dir + "/bench-output-" + std::to_string(n)));
+    }
+
+    std::size_t const total = mb_per_file * 1024 * 1024;
+    for (std::size_t written = 0; written < total; written += chunk.size()) {
+        for (auto &sink : sinks) {
+            sink->write(chunk);
+        }
+    }
+
+    for (auto &sink : sinks) {
+        sink->close();
+    }
+
+    std::chrono::duration<double> const duration =
+        std::chrono::steady_clock::now() - start;
+    auto const mb = static_cast<double>(num_files * mb_per_file);
+    std::cout << name << ": " << mb << " MB in " << duration.count()
+              << " s = " << (mb / duration.count()) << " MB/s\n";
+
+    for (std::size_t n = 0; n < num_files; ++n) {
+        std::remove((dir + "/bench-output-" + std::to_string(n)).c_str());
+    }
+}
+
+std::size_t arg(int argc, char *argv[], int n, std::size_t default_value)
+{
+    return argc > n ? std::strtoul(argv[n], nullptr, 10) : default_value;
+}
+
+} // anonymous namespace
+
+int main(int argc, char *argv[])
+{
+    std::string const dir = argc > 1 ? argv[1] : ".";
+    auto const num_files = arg(argc, argv, 2, 12);
+    auto const mb_per_file = arg(argc, argv, 3, 256);
+    auto const chunk_size = arg(argc, argv, 4, 1000) * 1024;
+
+    std::string chunk;
+    while (chunk.size() < chunk_size) {
+        chunk += "1234567\t\\N\t2020-01-01T00:00:00Z\t{\"highway\":\"primary\"}\n";
+    }
+    chunk.resize(chunk_size);
+
+    run(
+        "write()",
+        [](std::string const &filename) {
+            return std::make_unique<FileSink>(filename);
+        },
+        dir, num_files, mb_per_file, chunk);
+
+    for (bool const direct : {false, true}) {
+        auto writer = UringWriter::shared(chunk_size, direct);
+        if (!writer) {
+            std::cout << "io_uring not available\n";
+            return 1;
+        }
+        run(
+            direct ? "io_uring O_DIRECT" : "io_uring",
+            [&writer](std::string const &filename) {
+                return std::make_unique<UringSink>(writer, filename);
+            },
+            dir, num_files, mb_per_file, chunk);
+    }
+
+    return 0;
+}
@@ -0,0 +1,91 @@
+/**
+ * Benchmark for formatting table rows. Reads all objects from the OSM file
+ * given on the command line into memory and then formats them for each of
+ * the streams given (or the default set of streams) with their default
+ * columns. Prints the number of rows formatted per second for each stream.
+ *
+ * Usage: bench-rows OSMFILE [STREAM...]
+ */
+
+#include "options.hpp"
+#include "table.hpp"
+
+#include <osmium/io/any_input.hpp>
+#include <osmium/memory/buffer.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+Options opts;
+
+namespace {
+
+void run(std::string const &stream, osmium::memory::Buffer const &buffer)
+{
+    // Tables are only created to get a formatter with the right columns,
+    // they are never opened.
+    std::string const filename{"bench-rows-" + stream};
+    auto table = create_table(opts, filename + "=" + stream);
+    auto formatter = table->create_formatter();
+
+    std::size_t rows = 0;
+    std::size_t bytes = 0;
+    auto const take_rows = [&]() {
+        auto const data = formatter->take_rows();
+        rows += static_cast<std::size_t>(
+            std::count(data.begin(), data.end(), '\n'));
+        bytes += data.size();
+    };
+
+    auto const start = std::chrono::steady_clock::now();
+    std::size_t count = 0;
+    for (auto const &object : buffer.select<osmium::OSMObject>()) {
+        if (formatter->matches(object.type())) {
+            formatter->add_row(object, osmium::Timestamp{});
+            if (++count % 10000 == 0) {
+                take_rows();
+            }
+        }
+    }
+    take_rows();
+    std::chrono::duration<double> const duration =
+        std::chrono::steady_clock::now() - start;
+
+    std::cout << stream << " (" << formatter->columns_string()
+              << "): " << rows << " rows, "
+              << (static_cast<double>(bytes) / 1024 / 1024) << " MB in "
+              << duration.count() << " s = "
+              << (static_cast<double>(rows) / duration.count())
+              << " rows/s\n";
+}
+
+} // anonymous namespace
+
+int main(int argc, char *argv[])
+{
+    if (argc < 2) {
+        std::cerr << "Usage: bench-rows OSMFILE [STREAM...]\n";
+        return 2;
+    }
+
+    opts.buffer_count = 1;
+
+    auto const buffer =
+        osmium::io::read_file(argv[1], osmium::osm_entity_bits::nwr);
+
+    std::vector<std::string> streams{argv + 2, argv + argc};
+    if (streams.empty()) {
+        streams = {"o", "oT", "wN", "rM"};
+    }
+
+    for (auto const &stream : streams) {
+        run(stream, buffer);
+    }
+
+    return 0;
+}
@@ -0,0 +1,149 @@
+/**
+ * Benchmark for the tag filter. Reads the OSM file given on the command line
+ * into memory and matches all objects against the filter expressions given
+ * (default: a typical set for a thematic export), once with the compiled
+ * TagFilter and once with a simple matcher comparing every tag with every
+ * expression.
+ *
+ * Usage: bench-tag-filter OSMFILE [EXPRESSION...]
+ */
+
+#include "tag-filter.hpp"
+
+#include <osmium/io/any_input.hpp>
+#include <osmium/memory/buffer.hpp>
+#include <osmium/osm.hpp>
+
+#include <chrono>
+#include <cstddef>
+#include <iostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace {
+
+// The straightforward implementation the TagFilter is compared with.
+class SimpleFilter
+{
+
+    struct expression_type
+    {
+        std::string types;
+        std::string key;
+        std::vector<std::string> values;
+    };
+
+    std::vector<expression_type> m_expressions;
+
+public:
+    void add(std::string const &expression)
+    {
+        expression_type expr;
+        std::string str = expression;
+        auto const slash = str.find('/');
+        if (slash != std::string::npos &&
+            str.substr(0, slash).find_first_not_of("nwra") ==
+                std::string::npos) {
+            expr.types = str.substr(0, slash);
+            str.erase(0, slash + 1);
+        } else {
+            expr.types = "nwra";
+        }
+
+        auto const equal = str.find('=');
+        expr.key = str.substr(0, equal);
+        if (equal != std::string::npos) {
+            std::string rest = str.substr(equal + 1);
+            std::size_t pos = 0;
+            while (true) {
+                auto const comma = rest.find(',', pos);
+                expr.values.push_back(rest.substr(pos, comma - pos));
+                if (comma == std::string::npos) {
+                    break;
+                }
+                pos = comma + 1;
+            }
+        }
+        m_expressions.push_back(std::move(expr));
+    }
+
+    bool matches(osmium::OSMObject const &object) const
+    {
+        char const type = osmium::item_type_to_char(object.type());
+        for (auto const &expr : m_expressions) {
+            if (expr.types.find(type) == std::string::npos) {
+                continue;
+            }
+            for (auto const &tag : object.tags()) {
+                if (expr.key != tag.key()) {
+                    continue;
+                }
+                if (expr.values.empty()) {
+                    return true;
+                }
+                for (auto const &value : expr.values) {
+                    if (value == tag.value()) {
+                        return true;
+                    }
+                }
+            }
+        }
+        return false;
+    }
+
+}; // class SimpleFilter
+
+template <typename TFilter>
+void run(char const *name, TFilter const &filter,
+         osmium::memory::Buffer const &buffer)
+{
+    std::size_t objects = 0;
+    std::size_t matched = 0;
+    auto const start = std::chrono::steady_clock::now();
+    for (auto const &object : buffer.select<osmium::OSMObject>()) {
+        if (filter.matches(object)) {
+            ++matched;
+        }
+        ++objects;
+    }
+    std::chrono::duration<double> const duration =
+        std::chrono::steady_clock::now() - start;
+
+    std::cout << name << ": " << objects << " objects (" << matched
+              << " matched) in " << duration.count() << " s = "
+              << (static_cast<double>(objects) / duration.count())
+              << " objects/s\n";
+}
+
+} // anonymous namespace
+
+int main(int argc, char *argv[])
+{
+    if (argc < 2) {
+        std::cerr << "Usage: bench-tag-filter OSMFILE [EXPRESSION...]\n";
+        return 2;
+    }
+
+    std::vector<std::string> expressions{argv + 2, argv + argc};
+    if (expressions.empty()) {
+        expressions = {"w/highway=motorway,trunk,primary,secondary,tertiary",
+                       "n/amenity=restaurant,cafe,pub,bar,fast_food",
+                       "wr/building", "nw/shop", "r/type=route"};
+    }
+
+    TagFilter tag_filter;
+    SimpleFilter simple_filter;
+    for (auto const &expression : expressions) {
+        tag_filter.add(expression);
+        simple_filter.add(expression);
+    }
+
+    auto const buffer =
+        osmium::io::read_file(argv[1], osmium::osm_entity_bits::nwr);
+
+    run("simple", simple_filter, buffer);
+    run("compiled", tag_filter, buffer);
+
+    return 0;
+}
@@ -0,0 +1,380 @@
+#include "area-assembly.hpp"
+
+#include <osmium/io/any_input.hpp>
+#include <osmium/io/any_output.hpp>
+#include <osmium/visitor.hpp>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <stdexcept>
+#include <utility>
+
+namespace {
+
+// Maximum number of pieces of work waiting for a thread.
+constexpr std::size_t max_queue_size = 64;
+
+// Maximum number of pieces of work in progress or waiting to be handed on.
+constexpr std::uint64_t max_in_flight = 1024;
+
+// Closed ways are collected into pieces of work of about this size.
+constexpr std::size_t ways_batch_size = 1024UL * 1024UL;
+
+constexpr std::size_t initial_buffer_size = 64UL * 1024UL;
+
+// First line of the file next to the relations cache identifying the input
+// file. Increase the version if the rules selecting relations change.
+constexpr char const *const cache_version = "ope relations cache v2";
+
+// The identity can't be kept in the header of the cache file, the PBF format
+// only stores some well-known header options.
+std::string cache_identity_filename(std::string const &cache_filename)
+{
+    return cache_filename + ".id";
+}
+
+std::string input_file_identity(osmium::io::File const &input_file)
+{
+    if (input_file.filename().empty()) {
+        throw std::runtime_error{"Can't use relations cache with STDIN"};
+    }
+
+    std::filesystem::path const path{input_file.filename()};
+    auto const absolute = std::filesystem::absolute(path).string();
+    auto const size = std::filesystem::file_size(path);
+    auto const mtime =
+        std::filesystem::last_write_time(path).time_since_epoch().count();
+
+    return absolute + ':' + std::to_string(size) + ':' +
+           std::to_string(mtime);
+}
+
+bool cache_matches(std::string const &cache_filename,
+                   std::string const &identity)
+{
+    if (!std::filesystem::exists(cache_filename)) {
+        return false;
+    }
+
+    std::ifstream file{cache_identity_filename(cache_filename)};
+    std::string version;
+    std::string source;
+    if (!std::getline(file, version) || !std::getline(file, source)) {
+        return false;
+    }
+    return version == cache_version && source == identity;
+}
+
+void write_cache_identity(std::string const &cache_filename,
+                          std::string const &identity)
+{
+    auto const filename = cache_identity_filename(cache_filename);
+    std::ofstream file{filename};
+    file << cache_version << '\n' << identity << '\n';
+    file.close();
+    if (!file) {
+        throw std::runtime_error{"Error writing '" + filename + "'"};
+    }
+}
+
+std::unique_ptr<osmium::io::Writer> open_cache(std::string const &filename)
+{
+    osmium::io::Header header;
+    header.set("generator", "ope");
+
+    return std::make_unique<osmium::io::Writer>(
+        osmium::io::File{filename, "pbf"}, header,
+        osmium::io::overwrite::allow);
+}
+
+} // anonymous namespace
+
+AreaAssemblerPool::AreaAssemblerPool(
+    osmium::area::Assembler::config_type const &config,
+    unsigned int num_threads, callback_func callback)
+: m_config(config), m_callback(std::move(callback)), m_queue(max_queue_size),
+  m_sequencer(
+      [this](osmium::memory::Buffer &&buffer) { deliver(std::move(buffer)); }),
+  m_ways(initial_buffer_size, osmium::memory::Buffer::auto_grow::yes)
+{
+    for (unsigned int n = 0; n < num_threads; ++n) {
+        m_threads.emplace_back(&AreaAssemblerPool::run, this);
+    }
+}
+
+AreaAssemblerPool::~AreaAssemblerPool()
+{
+    try {
+        stop();
+    } catch (...) {
+        // ignore exceptions in destructor
+    }
+}
+
+void AreaAssemblerPool::set_error(std::exception_ptr error)
+{
+    std::lock_guard<std::mutex> const lock{m_mutex};
+    if (!m_error) {
+        m_error = std::move(error);
+    }
+}
+
+void AreaAssemblerPool::deliver(osmium::memory::Buffer &&buffer)
+{
+    // After an error results are still counted but not handed on, so that
+    // nothing waits for them forever.
+    bool failed = false;
+    {
+        std::lock_guard<std::mutex> const lock{m_mutex};
+        failed = static_cast<bool>(m_error);
+    }
+    if (!failed && buffer.committed() > 0) {
+        try {
+            m_callback(std::move(buffer));
+        } catch (...) {
+            set_error(std::current_exception());
+        }
+    }
+
+    {
+        std::lock_guard<std::mutex> const lock{m_mutex};
+        ++m_delivered;
+    }
+    m_delivered_cv.notify_one();
+}
+
+void AreaAssemblerPool::run()
+{
+    while (true) {
+        auto work = m_queue.pop();
+        if (!work.buffer) {
+            return;
+        }
+
+        osmium::memory::Buffer out{initial_buffer_size,
+                                   osmium::memory::Buffer::auto_grow::yes};
+        try {
+            if (work.relation) {
+                std::vector<osmium::Way const *> ways;
+                for (auto const &way : work.buffer.select<osmium::Way>()) {
+                    ways.push_back(&way);
+                }
+                auto const &relation =
+                    *work.buffer.select<osmium::Relation>().begin();
+                try {
+                    osmium::area::Assembler assembler{m_config};
+                    assembler(relation, ways, out);
+                } catch (osmium::invalid_location const &) {
+                    // ignore relations with missing node locations
+                }
+            } else {
+                for (auto const &way : work.buffer.select<osmium::Way>()) {
+                    try {
+                        osmium::area::Assembler assembler{m_config};
+                        assembler(way, out);
+                    } catch (osmium::invalid_location const &) {
+                        // ignore ways with missing node locations
+                    }
+                }
+            }
+        } catch (...) {
+            set_error(std::current_exception());
+        }
+
+        // Always add the result, even if empty, otherwise the sequencer
+        // would wait for it forever.
+        m_sequencer.add(work.seq, std::move(out));
+    }
+}
+
+void AreaAssemblerPool::dispatch(osmium::memory::Buffer &&buffer,
+                                 bool relation)
+{
+    std::uint64_t seq = 0;
+    {
+        std::unique_lock<std::mutex> lock{m_mutex};
+        m_delivered_cv.wait(lock, [this] {
+            return m_next_seq - m_delivered < max_in_flight;
+        });
+        seq = m_next_seq++;
+    }
+    m_queue.push(work_type{seq, relation, std::move(buffer)});
+}
+
+void AreaAssemblerPool::dispatch_ways()
+{
+    if (m_ways.committed() == 0) {
+        return;
+    }
+    dispatch(std::exchange(m_ways,
+                           osmium::memory::Buffer{
+                               initial_buffer_size,
+                               osmium::memory::Buffer::auto_grow::yes}),
+             false);
+}
+
+void AreaAssemblerPool::add_relation(
+    osmium::Relation const &relation,
+    std::vector<osmium::Way const *> const &ways)
+{
+    // Closed ways seen before this relation was completed come first.
+    dispatch_ways();
+
+    osmium::memory::Buffer buffer{initial_buffer_size,
+                                  osmium::memory::Buffer::auto_grow::yes};
+    buffer.add_item(relation);
+    buffer.commit();
+    for (auto const *way : ways) {
+        buffer.add_item(*way);
+        buffer.commit();
+    }
+    dispatch(std::move(buffer), true);
+}
+
+void AreaAssemblerPool::add_way(osmium::Way const &way)
+{
+    m_ways.add_item(way);
+    m_ways.commit();
+    if (m_ways.committed() > ways_batch_size) {
+        dispatch_ways();
+    }
+}
+
+void AreaAssemblerPool::stop()
+{
+    if (m_threads.empty()) {
+        return;
+    }
+
+    for (std::size_t n = 0; n < m_threads.size(); ++n) {
+        m_queue.push(work_type{});
+    }
+    for (auto &thread : m_threads) {
+        thread.join();
+    }
+    m_threads.clear();
+}
+
+void AreaAssemblerPool::finish()
+{
+    dispatch_ways();
+    stop();
+    if (m_error) {
+        std::rethrow_exception(m_error);
+    }
+}
+
+bool ParallelMultipolygonManager::new_relation(
+    osmium::Relation const &relation) const noexcept
+{
+    char const *type = relation.tags().get_value_by_key("type");
+    if (type == nullptr) {
+        return false;
+    }
+    if (std::strcmp(type, "multipolygon") != 0 &&
+        std::strcmp(type, "boundary") != 0) {
+        return false;
+    }
+    return std::any_of(relation.members().cbegin(), relation.members().cend(),
+                       [](osmium::RelationMember const &member) {
+                           return member.type() == osmium::item_type::way;
+                       });
+}
+
+void ParallelMultipolygonManager::complete_relation(
+    osmium::Relation const &relation)
+{
+    std::vector<osmium::Way const *> ways;
+    ways.reserve(relation.members().size());
+    for (auto const &member : relation.members()) {
+        if (member.ref() != 0) {
+            ways.push_back(this->get_member_way(member.ref()));
+        }
+    }
+    m_pool->add_relation(relation, ways);
+}
+
+void ParallelMultipolygonManager::after_way(osmium::Way const &way)
+{
+    // At least 4 nodes are needed for a polygon
+    if (way.nodes().size() <= 3) {
+        return;
+    }
+
+    if (!way.nodes().front().location() || !way.nodes().back().location()) {
+        return;
+    }
+
+    if (!way.ends_have_same_location() || way.tags().empty() ||
+        way.tags().has_tag("area", "no")) {
+        return;
+    }
+
+    m_pool->add_way(way);
+}
+
+bool read_area_relations(osmium::io::File const &input_file,
+                         std::string const &cache_filename,
+                         ParallelMultipolygonManager &manager,
+                         relations_func const &next)
+{
+    std::string identity;
+    bool use_cache = false;
+    if (!cache_filename.empty()) {
+        identity = input_file_identity(input_file);
+        use_cache = cache_matches(cache_filename, identity);
+    }
+
+    if (use_cache) {
+        osmium::relations::read_relations(
+            osmium::io::File{cache_filename, "pbf"}, manager);
+        if (next) {
+            osmium::io::Reader reader{input_file,
+                                      osmium::osm_entity_bits::relation};
+            while (auto buffer = reader.read()) {
+                next(std::move(buffer));
+            }
+            reader.close();
+        }
+        return true;
+    }
+
+    // Write to a temporary file first, so that an interrupted run doesn't
+    // leave an incomplete cache file behind.
+    std::string const tmp_filename{cache_filename + ".tmp"};
+    std::unique_ptr<osmium::io::Writer> writer;
+    if (!cache_filename.empty()) {
+        // The old cache file is no longer valid, even if this run fails.
+        std::filesystem::remove(cache_identity_filename(cache_filename));
+        writer = open_cache(tmp_filename);
+    }
+
+    osmium::io::Reader reader{input_file, osmium::osm_entity_bits::relation};
+    while (auto buffer = reader.read()) {
+        osmium::apply(buffer, manager);
+        if (writer) {
+            for (auto const &relation : buffer.select<osmium::Relation>()) {
+                if (manager.new_relation(relation)) {
+                    (*writer)(relation);
+                }
+            }
+        }
+        if (next) {
+            next(std::move(buffer));
+        }
+    }
+    reader.close();
+    manager.prepare_for_lookup();
+
+    if (writer) {
+        writer->close();
+        std::filesystem::rename(tmp_filename, cache_filename);
+        write_cache_identity(cache_filename, identity);
+    }
+
+    return false;
+}
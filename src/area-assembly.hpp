@@ -0,0 +1,156 @@
+#pragma once
+
+#include "queue.hpp"
+#include "sequencer.hpp"
+
+#include <osmium/area/assembler.hpp>
+#include <osmium/io/file.hpp>
+#include <osmium/memory/buffer.hpp>
+#include <osmium/osm.hpp>
+#include <osmium/relations/relations_manager.hpp>
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+ * Assembles areas on a pool of threads. Each piece of work is a buffer with
+ * a relation and its member ways or with a batch of closed ways. The
+ * resulting areas are handed to the callback in the order the work was
+ * added, so the output is the same as with a single thread.
+ */
+class AreaAssemblerPool
+{
+public:
+    using callback_func = std::function<void(osmium::memory::Buffer &&)>;
+
+    AreaAssemblerPool(osmium::area::Assembler::config_type const &config,
+                      unsigned int num_threads, callback_func callback);
+
+    AreaAssemblerPool(AreaAssemblerPool const &) = delete;
+    AreaAssemblerPool &operator=(AreaAssemblerPool const &) = delete;
+
+    AreaAssemblerPool(AreaAssemblerPool &&) = delete;
+    AreaAssemblerPool &operator=(AreaAssemblerPool &&) = delete;
+
+    ~AreaAssemblerPool();
+
+    /// Add a relation with its member ways (in member order).
+    void add_relation(osmium::Relation const &relation,
+                      std::vector<osmium::Way const *> const &ways);
+
+    /// Add a closed way.
+    void add_way(osmium::Way const &way);
+
+    /**
+     * Wait until all areas are assembled and handed to the callback.
+     * Rethrows the first exception thrown in any of the threads.
+     */
+    void finish();
+
+private:
+    struct work_type
+    {
+        std::uint64_t seq = 0;
+        bool relation = false;
+
+        // Invalid buffer marks the end.
+        osmium::memory::Buffer buffer{};
+    };
+
+    osmium::area::Assembler::config_type m_config;
+    callback_func m_callback;
+
+    Queue<work_type> m_queue;
+    Sequencer<osmium::memory::Buffer> m_sequencer;
+    std::vector<std::thread> m_threads;
+
+    // Closed ways collected for the next piece of work
+    osmium::memory::Buffer m_ways;
+
+    // Sequence number for the next piece of work and number of pieces
+    // handed to the callback. Used to limit the number of results waiting
+    // for an earlier one (which can take long for large relations).
+    std::uint64_t m_next_seq = 0;
+    std::uint64_t m_delivered = 0;
+    std::mutex m_mutex;
+    std::condition_variable m_delivered_cv;
+
+    std::exception_ptr m_error{};
+
+    void run();
+
+    void set_error(std::exception_ptr error);
+
+    void deliver(osmium::memory::Buffer &&buffer);
+
+    void dispatch(osmium::memory::Buffer &&buffer, bool relation);
+
+    void dispatch_ways();
+
+    void stop();
+
+}; // class AreaAssemblerPool
+
+/**
+ * Replacement for osmium::area::MultipolygonManager handing the assembly of
+ * areas to an AreaAssemblerPool instead of doing it in the second pass
+ * itself. Uses the same rules to decide which relations and closed ways
+ * become areas.
+ */
+class ParallelMultipolygonManager
+: public osmium::relations::RelationsManager<ParallelMultipolygonManager,
+                                             false, true, false>
+{
+
+    AreaAssemblerPool *m_pool;
+
+public:
+    explicit ParallelMultipolygonManager(AreaAssemblerPool &pool)
+    : m_pool(&pool)
+    {
+    }
+
+    bool new_relation(osmium::Relation const &relation) const noexcept;
+
+    bool new_member(osmium::Relation const & /*relation*/,
+                    osmium::RelationMember const &member,
+                    std::size_t /*n*/) const noexcept
+    {
+        return member.type() == osmium::item_type::way;
+    }
+
+    void complete_relation(osmium::Relation const &relation);
+
+    void after_way(osmium::Way const &way);
+
+}; // class ParallelMultipolygonManager
+
+/// Callback for the buffers of relations read from the input file.
+using relations_func = std::function<void(osmium::memory::Buffer &&)>;
+
+/**
+ * First pass for the area assembly: Read the relations from the input file
+ * into the manager. If next is set, all buffers with relations read from the
+ * input file are handed to it afterwards, so that tables only needing
+ * relations can be filled in the same pass.
+ *
+ * If cache_filename is not empty, the relations that can become areas are
+ * kept in an OSM file with this name. The name, size and modification time
+ * of the input file are written into a file with the same name plus ".id"
+ * next to it. If they match on a later run, the
+ * relations are read from the cache file instead of the input file. The
+ * input file is then only read if next is set.
+ *
+ * Returns true if the cache file was used.
+ */
+bool read_area_relations(osmium::io::File const &input_file,
+                         std::string const &cache_filename,
+                         ParallelMultipolygonManager &manager,
+                         relations_func const &next = {});
@@ -0,0 +1,72 @@
+#include "buffer-stage.hpp"
+
+#include <utility>
+
+BufferStage::BufferStage(std::size_t max_queue_size, process_func process,
+                         next_func next)
+: m_queue(max_queue_size), m_process(std::move(process)),
+  m_next(std::move(next))
+{
+    m_thread = std::thread{&BufferStage::run, this};
+}
+
+BufferStage::~BufferStage()
+{
+    try {
+        stop();
+    } catch (...) {
+        // ignore exceptions in destructor
+    }
+}
+
+void BufferStage::run()
+{
+    StopWatch watch;
+    while (auto buffer = m_queue.pop()) {
+        m_stats.add_input_wait(watch.lap());
+
+        // After an error keep taking buffers from the queue so that the
+        // previous stage doesn't block, they are just not processed any more.
+        if (m_failed) {
+            continue;
+        }
+
+        try {
+            m_stats.add_buffer(buffer.committed());
+            m_process(buffer);
+            m_stats.add_busy(watch.lap());
+            m_next(std::move(buffer));
+            m_stats.add_output_wait(watch.lap());
+        } catch (...) {
+            m_error = std::current_exception();
+            m_failed = true;
+        }
+    }
+}
+
+void BufferStage::check_error()
+{
+    if (m_failed) {
+        std::rethrow_exception(m_error);
+    }
+}
+
+void BufferStage::operator()(osmium::memory::Buffer &&buffer)
+{
+    check_error();
+    m_queue.push(std::move(buffer));
+}
+
+void BufferStage::stop()
+{
+    if (m_thread.joinable()) {
+        m_queue.push(osmium::memory::Buffer{});
+        m_thread.join();
+    }
+}
+
+void BufferStage::finish()
+{
+    stop();
+    check_error();
+}
@@ -0,0 +1,74 @@
+#pragma once
+
+#include "queue.hpp"
+#include "stats.hpp"
+
+#include <osmium/memory/buffer.hpp>
+
+#include <atomic>
+#include <cstddef>
+#include <exception>
+#include <functional>
+#include <thread>
+
+/**
+ * A stage of the processing pipeline running on a thread of its own.
+ * Buffers handed to it are queued and processed in order on the stage
+ * thread, then they are handed on to the next stage. If the queue is full
+ * the caller blocks.
+ */
+class BufferStage
+{
+public:
+    using process_func = std::function<void(osmium::memory::Buffer &)>;
+    using next_func = std::function<void(osmium::memory::Buffer &&)>;
+
+    BufferStage(std::size_t max_queue_size, process_func process,
+                next_func next);
+
+    BufferStage(BufferStage const &) = delete;
+    BufferStage &operator=(BufferStage const &) = delete;
+
+    BufferStage(BufferStage &&) = delete;
+    BufferStage &operator=(BufferStage &&) = delete;
+
+    ~BufferStage();
+
+    /**
+     * Hand a buffer to the stage. Rethrows an exception thrown on the stage
+     * thread, so the caller stops early.
+     */
+    void operator()(osmium::memory::Buffer &&buffer);
+
+    /**
+     * Wait for the stage to process the remaining buffers. Rethrows an
+     * exception thrown on the stage thread.
+     */
+    void finish();
+
+    /// Statistics for this stage, only valid after finish().
+    StageStats const &stats() const noexcept { return m_stats; }
+
+    Queue<osmium::memory::Buffer> &queue() noexcept { return m_queue; }
+
+private:
+    // An invalid buffer marks the end.
+    Queue<osmium::memory::Buffer> m_queue;
+
+    process_func m_process;
+    next_func m_next;
+    StageStats m_stats;
+
+    // Set by the stage thread, m_failed is set after m_error.
+    std::exception_ptr m_error{};
+    std::atomic<bool> m_failed{false};
+
+    std::thread m_thread;
+
+    void run();
+
+    void stop();
+
+    void check_error();
+
+}; // class BufferStage
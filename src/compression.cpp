@@ -0,0 +1,337 @@
+#include "compression.hpp"
+
+#include <zlib.h>
+
+#ifdef OPE_WITH_ZSTD
+#include <zstd.h>
+#endif
+
+#ifdef OPE_WITH_LZ4
+#include <lz4frame.h>
+#endif
+
+#include <stdexcept>
+#include <utility>
+
+namespace {
+
+// Maximum number of buffers waiting for compression.
+constexpr std::size_t max_queue_size = 4;
+
+bool has_suffix(std::string_view filename, std::string_view suffix) noexcept
+{
+    return filename.size() > suffix.size() &&
+           filename.substr(filename.size() - suffix.size()) == suffix;
+}
+
+class GzipCompressor : public Compressor
+{
+
+    z_stream m_stream{};
+
+    void deflate_into(std::string_view data, std::string &out, int flush)
+    {
+        // zlib doesn't change the input, the old API just isn't const
+        // NOLINTNEXTLINE(cppcoreguidelines-pro-type-const-cast)
+        m_stream.next_in =
+            reinterpret_cast<Bytef *>(const_cast<char *>(data.data()));
+        m_stream.avail_in = static_cast<uInt>(data.size());
+
+        int result = Z_OK;
+        do {
+            auto const offset = out.size();
+            auto const chunk_size =
+                deflateBound(&m_stream, m_stream.avail_in) + 64;
+            out.resize(offset + chunk_size);
+            m_stream.next_out = reinterpret_cast<Bytef *>(out.data() + offset);
+            m_stream.avail_out = static_cast<uInt>(chunk_size);
+            result = deflate(&m_stream, flush);
+            if (result == Z_STREAM_ERROR) {
+                throw std::runtime_error{"gzip compression failed"};
+            }
+            out.resize(out.size() - m_stream.avail_out);
+        } while (m_stream.avail_out == 0 ||
+                 (flush == Z_FINISH && result != Z_STREAM_END));
+    }
+
+public:
+    GzipCompressor()
+    {
+        // window bits 15 + 16 means: write gzip header
+        if (deflateInit2(&m_stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 15 + 16,
+                         8, Z_DEFAULT_STRATEGY) != Z_OK) {
+            throw std::runtime_error{"gzip initialization failed"};
+        }
+    }
+
+    ~GzipCompressor() override { deflateEnd(&m_stream); }
+
+    GzipCompressor(GzipCompressor const &) = delete;
+    GzipCompressor &operator=(GzipCompressor const &) = delete;
+
+    GzipCompressor(GzipCompressor &&) = delete;
+    GzipCompressor &operator=(GzipCompressor &&) = delete;
+
+    void compress(std::string_view data, std::string &out) override
+    {
+        deflate_into(data, out, Z_NO_FLUSH);
+    }
+
+    void finish(std::string &out) override { deflate_into({}, out, Z_FINISH); }
+
+}; // class GzipCompressor
+
+#ifdef OPE_WITH_ZSTD
+class ZstdCompressor : public Compressor
+{
+
+    ZSTD_CCtx *m_ctx;
+
+    void compress_into(std::string_view data, std::string &out,
+                       ZSTD_EndDirective mode)
+    {
+        ZSTD_inBuffer input{data.data(), data.size(), 0};
+        std::size_t remaining = 0;
+        do {
+            auto const offset = out.size();
+            auto const chunk_size = ZSTD_CStreamOutSize();
+            out.resize(offset + chunk_size);
+            ZSTD_outBuffer output{out.data() + offset, chunk_size, 0};
+            remaining = ZSTD_compressStream2(m_ctx, &output, &input, mode);
+            if (ZSTD_isError(remaining)) {
+                throw std::runtime_error{
+                    std::string{"zstd compression failed: "} +
+                    ZSTD_getErrorName(remaining)};
+            }
+            out.resize(offset + output.pos);
+        } while (input.pos < input.size ||
+                 (mode == ZSTD_e_end && remaining != 0));
+    }
+
+public:
+    ZstdCompressor() : m_ctx(ZSTD_createCCtx())
+    {
+        if (!m_ctx) {
+            throw std::runtime_error{"zstd initialization failed"};
+        }
+    }
+
+    ~ZstdCompressor() override { ZSTD_freeCCtx(m_ctx); }
+
+    ZstdCompressor(ZstdCompressor const &) = delete;
+    ZstdCompressor &operator=(ZstdCompressor const &) = delete;
+
+    ZstdCompressor(ZstdCompressor &&) = delete;
+    ZstdCompressor &operator=(ZstdCompressor &&) = delete;
+
+    void compress(std::string_view data, std::string &out) override
+    {
+        compress_into(data, out, ZSTD_e_continue);
+    }
+
+    void finish(std::string &out) override
+    {
+        compress_into({}, out, ZSTD_e_end);
+    }
+
+}; // class ZstdCompressor
+#endif
+
+#ifdef OPE_WITH_LZ4
+class Lz4Compressor : public Compressor
+{
+
+    LZ4F_cctx *m_ctx = nullptr;
+    bool m_started = false;
+
+    static void check(std::size_t result)
+    {
+        if (LZ4F_isError(result)) {
+            throw std::runtime_error{std::string{"lz4 compression failed: "} +
+                                     LZ4F_getErrorName(result)};
+        }
+    }
+
+    void start(std::string &out)
+    {
+        auto const offset = out.size();
+        out.resize(offset + LZ4F_HEADER_SIZE_MAX);
+        auto const size = LZ4F_compressBegin(m_ctx, out.data() + offset,
+                                             LZ4F_HEADER_SIZE_MAX, nullptr);
+        check(size);
+        out.resize(offset + size);
+        m_started = true;
+    }
+
+public:
+    Lz4Compressor()
+    {
+        check(LZ4F_createCompressionContext(&m_ctx, LZ4F_VERSION));
+    }
+
+    ~Lz4Compressor() override { LZ4F_freeCompressionContext(m_ctx); }
+
+    Lz4Compressor(Lz4Compressor const &) = delete;
+    Lz4Compressor &operator=(Lz4Compressor const &) = delete;
+
+    Lz4Compressor(Lz4Compressor &&) = delete;
+    Lz4Compressor &operator=(Lz4Compressor &&) = delete;
+
+    void compress(std::string_view data, std::string &out) override
+    {
+        if (!m_started) {
+            start(out);
+        }
+        auto const offset = out.size();
+        auto const bound = LZ4F_compressBound(data.size(), nullptr);
+        out.resize(offset + bound);
+        auto const size =
+            LZ4F_compressUpdate(m_ctx, out.data() + offset, bound, data.data(),
+                                data.size(), nullptr);
+        check(size);
+        out.resize(offset + size);
+    }
+
+    void finish(std::string &out) override
+    {
+        if (!m_started) {
+            start(out);
+        }
+        auto const offset = out.size();
+        auto const bound = LZ4F_compressBound(0, nullptr);
+        out.resize(offset + bound);
+        auto const size =
+            LZ4F_compressEnd(m_ctx, out.data() + offset, bound, nullptr);
+        check(size);
+        out.resize(offset + size);
+    }
+
+}; // class Lz4Compressor
+#endif
+
+} // anonymous namespace
+
+CompressingSink::CompressingSink(std::unique_ptr<Compressor> compressor,
+                                 std::unique_ptr<Sink> sink)
+: m_compressor(std::move(compressor)), m_sink(std::move(sink)),
+  m_queue(max_queue_size), m_thread(&CompressingSink::run, this)
+{
+}
+
+CompressingSink::~CompressingSink()
+{
+    try {
+        stop();
+    } catch (...) {
+        // ignore exceptions in destructor
+    }
+}
+
+void CompressingSink::run()
+{
+    std::string out;
+    while (true) {
+        auto const data = m_queue.pop();
+        bool const last = data.empty();
+
+        // After an error keep taking data from the queue so that the
+        // writer doesn't block, it is just not processed any more.
+        if (!m_failed) {
+            try {
+                if (last) {
+                    m_compressor->finish(out);
+                } else {
+                    m_compressor->compress(data, out);
+                }
+                if (!out.empty()) {
+                    m_sink->write(out);
+                    out.clear();
+                }
+                if (last) {
+                    m_sink->close();
+                }
+            } catch (...) {
+                m_error = std::current_exception();
+                m_failed = true;
+            }
+        }
+
+        if (last) {
+            return;
+        }
+    }
+}
+
+void CompressingSink::stop()
+{
+    if (m_thread.joinable()) {
+        m_queue.push(std::string{});
+        m_thread.join();
+    }
+}
+
+void CompressingSink::check_error()
+{
+    if (m_failed) {
+        std::rethrow_exception(m_error);
+    }
+}
+
+void CompressingSink::write(std::string_view data)
+{
+    check_error();
+    if (!data.empty()) {
+        m_queue.push(std::string{data});
+    }
+}
+
+void CompressingSink::close()
+{
+    stop();
+    check_error();
+}
+
+std::unique_ptr<Sink> create_file_sink(std::string const &filename)
+{
+    std::unique_ptr<Compressor> compressor;
+
+    if (has_suffix(filename, ".gz")) {
+        compressor = std::make_unique<GzipCompressor>();
+    } else if (has_suffix(filename, ".zst")) {
+#ifdef OPE_WITH_ZSTD
+        compressor = std::make_unique<ZstdCompressor>();
+#else
+        throw std::runtime_error{"Can't write '" + filename +
+                                 "': compiled without zstd support"};
+#endif
+    } else if (has_suffix(filename, ".lz4")) {
+#ifdef OPE_WITH_LZ4
+        compressor = std::make_unique<Lz4Compressor>();
+#else
+        throw std::runtime_error{"Can't write '" + filename +
+                                 "': compiled without lz4 support"};
+#endif
+    }
+
+    auto sink = open_file_sink(filename);
+    if (!compressor) {
+        return sink;
+    }
+
+    return std::make_unique<CompressingSink>(std::move(compressor),
+                                             std::move(sink));
+}
+
+std::string_view decompress_command(std::string_view filename) noexcept
+{
+    if (has_suffix(filename, ".gz")) {
+        return "zcat";
+    }
+    if (has_suffix(filename, ".zst")) {
+        return "zstdcat";
+    }
+    if (has_suffix(filename, ".lz4")) {
+        return "lz4cat";
+    }
+    return {};
+}
@@ -0,0 +1,94 @@
+#pragma once
+
+#include "queue.hpp"
+#include "sink.hpp"
+
+#include <atomic>
+#include <exception>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <thread>
+
+/**
+ * Interface for streaming compressors used by the CompressingSink.
+ */
+class Compressor
+{
+public:
+    Compressor() = default;
+
+    Compressor(Compressor const &) = delete;
+    Compressor &operator=(Compressor const &) = delete;
+
+    Compressor(Compressor &&) = delete;
+    Compressor &operator=(Compressor &&) = delete;
+
+    virtual ~Compressor() = default;
+
+    /// Compress data and append the result (if any) to out.
+    virtual void compress(std::string_view data, std::string &out) = 0;
+
+    /// Append whatever is still buffered in the compressor to out.
+    virtual void finish(std::string &out) = 0;
+
+}; // class Compressor
+
+/**
+ * Sink compressing the data on a background thread before handing it to
+ * another sink. Writing only copies the data into a queue, so the thread
+ * formatting the rows doesn't wait for the compression unless the queue is
+ * full.
+ */
+class CompressingSink : public Sink
+{
+
+    std::unique_ptr<Compressor> m_compressor;
+    std::unique_ptr<Sink> m_sink;
+
+    // An empty string marks the end of the data.
+    Queue<std::string> m_queue;
+
+    // Set by the background thread, m_failed is set after m_error.
+    std::exception_ptr m_error{};
+    std::atomic<bool> m_failed{false};
+
+    std::thread m_thread;
+
+    void run();
+
+    void stop();
+
+    void check_error();
+
+public:
+    CompressingSink(std::unique_ptr<Compressor> compressor,
+                    std::unique_ptr<Sink> sink);
+
+    ~CompressingSink() override;
+
+    CompressingSink(CompressingSink const &) = delete;
+    CompressingSink &operator=(CompressingSink const &) = delete;
+
+    CompressingSink(CompressingSink &&) = delete;
+    CompressingSink &operator=(CompressingSink &&) = delete;
+
+    void write(std::string_view data) override;
+
+    void close() override;
+
+}; // class CompressingSink
+
+/**
+ * Create the sink for writing to the file with the given name. The suffix
+ * of the filename decides on the compression: ".gz" for gzip, ".zst" for
+ * zstd and ".lz4" for lz4. Other names (and the empty name for STDOUT) are
+ * written uncompressed.
+ */
+std::unique_ptr<Sink> create_file_sink(std::string const &filename);
+
+/**
+ * Return the shell command to decompress the file with the given name or
+ * an empty string if the file isn't compressed.
+ */
+std::string_view decompress_command(std::string_view filename) noexcept;
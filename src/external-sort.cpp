@@ -0,0 +1,276 @@
+#include "external-sort.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <memory>
+#include <queue>
+#include <stdexcept>
+#include <utility>
+
+namespace {
+
+// Size of the chunks runs are written in
+constexpr std::size_t write_chunk_size = 1024UL * 1024UL;
+
+template <typename T>
+void append_raw(std::string &buffer, T const value)
+{
+    buffer.append(reinterpret_cast<char const *>(&value), sizeof(value));
+}
+
+// Sorted records to be merged, from a run file or from memory.
+class RecordSource
+{
+public:
+    RecordSource() = default;
+
+    RecordSource(RecordSource const &) = delete;
+    RecordSource &operator=(RecordSource const &) = delete;
+
+    RecordSource(RecordSource &&) = delete;
+    RecordSource &operator=(RecordSource &&) = delete;
+
+    virtual ~RecordSource() = default;
+
+    ExternalSorter::key_type key() const noexcept { return m_key; }
+
+    std::string_view record() const noexcept { return m_record; }
+
+    // Go to the next record, returns false at the end.
+    virtual bool next() = 0;
+
+protected:
+    ExternalSorter::key_type m_key;
+    std::string_view m_record;
+
+}; // class RecordSource
+
+class RunReader : public RecordSource
+{
+
+    std::ifstream m_file;
+    std::string m_buffer;
+
+public:
+    explicit RunReader(std::string const &filename)
+    : m_file(filename, std::ios::binary)
+    {
+        if (!m_file) {
+            throw std::runtime_error{"Can't open sort run '" + filename +
+                                     "'"};
+        }
+    }
+
+    bool next() override
+    {
+        if (!m_file.read(reinterpret_cast<char *>(&m_key), sizeof(m_key))) {
+            return false;
+        }
+        std::uint64_t length = 0;
+        m_file.read(reinterpret_cast<char *>(&length), sizeof(length));
+        m_buffer.resize(length);
+        m_file.read(m_buffer.data(), static_cast<std::streamsize>(length));
+        if (!m_file) {
+            throw std::runtime_error{"Error reading sort run"};
+        }
+        m_record = m_buffer;
+        return true;
+    }
+
+}; // class RunReader
+
+class MemoryReader : public RecordSource
+{
+
+    std::vector<std::pair<ExternalSorter::key_type, std::string_view>>
+        m_records;
+    std::size_t m_next = 0;
+
+public:
+    explicit MemoryReader(
+        std::vector<std::pair<ExternalSorter::key_type, std::string_view>>
+            records)
+    : m_records(std::move(records))
+    {
+    }
+
+    bool next() override
+    {
+        if (m_next == m_records.size()) {
+            return false;
+        }
+        m_key = m_records[m_next].first;
+        m_record = m_records[m_next].second;
+        ++m_next;
+        return true;
+    }
+
+}; // class MemoryReader
+
+} // anonymous namespace
+
+ExternalSorter::ExternalSorter(std::string prefix, std::size_t memory)
+: m_prefix(std::move(prefix)), m_memory(memory)
+{
+}
+
+ExternalSorter::~ExternalSorter()
+{
+    try {
+        wait_for_writing();
+    } catch (...) {
+        // ignore exceptions in destructor
+    }
+    remove_runs();
+}
+
+void ExternalSorter::add(key_type key, std::string_view record)
+{
+    // The other half of the memory is used by the run written in the
+    // background.
+    if (!m_records.empty() && used_memory() + record.size() +
+                                      sizeof(record_type) >
+                                  m_memory / 2) {
+        start_run();
+    }
+
+    m_records.push_back(record_type{key, m_data.size(), record.size()});
+    m_data.append(record);
+}
+
+void ExternalSorter::sort_records(std::vector<record_type> &records)
+{
+    std::stable_sort(records.begin(), records.end(),
+                     [](record_type const &a, record_type const &b) {
+                         return a.key < b.key;
+                     });
+}
+
+void ExternalSorter::write_run(std::string const &filename,
+                               std::string const &data,
+                               std::vector<record_type> const &records)
+{
+    std::ofstream file{filename, std::ios::binary | std::ios::trunc};
+    if (!file) {
+        throw std::runtime_error{"Can't create sort run '" + filename + "'"};
+    }
+
+    std::string buffer;
+    auto const write_buffer = [&]() {
+        file.write(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+        buffer.clear();
+    };
+    for (auto const &record : records) {
+        append_raw(buffer, record.key);
+        append_raw(buffer, static_cast<std::uint64_t>(record.length));
+        buffer.append(data, record.offset, record.length);
+        if (buffer.size() > write_chunk_size) {
+            write_buffer();
+        }
+    }
+    write_buffer();
+
+    file.close();
+    if (!file) {
+        throw std::runtime_error{"Error writing sort run '" + filename + "'"};
+    }
+}
+
+void ExternalSorter::wait_for_writing()
+{
+    if (m_writing.valid()) {
+        m_writing.get();
+    }
+}
+
+void ExternalSorter::start_run()
+{
+    // Only one run is written at a time, this also reports errors from
+    // writing the last one.
+    wait_for_writing();
+
+    m_runs.push_back(m_prefix + "." + std::to_string(m_runs.size()));
+    m_writing = std::async(
+        std::launch::async,
+        [filename = m_runs.back(), data = std::move(m_data),
+         records = std::move(m_records)]() mutable {
+            sort_records(records);
+            write_run(filename, data, records);
+        });
+
+    m_data = std::string{};
+    m_records = std::vector<record_type>{};
+}
+
+void ExternalSorter::finish(
+    std::function<void(std::string_view)> const &output)
+{
+    wait_for_writing();
+    sort_records(m_records);
+
+    // Everything fits into memory, no need for temporary files.
+    if (m_runs.empty()) {
+        std::string_view const data{m_data};
+        for (auto const &record : m_records) {
+            output(data.substr(record.offset, record.length));
+        }
+        m_data = std::string{};
+        m_records = std::vector<record_type>{};
+        return;
+    }
+
+    std::vector<std::unique_ptr<RecordSource>> sources;
+    sources.reserve(m_runs.size() + 1);
+    for (auto const &filename : m_runs) {
+        sources.push_back(std::make_unique<RunReader>(filename));
+    }
+
+    // The records still in memory are merged directly. They were added
+    // last, so they come after the runs.
+    std::vector<std::pair<key_type, std::string_view>> in_memory;
+    in_memory.reserve(m_records.size());
+    std::string_view const data{m_data};
+    for (auto const &record : m_records) {
+        in_memory.emplace_back(record.key,
+                               data.substr(record.offset, record.length));
+    }
+    m_records = std::vector<record_type>{};
+    sources.push_back(std::make_unique<MemoryReader>(std::move(in_memory)));
+
+    // Smallest key first, on equal keys the earlier source first so records
+    // stay in the order they were added.
+    using entry_type = std::pair<key_type, std::size_t>;
+    std::priority_queue<entry_type, std::vector<entry_type>,
+                        std::greater<entry_type>>
+        queue;
+
+    for (std::size_t n = 0; n < sources.size(); ++n) {
+        if (sources[n]->next()) {
+            queue.emplace(sources[n]->key(), n);
+        }
+    }
+
+    while (!queue.empty()) {
+        auto const n = queue.top().second;
+        queue.pop();
+        auto &source = *sources[n];
+        output(source.record());
+        if (source.next()) {
+            queue.emplace(source.key(), n);
+        }
+    }
+
+    sources.clear();
+    m_data = std::string{};
+    remove_runs();
+}
+
+void ExternalSorter::remove_runs() noexcept
+{
+    for (auto const &filename : m_runs) {
+        // NOLINTNEXTLINE(cert-err33-c)
+        std::remove(filename.c_str());
+    }
+    m_runs.clear();
+}
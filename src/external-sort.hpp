@@ -0,0 +1,91 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <future>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/**
+ * Sort records (any data, for tables the rows of one object) by a key using
+ * a bounded amount of memory. Records are collected in memory until half of
+ * the memory budget is used up, then they are sorted and written to a
+ * temporary file as a sorted run on a background thread while the next
+ * records are collected in the other half. finish() merges all runs and
+ * the records still in memory. Records with the same key stay in the order
+ * they were added.
+ */
+class ExternalSorter
+{
+public:
+    /// Records are sorted by the primary, then by the secondary key.
+    struct key_type
+    {
+        std::uint64_t primary = 0;
+        std::uint64_t secondary = 0;
+
+        friend auto operator<=>(key_type const &,
+                                key_type const &) noexcept = default;
+    };
+
+    /**
+     * Temporary files are called PREFIX.N, they are removed after merging.
+     * The memory budget is in bytes.
+     */
+    ExternalSorter(std::string prefix, std::size_t memory);
+
+    ~ExternalSorter();
+
+    ExternalSorter(ExternalSorter const &) = delete;
+    ExternalSorter &operator=(ExternalSorter const &) = delete;
+
+    ExternalSorter(ExternalSorter &&) = delete;
+    ExternalSorter &operator=(ExternalSorter &&) = delete;
+
+    void add(key_type key, std::string_view record);
+
+    /**
+     * Call output for each record in sorted order. No records can be added
+     * after this.
+     */
+    void finish(std::function<void(std::string_view)> const &output);
+
+    /// Number of runs written to temporary files so far.
+    std::size_t num_runs() const noexcept { return m_runs.size(); }
+
+private:
+    struct record_type
+    {
+        key_type key;
+        std::size_t offset;
+        std::size_t length;
+    };
+
+    std::string m_prefix;
+    std::size_t m_memory;
+    std::string m_data;
+    std::vector<record_type> m_records;
+    std::vector<std::string> m_runs;
+
+    // Writing of the last run in the background
+    std::future<void> m_writing;
+
+    std::size_t used_memory() const noexcept
+    {
+        return m_data.size() + (m_records.size() * sizeof(record_type));
+    }
+
+    static void sort_records(std::vector<record_type> &records);
+
+    static void write_run(std::string const &filename, std::string const &data,
+                          std::vector<record_type> const &records);
+
+    void wait_for_writing();
+
+    void start_run();
+
+    void remove_runs() noexcept;
+
+}; // class ExternalSorter
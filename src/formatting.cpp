@@ -4,7 +4,10 @@
 #include "json-writer.hpp"
 #include "util.hpp"
 
-#include <format>
+#include <array>
+#include <bit>
+#include <cstring>
+#include <type_traits>
 
 void add_null(std::string &buffer)
 {
@@ -20,10 +23,106 @@ void add_bool(std::string &buffer, bool value, char true_value,
     add_char(buffer, value ? true_value : false_value);
 }
 
-void add_tags_json(std::string &buffer, osmium::TagList const &tags)
+namespace {
+
+// Table with the two digits of all numbers from 0 to 99.
+constexpr auto digit_pairs = [] {
+    std::array<char, 200> pairs{};
+    for (std::size_t n = 0; n < 100; ++n) {
+        pairs[2 * n] = static_cast<char>('0' + (n / 10));
+        pairs[(2 * n) + 1] = static_cast<char>('0' + (n % 10));
+    }
+    return pairs;
+}();
+
+std::size_t count_digits(std::uint64_t value) noexcept
+{
+    std::size_t digits = 1;
+    while (value >= 100) {
+        value /= 100;
+        digits += 2;
+    }
+    return value >= 10 ? digits + 1 : digits;
+}
+
+// Write the decimal digits of value backwards ending just before end.
+void write_digits(char *end, std::uint64_t value) noexcept
+{
+    while (value >= 100) {
+        auto const pair = 2 * (value % 100);
+        value /= 100;
+        *--end = digit_pairs[pair + 1];
+        *--end = digit_pairs[pair];
+    }
+    if (value >= 10) {
+        *--end = digit_pairs[(2 * value) + 1];
+        *--end = digit_pairs[2 * value];
+    } else {
+        *--end = static_cast<char>('0' + value);
+    }
+}
+
+// Make space for size characters at the end of the buffer and return a
+// pointer to it.
+char *extend(std::string &buffer, std::size_t size)
+{
+    auto const offset = buffer.size();
+    buffer.resize(offset + size);
+    return buffer.data() + offset;
+}
+
+} // anonymous namespace
+
+void add_int(std::string &buffer, std::int64_t value)
+{
+    bool const negative = value < 0;
+    auto const abs_value = negative ? 0 - static_cast<std::uint64_t>(value)
+                                    : static_cast<std::uint64_t>(value);
+
+    auto const size = count_digits(abs_value) + (negative ? 1 : 0);
+    char *out = extend(buffer, size);
+    if (negative) {
+        *out = '-';
+    }
+    write_digits(out + size, abs_value);
+}
+
+void add_coordinate(std::string &buffer, std::int32_t value)
 {
-    json_writer writer;
+    constexpr std::size_t decimals = 7;
+    constexpr std::uint32_t precision = 10'000'000;
+
+    bool const negative = value < 0;
+    auto const abs_value = negative ? 0 - static_cast<std::uint32_t>(value)
+                                    : static_cast<std::uint32_t>(value);
+    auto const integer_part = abs_value / precision;
+    auto fraction = abs_value % precision;
+
+    auto const size =
+        count_digits(integer_part) + 1 + decimals + (negative ? 1 : 0);
+    char *out = extend(buffer, size);
+    if (negative) {
+        *out = '-';
+    }
+
+    char *end = out + size;
+    // 7 decimals: three pairs and a single digit
+    *--end = static_cast<char>('0' + (fraction % 10));
+    fraction /= 10;
+    for (int n = 0; n < 3; ++n) {
+        auto const pair = 2 * (fraction % 100);
+        fraction /= 100;
+        *--end = digit_pairs[pair + 1];
+        *--end = digit_pairs[pair];
+    }
+    *--end = '.';
+    write_digits(end, integer_part);
+}
 
+namespace {
+
+void write_tags_json(json_writer &writer, osmium::TagList const &tags)
+{
     writer.start_object();
     for (auto const &tag : tags) {
         writer.key(tag.key());
@@ -31,8 +130,14 @@ void add_tags_json(std::string &buffer, osmium::TagList const &tags)
         writer.next();
     }
     writer.end_object();
+}
+
+} // anonymous namespace
 
-    append_pg_escaped(buffer, writer.json().c_str());
+void add_tags_json(std::string &buffer, osmium::TagList const &tags)
+{
+    json_writer writer{buffer, true};
+    write_tags_json(writer, tags);
 }
 
 namespace {
@@ -87,7 +192,7 @@ void add_way_nodes_array(std::string &buffer, osmium::WayNodeList const &nodes)
         } else {
             delimiter = true;
         }
-        std::format_to(std::back_inserter(buffer), "{}", nr.ref());
+        add_int(buffer, nr.ref());
     }
 
     add_char(buffer, '}');
@@ -141,26 +246,30 @@ void add_members_type(std::string &buffer,
             delimiter = true;
         }
 
-        std::format_to(std::back_inserter(buffer), "\"({},{},",
-                       osmium::item_type_to_char(member.type()), member.ref());
+        buffer.append("\"(");
+        add_char(buffer, osmium::item_type_to_char(member.type()));
+        add_char(buffer, ',');
+        add_int(buffer, member.ref());
+        add_char(buffer, ',');
         if (needs_quoting(member.role())) {
-            std::format_to(std::back_inserter(buffer), R"FOO(\\")FOO");
+            buffer.append(R"FOO(\\")FOO");
             auto const escaped_role = escape_str(member.role());
             append_pg_escaped(buffer, escaped_role.c_str());
-            std::format_to(std::back_inserter(buffer), R"FOO(\\")")FOO");
+            buffer.append(R"FOO(\\")")FOO");
         } else {
-            std::format_to(std::back_inserter(buffer), "{})\"", member.role());
+            buffer.append(member.role());
+            buffer.append(")\"");
         }
     }
 
     add_char(buffer, '}');
 }
 
-void add_members_json(std::string &buffer,
-                      osmium::RelationMemberList const &members)
-{
-    json_writer writer;
+namespace {
 
+void write_members_json(json_writer &writer,
+                        osmium::RelationMemberList const &members)
+{
     char typebuffer[2] = "x";
     writer.start_array();
     for (auto const &member : members) {
@@ -178,6 +287,100 @@ void add_members_json(std::string &buffer,
         writer.next();
     }
     writer.end_array();
+}
+
+} // anonymous namespace
+
+void add_members_json(std::string &buffer,
+                      osmium::RelationMemberList const &members)
+{
+    json_writer writer{buffer, true};
+    write_members_json(writer, members);
+}
+
+namespace {
+
+template <typename T>
+void add_network_order(std::string &buffer, T value)
+{
+    auto v = static_cast<std::make_unsigned_t<T>>(value);
+    std::array<char, sizeof(T)> data{};
+    for (auto it = data.rbegin(); it != data.rend(); ++it) {
+        *it = static_cast<char>(v & 0xffU);
+        v >>= 8U;
+    }
+    buffer.append(data.data(), data.size());
+}
+
+// Type OID of BIGINT in PostgreSQL, needed in binary arrays
+constexpr std::int32_t int8_oid = 20;
+
+} // anonymous namespace
+
+void add_int16_binary(std::string &buffer, std::int16_t value)
+{
+    add_network_order(buffer, value);
+}
+
+void add_int32_binary(std::string &buffer, std::int32_t value)
+{
+    add_network_order(buffer, value);
+}
+
+void add_int64_binary(std::string &buffer, std::int64_t value)
+{
+    add_network_order(buffer, value);
+}
 
-    append_pg_escaped(buffer, writer.json().c_str());
+void add_float4_binary(std::string &buffer, float value)
+{
+    add_network_order(buffer, std::bit_cast<std::uint32_t>(value));
+}
+
+void add_tags_json_binary(std::string &buffer, osmium::TagList const &tags)
+{
+    json_writer writer{buffer};
+    write_tags_json(writer, tags);
+}
+
+void add_tags_hstore_binary(std::string &buffer, osmium::TagList const &tags)
+{
+    add_int32_binary(buffer, static_cast<std::int32_t>(tags.size()));
+    for (auto const &tag : tags) {
+        auto const key_length = std::strlen(tag.key());
+        add_int32_binary(buffer, static_cast<std::int32_t>(key_length));
+        buffer.append(tag.key(), key_length);
+        auto const value_length = std::strlen(tag.value());
+        add_int32_binary(buffer, static_cast<std::int32_t>(value_length));
+        buffer.append(tag.value(), value_length);
+    }
+}
+
+void add_way_nodes_array_binary(std::string &buffer,
+                                osmium::WayNodeList const &nodes)
+{
+    // number of dimensions, flags (no NULLs), element type
+    add_int32_binary(buffer, nodes.empty() ? 0 : 1);
+    add_int32_binary(buffer, 0);
+    add_int32_binary(buffer, int8_oid);
+
+    if (nodes.empty()) {
+        return;
+    }
+
+    // size and lower bound of the only dimension
+    add_int32_binary(buffer, static_cast<std::int32_t>(nodes.size()));
+    add_int32_binary(buffer, 1);
+
+    for (auto const &nr : nodes) {
+        add_int32_binary(buffer, sizeof(std::int64_t));
+        add_int64_binary(buffer, nr.ref());
+    }
+}
+
+void add_members_json_binary(std::string &buffer,
+                             osmium::RelationMemberList const &members)
+{
+    json_writer writer{buffer};
+    write_members_json(writer, members);
 }
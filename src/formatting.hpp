@@ -4,6 +4,7 @@
 #include <osmium/osm/tag.hpp>
 #include <osmium/osm/way.hpp>
 
+#include <cstdint>
 #include <string>
 
 void add_null(std::string &buffer);
@@ -13,6 +14,15 @@ void add_char(std::string &buffer, char c);
 void add_bool(std::string &buffer, bool value, char true_value = 't',
               char false_value = 'f');
 
+/// Add integer in decimal notation.
+void add_int(std::string &buffer, std::int64_t value);
+
+/**
+ * Add coordinate in the fixed-point integer format used by osmium (with 7
+ * decimal places) in decimal notation, always with all 7 decimal places.
+ */
+void add_coordinate(std::string &buffer, std::int32_t value);
+
 void add_tags_json(std::string &buffer, osmium::TagList const &tags);
 
 void add_tags_hstore(std::string &buffer, osmium::TagList const &tags);
@@ -23,3 +33,24 @@ void add_members_type(std::string &buffer,
                       osmium::RelationMemberList const &members);
 void add_members_json(std::string &buffer,
                       osmium::RelationMemberList const &members);
+
+// Functions for the PostgreSQL binary COPY format. Values are in network
+// byte order, strings are not escaped.
+
+void add_int16_binary(std::string &buffer, std::int16_t value);
+
+void add_int32_binary(std::string &buffer, std::int32_t value);
+
+void add_int64_binary(std::string &buffer, std::int64_t value);
+
+void add_float4_binary(std::string &buffer, float value);
+
+void add_tags_json_binary(std::string &buffer, osmium::TagList const &tags);
+
+void add_tags_hstore_binary(std::string &buffer, osmium::TagList const &tags);
+
+void add_way_nodes_array_binary(std::string &buffer,
+                                osmium::WayNodeList const &nodes);
+
+void add_members_json_binary(std::string &buffer,
+                             osmium::RelationMemberList const &members);
@@ -0,0 +1,184 @@
+#pragma once
+
+#include "history-location-index.hpp"
+#include "options.hpp"
+#include "table.hpp"
+#include "tag-filter.hpp"
+
+#include <osmium/diff_handler.hpp>
+#include <osmium/diff_visitor.hpp>
+#include <osmium/handler.hpp>
+#include <osmium/io/reader.hpp>
+#include <osmium/memory/buffer.hpp>
+#include <osmium/visitor.hpp>
+
+#include <utility>
+#include <vector>
+
+extern Options opts;
+
+class Handler : public osmium::handler::Handler
+{
+
+    std::vector<Table *> m_tables;
+
+public:
+    explicit Handler(std::vector<Table *> tables) : m_tables(std::move(tables))
+    {
+    }
+
+    void osm_object(osmium::OSMObject const &object)
+    {
+        if (opts.filter_with_tags && object.tags().empty()) {
+            return;
+        }
+        if (opts.tag_filter && !opts.tag_filter->matches(object)) {
+            return;
+        }
+        for (auto *table : m_tables) {
+            if (table->matches(object.type())) {
+                table->select_shard_for(object);
+                table->set_sort_key(object);
+                table->add_row(object, osmium::Timestamp{});
+                table->possible_flush();
+            }
+        }
+    }
+
+    void changeset(osmium::Changeset const &changeset)
+    {
+        for (auto *table : m_tables) {
+            if (table->matches(changeset.type())) {
+                table->select_shard_for(changeset);
+                table->set_sort_key(changeset);
+                table->add_changeset_row(changeset);
+                table->possible_flush();
+            }
+        }
+    }
+
+}; // class Handler
+
+class DiffHandler : public osmium::diff_handler::DiffHandler
+{
+
+    std::vector<Table *> m_tables;
+
+    void osm_object(osmium::OSMObject const &object,
+                    osmium::Timestamp const next_version_timestamp)
+    {
+        if (opts.filter_with_tags && object.tags().empty()) {
+            return;
+        }
+        if (opts.tag_filter && !opts.tag_filter->matches(object)) {
+            return;
+        }
+        for (auto *table : m_tables) {
+            if (table->matches(object.type())) {
+                table->select_shard_for(object);
+                table->set_sort_key(object);
+                table->add_row(object, next_version_timestamp);
+                table->possible_flush();
+            }
+        }
+    }
+
+public:
+    explicit DiffHandler(std::vector<Table *> tables)
+    : m_tables(std::move(tables))
+    {
+    }
+
+    void node(osmium::DiffNode const &dnode)
+    {
+        osmium::Timestamp timestamp;
+        if (!dnode.last()) {
+            timestamp = dnode.next().timestamp();
+        }
+        osm_object(dnode.curr(), timestamp);
+    }
+
+    void way(osmium::DiffWay const &dway)
+    {
+        osmium::Timestamp timestamp;
+        if (!dway.last()) {
+            timestamp = dway.next().timestamp();
+        }
+        osm_object(dway.curr(), timestamp);
+    }
+
+    void relation(osmium::DiffRelation const &drelation)
+    {
+        osmium::Timestamp timestamp;
+        if (!drelation.last()) {
+            timestamp = drelation.next().timestamp();
+        }
+        osm_object(drelation.curr(), timestamp);
+    }
+
+}; // class DiffHandler
+
+/**
+ * Stores the locations of all node versions in a history file and sets the
+ * locations of the way nodes to where the nodes were when the way version
+ * was created.
+ */
+class HistoryLocationsForWays : public osmium::handler::Handler
+{
+
+    HistoryLocationIndex *m_index;
+    bool m_must_sort = true;
+
+public:
+    explicit HistoryLocationsForWays(HistoryLocationIndex &index)
+    : m_index(&index)
+    {
+    }
+
+    void node(osmium::Node const &node)
+    {
+        m_index->set(node.positive_id(), node.timestamp(),
+                     node.visible() ? node.location() : osmium::Location{});
+    }
+
+    void way(osmium::Way &way)
+    {
+        if (m_must_sort) {
+            m_index->sort();
+            m_must_sort = false;
+        }
+        for (auto &nr : way.nodes()) {
+            nr.set_location(m_index->get(nr.positive_ref(), way.timestamp()));
+        }
+    }
+
+}; // class HistoryLocationsForWays
+
+/**
+ * Source for osmium::apply_diff() reading buffers from a reader and running
+ * a handler on each buffer before the objects are handed on. This way the
+ * handler can change the objects, as the location handlers do.
+ */
+template <typename THandler>
+class PreparedSource
+{
+
+    osmium::io::Reader *m_reader;
+    THandler *m_handler;
+
+public:
+    PreparedSource(osmium::io::Reader &reader, THandler &handler)
+    : m_reader(&reader), m_handler(&handler)
+    {
+    }
+
+    osmium::memory::Buffer read()
+    {
+        auto buffer = m_reader->read();
+        if (buffer) {
+            osmium::apply(buffer, *m_handler);
+        }
+        return buffer;
+    }
+
+}; // class PreparedSource
@@ -0,0 +1,60 @@
+
+#include "history-location-index.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <iterator>
+
+namespace {
+
+template <typename TEntry>
+bool before(TEntry const &a, TEntry const &b) noexcept
+{
+    return a.id < b.id || (a.id == b.id && a.timestamp < b.timestamp);
+}
+
+} // anonymous namespace
+
+void HistoryLocationIndex::set(id_type const id,
+                               osmium::Timestamp const timestamp,
+                               osmium::Location const location)
+{
+    entry const e{id, timestamp.seconds_since_epoch(), location.x(),
+                  location.y()};
+    if (!m_entries.empty() && before(e, m_entries.back())) {
+        m_sorted = false;
+    }
+    m_entries.push_back(e);
+}
+
+void HistoryLocationIndex::sort()
+{
+    if (!m_sorted) {
+        // Stable sort, so that the last location set for an id and
+        // timestamp comes last.
+        std::stable_sort(m_entries.begin(), m_entries.end(),
+                         before<entry>);
+        m_sorted = true;
+    }
+}
+
+osmium::Location
+HistoryLocationIndex::get(id_type const id,
+                          osmium::Timestamp const timestamp) const noexcept
+{
+    assert(m_sorted);
+
+    entry const key{id, timestamp.seconds_since_epoch(), 0, 0};
+    auto const it = std::upper_bound(m_entries.begin(), m_entries.end(), key,
+                                     before<entry>);
+    if (it == m_entries.begin()) {
+        return osmium::Location{};
+    }
+
+    auto const &found = *std::prev(it);
+    if (found.id != id) {
+        return osmium::Location{};
+    }
+
+    return osmium::Location{found.x, found.y};
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <osmium/osm/location.hpp>
+#include <osmium/osm/timestamp.hpp>
+#include <osmium/osm/types.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/**
+ * Node location index for history data. It stores the location of each
+ * version of a node together with the time the version was created, so the
+ * location of a node at any point in time can be looked up. Deleted
+ * versions are stored with an invalid location.
+ *
+ * Versions are expected in the order of history files (by id, then by
+ * version). Other orders work, too, but sort() has to be called after the
+ * last set() before looking up locations.
+ */
+class HistoryLocationIndex
+{
+public:
+    using id_type = osmium::unsigned_object_id_type;
+
+    void set(id_type id, osmium::Timestamp timestamp,
+             osmium::Location location);
+
+    /**
+     * Get the location of the node with this id at the given point in time,
+     * ie. of the last version created before or at that time. Returns an
+     * invalid location if there is no such version or it is deleted.
+     */
+    osmium::Location get(id_type id,
+                         osmium::Timestamp timestamp) const noexcept;
+
+    void sort();
+
+    std::size_t size() const noexcept { return m_entries.size(); }
+
+    std::size_t used_memory() const noexcept
+    {
+        return m_entries.capacity() * sizeof(entry);
+    }
+
+private:
+    struct entry
+    {
+        id_type id;
+        std::uint32_t timestamp;
+        std::int32_t x;
+        std::int32_t y;
+    };
+
+    std::vector<entry> m_entries;
+    bool m_sorted = true;
+
+}; // class HistoryLocationIndex
@@ -9,16 +9,30 @@
  * For a full list of authors see the git log.
  */
 
+#include <array>
 #include <cassert>
+#include <charconv>
 #include <cmath>
 #include <format>
 #include <iterator>
 #include <string>
+#include <string_view>
 #include <type_traits>
 
+/**
+ * Writes JSON into an external buffer. If copy_escape is set, the output is
+ * escaped for the PostgreSQL COPY text format at the same time. Because
+ * JSON output never contains raw newlines, carriage returns or tabs, this
+ * only means doubling every backslash.
+ */
 class json_writer
 {
 public:
+    explicit json_writer(std::string &buffer, bool copy_escape = false)
+    : m_buffer(buffer), m_backslash(copy_escape ? R"(\\)" : R"(\)")
+    {
+    }
+
     void null() { m_buffer.append("null"); }
 
     void boolean(bool value) { m_buffer.append(value ? "true" : "false"); }
@@ -37,44 +51,59 @@ public:
     template <typename T, std::enable_if_t<std::is_integral_v<T>, bool> = true>
     void number(T value)
     {
-        std::format_to(std::back_inserter(m_buffer), "{}", value);
+        std::array<char, 24> buffer{};
+        auto const result =
+            std::to_chars(buffer.data(), buffer.data() + buffer.size(), value);
+        m_buffer.append(buffer.data(), result.ptr);
     }
 
     void string(char const *str)
     {
         m_buffer += '"';
-        while (auto const c = *str++) {
+        char const *run = str;
+        while (auto const c = *str) {
+            std::string_view escaped;
             switch (c) {
             case '\b':
-                m_buffer.append("\\b");
+                escaped = "b";
                 break;
             case '\f':
-                m_buffer.append("\\f");
+                escaped = "f";
                 break;
             case '\n':
-                m_buffer.append("\\n");
+                escaped = "n";
                 break;
             case '\r':
-                m_buffer.append("\\r");
+                escaped = "r";
                 break;
             case '\t':
-                m_buffer.append("\\t");
+                escaped = "t";
                 break;
             case '"':
-                m_buffer.append("\\\"");
+                escaped = "\"";
                 break;
             case '\\':
-                m_buffer.append("\\\\");
+                escaped = m_backslash;
                 break;
             default:
-                if (static_cast<unsigned char>(c) <= 0x1fU) {
-                    std::format_to(std::back_inserter(m_buffer), R"(\u{:04x})",
-                                   static_cast<unsigned char>(c));
-                } else {
-                    m_buffer += c;
+                if (static_cast<unsigned char>(c) > 0x1fU) {
+                    ++str;
+                    continue;
                 }
             }
+
+            // Copy the run of characters not needing escaping in one go
+            m_buffer.append(run, str);
+            m_buffer.append(m_backslash);
+            if (escaped.empty()) {
+                std::format_to(std::back_inserter(m_buffer), "u{:04x}",
+                               static_cast<unsigned char>(c));
+            } else {
+                m_buffer.append(escaped);
+            }
+            run = ++str;
         }
+        m_buffer.append(run, str);
         m_buffer += '"';
     }
 
@@ -110,8 +139,10 @@ public:
 
     void next() { m_buffer += ','; }
 
-    std::string const &json() const noexcept { return m_buffer; }
-
 private:
-    std::string m_buffer;
+    std::string &m_buffer;
+
+    // The backslash used to escape characters in JSON strings, two of them
+    // if COPY escaping is needed.
+    std::string_view m_backslash;
 };
@@ -0,0 +1,268 @@
+
+#include "location-store.hpp"
+
+#include <osmium/index/index.hpp>
+
+#include <algorithm>
+#include <iterator>
+
+namespace {
+
+void append_varint(std::string &data, std::uint64_t value)
+{
+    while (value >= 0x80U) {
+        data += static_cast<char>((value & 0x7fU) | 0x80U);
+        value >>= 7U;
+    }
+    data += static_cast<char>(value);
+}
+
+std::uint64_t decode_varint(char const **data) noexcept
+{
+    std::uint64_t value = 0;
+    unsigned int shift = 0;
+    while (true) {
+        auto const byte = static_cast<unsigned char>(*(*data)++);
+        value |= static_cast<std::uint64_t>(byte & 0x7fU) << shift;
+        if (byte < 0x80U) {
+            return value;
+        }
+        shift += 7;
+    }
+}
+
+std::uint64_t zigzag(std::int64_t value) noexcept
+{
+    return (static_cast<std::uint64_t>(value) << 1U) ^
+           static_cast<std::uint64_t>(value >> 63);
+}
+
+std::int64_t unzigzag(std::uint64_t value) noexcept
+{
+    return static_cast<std::int64_t>(value >> 1U) ^
+           -static_cast<std::int64_t>(value & 1U);
+}
+
+} // anonymous namespace
+
+CompactLocationStore::CompactLocationStore()
+{
+    // Decoding a block into the cache must not allocate, it happens in
+    // get_noexcept().
+    for (auto &cached : m_cache) {
+        cached.ids.reserve(block_size);
+        cached.locations.reserve(block_size);
+    }
+}
+
+void CompactLocationStore::set(id_type const id,
+                               osmium::Location const location)
+{
+    if (m_size > 0 && id == m_last_id) {
+        if (!m_pending.empty()) {
+            m_pending.back().second = location;
+            return;
+        }
+        // Only after sort() the last node is in an encoded block already.
+        // The unordered nodes are searched first, so this location wins.
+        m_unordered.emplace_back(id, location);
+        m_unordered_sorted = false;
+        return;
+    }
+
+    ++m_size;
+
+    if (m_size == 1 || id > m_last_id) {
+        // A full block is only encoded when the next node comes in, so
+        // the last node is always still pending and can be updated.
+        if (m_pending.size() == block_size) {
+            encode_pending();
+        }
+        m_pending.emplace_back(id, location);
+        m_last_id = id;
+        return;
+    }
+
+    m_unordered.emplace_back(id, location);
+    m_unordered_sorted = false;
+}
+
+void CompactLocationStore::encode_pending()
+{
+    if (m_pending.empty()) {
+        return;
+    }
+
+    m_directory.push_back({m_pending.front().first, m_data.size()});
+
+    id_type prev_id = m_pending.front().first;
+    std::int64_t prev_x = 0;
+    std::int64_t prev_y = 0;
+    for (auto const &[id, location] : m_pending) {
+        append_varint(m_data, id - prev_id);
+        append_varint(m_data, zigzag(location.x() - prev_x));
+        append_varint(m_data, zigzag(location.y() - prev_y));
+        prev_id = id;
+        prev_x = location.x();
+        prev_y = location.y();
+    }
+
+    m_pending.clear();
+}
+
+void CompactLocationStore::sort()
+{
+    encode_pending();
+    if (!m_unordered_sorted) {
+        // Stable sort, so that the last location set for an id comes last.
+        std::stable_sort(
+            m_unordered.begin(), m_unordered.end(),
+            [](entry const &a, entry const &b) { return a.first < b.first; });
+        m_unordered_sorted = true;
+    }
+}
+
+CompactLocationStore::cached_block const &
+CompactLocationStore::decoded_block(std::size_t const block) const
+{
+    ++m_cache_tick;
+
+    auto *slot = &m_cache.front();
+    for (auto &cached : m_cache) {
+        if (cached.block == block) {
+            cached.last_used = m_cache_tick;
+            return cached;
+        }
+        if (cached.last_used < slot->last_used) {
+            slot = &cached;
+        }
+    }
+
+    // Not in cache, decode into the least recently used slot.
+    slot->block = block;
+    slot->last_used = m_cache_tick;
+    slot->ids.clear();
+    slot->locations.clear();
+
+    char const *data = m_data.data() + m_directory[block].offset;
+    char const *const end = block + 1 < m_directory.size()
+                                ? m_data.data() + m_directory[block + 1].offset
+                                : m_data.data() + m_data.size();
+
+    id_type id = m_directory[block].first_id;
+    std::int64_t x = 0;
+    std::int64_t y = 0;
+    while (data != end) {
+        id += decode_varint(&data);
+        x += unzigzag(decode_varint(&data));
+        y += unzigzag(decode_varint(&data));
+        slot->ids.push_back(id);
+        slot->locations.emplace_back(static_cast<std::int32_t>(x),
+                                     static_cast<std::int32_t>(y));
+    }
+
+    return *slot;
+}
+
+osmium::Location
+CompactLocationStore::get_noexcept(id_type const id) const noexcept
+{
+    auto const by_id = [](entry const &e, id_type const i) {
+        return e.first < i;
+    };
+
+    if (!m_unordered.empty()) {
+        if (m_unordered_sorted) {
+            auto const it = std::upper_bound(
+                m_unordered.begin(), m_unordered.end(), id,
+                [](id_type const i, entry const &e) { return i < e.first; });
+            if (it != m_unordered.begin() && std::prev(it)->first == id) {
+                return std::prev(it)->second;
+            }
+        } else {
+            for (auto it = m_unordered.rbegin(); it != m_unordered.rend();
+                 ++it) {
+                if (it->first == id) {
+                    return it->second;
+                }
+            }
+        }
+    }
+
+    if (!m_pending.empty() && id >= m_pending.front().first) {
+        auto const it =
+            std::lower_bound(m_pending.begin(), m_pending.end(), id, by_id);
+        if (it != m_pending.end() && it->first == id) {
+            return it->second;
+        }
+        return osmium::Location{};
+    }
+
+    auto const it = std::upper_bound(
+        m_directory.begin(), m_directory.end(), id,
+        [](id_type const i, block_info const &b) { return i < b.first_id; });
+    if (it == m_directory.begin()) {
+        return osmium::Location{};
+    }
+
+    auto const &cached = decoded_block(
+        static_cast<std::size_t>(std::distance(m_directory.begin(), it) - 1));
+    auto const id_it =
+        std::lower_bound(cached.ids.begin(), cached.ids.end(), id);
+    if (id_it == cached.ids.end() || *id_it != id) {
+        return osmium::Location{};
+    }
+
+    return cached.locations[static_cast<std::size_t>(
+        std::distance(cached.ids.begin(), id_it))];
+}
+
+osmium::Location CompactLocationStore::get(id_type const id) const
+{
+    auto const location = get_noexcept(id);
+    if (location == osmium::Location{}) {
+        throw osmium::not_found{id};
+    }
+    return location;
+}
+
+std::size_t CompactLocationStore::used_memory() const noexcept
+{
+    std::size_t memory = m_data.capacity() +
+                         m_directory.capacity() * sizeof(block_info) +
+                         (m_pending.capacity() + m_unordered.capacity()) *
+                             sizeof(entry);
+    for (auto const &cached : m_cache) {
+        memory += cached.ids.capacity() * sizeof(id_type) +
+                  cached.locations.capacity() * sizeof(osmium::Location);
+    }
+    return memory;
+}
+
+void CompactLocationStore::clear()
+{
+    m_directory.clear();
+    m_data.clear();
+    m_pending.clear();
+    m_unordered.clear();
+    m_unordered_sorted = true;
+    m_last_id = 0;
+    m_size = 0;
+    // The vectors keep their capacity, see constructor.
+    for (auto &cached : m_cache) {
+        cached.block = std::numeric_limits<std::size_t>::max();
+        cached.last_used = 0;
+        cached.ids.clear();
+        cached.locations.clear();
+    }
+    m_cache_tick = 0;
+}
+
+void register_compact_location_store()
+{
+    osmium::index::MapFactory<osmium::unsigned_object_id_type,
+                              osmium::Location>::instance()
+        .register_map("compact", [](std::vector<std::string> const &) {
+            return new CompactLocationStore{}; // NOLINT(cppcoreguidelines-owning-memory)
+        });
+}
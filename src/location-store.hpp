@@ -0,0 +1,99 @@
+#pragma once
+
+#include <osmium/index/map.hpp>
+#include <osmium/osm/location.hpp>
+#include <osmium/osm/types.hpp>
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <string>
+#include <utility>
+#include <vector>
+
+/**
+ * Node location index storing ids and locations in compressed blocks.
+ *
+ * Nodes are collected into blocks of up to block_size nodes with ascending
+ * ids. Inside a block ids and coordinates are stored as varint-encoded
+ * differences to the previous node. Nodes with similar ids are usually
+ * close to each other, so most nodes need only a few bytes. A directory
+ * with the first id of each block is used to find the block for an id,
+ * recently used blocks are kept decoded in a small cache.
+ *
+ * Nodes not in ascending id order are kept uncompressed in a separate list.
+ * Call sort() after the last set() before looking up locations.
+ *
+ * Lookups change the cache without any locking, so the index must not be
+ * used from several threads at the same time, not even for lookups only.
+ */
+class CompactLocationStore
+: public osmium::index::map::Map<osmium::unsigned_object_id_type,
+                                 osmium::Location>
+{
+public:
+    using id_type = osmium::unsigned_object_id_type;
+
+    static constexpr std::size_t block_size = 256;
+    static constexpr std::size_t cache_size = 32;
+
+    CompactLocationStore();
+
+    void set(id_type id, osmium::Location location) override;
+
+    osmium::Location get(id_type id) const override;
+
+    osmium::Location get_noexcept(id_type id) const noexcept override;
+
+    std::size_t size() const noexcept override { return m_size; }
+
+    std::size_t used_memory() const noexcept override;
+
+    void clear() override;
+
+    void sort() override;
+
+private:
+    struct block_info
+    {
+        id_type first_id;
+        std::size_t offset;
+    };
+
+    struct cached_block
+    {
+        std::size_t block = std::numeric_limits<std::size_t>::max();
+        std::uint64_t last_used = 0;
+        std::vector<id_type> ids;
+        std::vector<osmium::Location> locations;
+    };
+
+    using entry = std::pair<id_type, osmium::Location>;
+
+    void encode_pending();
+
+    cached_block const &decoded_block(std::size_t block) const;
+
+    std::vector<block_info> m_directory;
+    std::string m_data;
+
+    // Nodes for the next block
+    std::vector<entry> m_pending;
+
+    // Nodes not in ascending order
+    std::vector<entry> m_unordered;
+    bool m_unordered_sorted = true;
+
+    id_type m_last_id = 0;
+    std::size_t m_size = 0;
+
+    // Changed by lookups, see the class comment on threads. The vectors
+    // of each slot have room for a full block.
+    mutable std::array<cached_block, cache_size> m_cache;
+    mutable std::uint64_t m_cache_tick = 0;
+
+}; // class CompactLocationStore
+
+/// Register CompactLocationStore with the libosmium map factory as "compact".
+void register_compact_location_store();
@@ -1,128 +1,127 @@
 
+#include "area-assembly.hpp"
+#include "buffer-stage.hpp"
+#include "handler.hpp"
+#include "location-store.hpp"
 #include "options.hpp"
+#ifdef OPE_WITH_LIBPQ
+#include "pg-sink.hpp"
+#endif
+#include "plan.hpp"
+#include "region.hpp"
+#include "stats.hpp"
+#include "table-workers.hpp"
 #include "table.hpp"
+#include "tag-filter.hpp"
+#include "way-store.hpp"
 
 #include <osmium/area/assembler.hpp>
-#include <osmium/area/multipolygon_manager.hpp>
-#include <osmium/diff_handler.hpp>
 #include <osmium/diff_visitor.hpp>
-#include <osmium/handler.hpp>
 #include <osmium/handler/node_locations_for_ways.hpp>
-#include <osmium/index/map/flex_mem.hpp>
 #include <osmium/index/node_locations_map.hpp>
 #include <osmium/io/any_input.hpp>
+#include <osmium/object_pointer_collection.hpp>
+#include <osmium/osm/object_comparisons.hpp>
 #include <osmium/util/verbose_output.hpp>
 #include <osmium/visitor.hpp>
 
 #include <boost/program_options.hpp>
 namespace po = boost::program_options;
 
+#include <algorithm>
+#include <charconv>
+#include <cstdlib>
+#include <filesystem>
+#include <format>
+#include <fstream>
 #include <iostream>
+#include <memory>
+#include <mutex>
 #include <string>
+#include <string_view>
 #include <utility>
 #include <vector>
 
 Options opts;
 
-class Handler : public osmium::handler::Handler
-{
-
-    std::vector<std::unique_ptr<Table>> *m_tables;
-
-public:
-    explicit Handler(std::vector<std::unique_ptr<Table>> *tables)
-    : m_tables(tables)
-    {
-    }
+namespace {
 
-    void osm_object(osmium::OSMObject const &object)
-    {
-        if (opts.filter_with_tags && object.tags().empty()) {
-            return;
-        }
-        for (auto &table : *m_tables) {
-            if (table->matches(object.type())) {
-                table->add_row(object, osmium::Timestamp{});
-                table->possible_flush();
-            }
-        }
-    }
+using index_type =
+    osmium::index::map::Map<osmium::unsigned_object_id_type, osmium::Location>;
+using location_handler_type = osmium::handler::NodeLocationsForWays<index_type>;
 
-    void changeset(osmium::Changeset const &changeset)
-    {
-        for (auto &table : *m_tables) {
-            if (table->matches(changeset.type())) {
-                table->add_changeset_row(changeset);
-                table->possible_flush();
-            }
-        }
-    }
+// Maximum number of buffers waiting for the location stage.
+constexpr std::size_t max_stage_queue_size = 8;
 
-}; // class Handler
+using map_factory_type =
+    osmium::index::MapFactory<osmium::unsigned_object_id_type,
+                              osmium::Location>;
 
-class DiffHandler : public osmium::diff_handler::DiffHandler
+// The file name of a file-based location index or an empty string.
+std::string location_index_file(std::string const &config)
 {
-
-    std::vector<std::unique_ptr<Table>> *m_tables;
-
-    void osm_object(osmium::OSMObject const &object,
-                    osmium::Timestamp const next_version_timestamp)
-    {
-        if (opts.filter_with_tags && object.tags().empty()) {
-            return;
-        }
-        for (auto &table : *m_tables) {
-            if (table->matches(object.type())) {
-                table->add_row(object, next_version_timestamp);
-                table->possible_flush();
-            }
-        }
-    }
-
-public:
-    explicit DiffHandler(std::vector<std::unique_ptr<Table>> *tables)
-    : m_tables(tables)
-    {
-    }
-
-    void node(osmium::DiffNode const &dnode)
-    {
-        osmium::Timestamp timestamp;
-        if (!dnode.last()) {
-            timestamp = dnode.next().timestamp();
-        }
-        osm_object(dnode.curr(), timestamp);
-    }
-
-    void way(osmium::DiffWay const &dway)
-    {
-        osmium::Timestamp timestamp;
-        if (!dway.last()) {
-            timestamp = dway.next().timestamp();
-        }
-        osm_object(dway.curr(), timestamp);
+    auto const pos = config.find(',');
+    if (pos == std::string::npos) {
+        return {};
     }
+    return config.substr(pos + 1);
+}
 
-    void relation(osmium::DiffRelation const &drelation)
-    {
-        osmium::Timestamp timestamp;
-        if (!drelation.last()) {
-            timestamp = drelation.next().timestamp();
-        }
-        osm_object(drelation.curr(), timestamp);
+std::string location_index_types()
+{
+    std::string types;
+    for (auto const &type : map_factory_type::instance().map_types()) {
+        types += "    ";
+        types += type;
+        types += '\n';
     }
-
-}; // class DiffHandler
-
-namespace {
+    return types;
+}
 
 void parse_command_line(int argc, char *argv[], std::string &input_filename,
-                        std::vector<std::unique_ptr<Table>> &tables)
+                        std::vector<std::unique_ptr<Table>> &tables,
+                        std::unique_ptr<Region> &region)
 {
     po::options_description desc{"OPTIONS"};
 
-    desc.add_options()("filter,f", po::value<std::vector<std::string>>(),
-                       "Filter")("help,h", "Show usage help")(
+    desc.add_options()("area-threads", po::value<unsigned int>(),
+                       "Number of threads assembling areas (default: 1)")(
+        "bbox", po::value<std::string>(),
+        "Only objects in bounding box MINLON,MINLAT,MAXLON,MAXLAT")(
+        "binary,b", "Write binary COPY format")(
+        "buffer-count", po::value<std::size_t>(),
+        "Number of output buffers per table (default: 2)")(
+        "buffer-size", po::value<std::size_t>(),
+        "Size of output buffers in kB (default: 1000)")(
+        "database,d", po::value<std::string>(),
+        "Write directly into database (libpq connection string)")(
+        "decode-threads", po::value<unsigned int>(),
+        "Number of threads decoding the input file (default: auto)")(
+        "direct-io", "Use O_DIRECT for output files (needs --io-uring)")(
+        "filter,f", po::value<std::vector<std::string>>(),
+        "Filter: with-tags or [TYPES/]KEY[=VALUE,...]")(
+        "help,h", "Show usage help")(
+        "partition", "Create partitioned tables, one partition per shard")(
+        "io-uring", "Write output files using io_uring")(
+        "location-index,i", po::value<std::string>(),
+        "Node location index type (default: flex_mem)")(
+        "polygon", po::value<std::string>(),
+        "Only objects in polygon from poly file")(
+        "relations-cache", po::value<std::string>(),
+        "Cache file for relations needed for areas")(
+        "reuse-location-index",
+        "Use file-based location index from earlier run")(
+        "shard-by", po::value<std::string>(),
+        "Split by: hash, range:SIZE, tile, or objtype (default: hash)")(
+        "shards", po::value<unsigned int>(),
+        "Split each table into this many files (default: 1)")(
+        "sort-by", po::value<std::string>(),
+        "Sort rows by: hilbert, tile, id, or changeset")(
+        "sort-memory", po::value<std::size_t>(),
+        "Memory for sorting each table in MB (default: 1024)")(
+        "threads,t", po::value<unsigned int>(),
+        "Number of threads formatting table rows (default: 1)")(
+        "update,u", "Update tables from change file")(
         "verbose,v", "Set verbose mode")("with-history,H", "With history");
 
     po::options_description hidden;
@@ -158,6 +157,9 @@ void parse_command_line(int argc, char *argv[], std::string &input_filename,
                      "empty)\n";
         std::cout << '\n';
         std::cout << desc;
+        std::cout << "\nLocation index types (add ',FILENAME' for file-based "
+                     "types):\n";
+        std::cout << location_index_types();
         std::exit(0); // NOLINT(concurrency-mt-unsafe)
     }
 
@@ -169,18 +171,221 @@ void parse_command_line(int argc, char *argv[], std::string &input_filename,
         opts.with_history = true;
     }
 
+    if (vm.count("binary")) {
+        opts.binary_format = true;
+    }
+
+    if (vm.count("buffer-count")) {
+        opts.buffer_count = vm["buffer-count"].as<std::size_t>();
+        if (opts.buffer_count == 0) {
+            throw std::runtime_error{"Number of buffers must be at least 1"};
+        }
+    }
+
+    if (vm.count("buffer-size")) {
+        opts.buffer_size = vm["buffer-size"].as<std::size_t>() * 1024;
+        if (opts.buffer_size == 0) {
+            throw std::runtime_error{"Buffer size must be at least 1 kB"};
+        }
+    }
+
+    if (vm.count("io-uring")) {
+#ifdef OPE_WITH_IO_URING
+        opts.io_uring = true;
+#else
+        std::cerr << "Warning! Compiled without io_uring support, "
+                     "ignoring --io-uring\n";
+#endif
+    }
+
+    if (vm.count("direct-io")) {
+        if (!vm.count("io-uring")) {
+            throw std::runtime_error{"Option --direct-io needs --io-uring"};
+        }
+        opts.direct_io = true;
+    }
+
+    if (vm.count("database")) {
+        opts.database = vm["database"].as<std::string>();
+#ifndef OPE_WITH_LIBPQ
+        throw std::runtime_error{
+            "Option --database not available: compiled without libpq"};
+#endif
+    }
+
+    if (vm.count("shards")) {
+        opts.shards = vm["shards"].as<unsigned int>();
+        if (opts.shards == 0) {
+            throw std::runtime_error{"Number of shards must be at least 1"};
+        }
+        if (opts.shards > 1 && !opts.database.empty()) {
+            throw std::runtime_error{
+                "Can't split output when writing into the database"};
+        }
+    }
+
+    if (vm.count("shard-by")) {
+        auto const method = vm["shard-by"].as<std::string>();
+        if (method == "hash") {
+            opts.shard_by = shard_method::hash;
+        } else if (method == "tile") {
+            opts.shard_by = shard_method::tile;
+        } else if (method == "objtype") {
+            opts.shard_by = shard_method::objtype;
+            if (!opts.database.empty()) {
+                throw std::runtime_error{
+                    "Can't split output when writing into the database"};
+            }
+        } else if (method.starts_with("range:")) {
+            opts.shard_by = shard_method::range;
+            auto const size = std::string_view{method}.substr(6);
+            auto const [end, error] = std::from_chars(
+                size.data(), size.data() + size.size(), opts.shard_range);
+            if (error != std::errc{} || end != size.data() + size.size() ||
+                opts.shard_range == 0) {
+                throw std::runtime_error{
+                    "Shard range size must be a number larger than 0"};
+            }
+        } else {
+            throw std::runtime_error{"Unknown shard method '" + method +
+                                     "'"};
+        }
+    }
+
+    if (vm.count("sort-by")) {
+        auto const method = vm["sort-by"].as<std::string>();
+        if (method == "hilbert") {
+            opts.sort_by = sort_method::hilbert;
+        } else if (method == "tile") {
+            opts.sort_by = sort_method::tile;
+        } else if (method == "id") {
+            opts.sort_by = sort_method::id;
+        } else if (method == "changeset") {
+            opts.sort_by = sort_method::changeset;
+        } else {
+            throw std::runtime_error{"Unknown sort method '" + method + "'"};
+        }
+    }
+
+    if (vm.count("sort-memory")) {
+        opts.sort_memory =
+            vm["sort-memory"].as<std::size_t>() * 1024UL * 1024UL;
+        if (opts.sort_memory == 0) {
+            throw std::runtime_error{
+                "Memory for sorting must be at least 1 MB"};
+        }
+    }
+
+    if (vm.count("partition")) {
+        opts.partition = true;
+        if (opts.shard_by == shard_method::hash) {
+            throw std::runtime_error{"Option --partition needs --shard-by "
+                                     "range:SIZE, tile, or objtype"};
+        }
+        if (opts.shard_by != shard_method::objtype && opts.shards < 2) {
+            throw std::runtime_error{
+                "Option --partition needs at least 2 --shards"};
+        }
+        if (!opts.database.empty()) {
+            throw std::runtime_error{
+                "Can't create partitions when writing into the database"};
+        }
+    }
+
+    if (vm.count("location-index")) {
+        opts.location_index = vm["location-index"].as<std::string>();
+        auto const type =
+            opts.location_index.substr(0, opts.location_index.find(','));
+        if (!map_factory_type::instance().has_map_type(type)) {
+            throw std::runtime_error{"Unknown location index type '" + type +
+                                     "'"};
+        }
+    }
+
+    if (vm.count("reuse-location-index")) {
+        if (location_index_file(opts.location_index).empty()) {
+            throw std::runtime_error{
+                "Option --reuse-location-index needs a file-based location "
+                "index"};
+        }
+        opts.reuse_location_index = true;
+    }
+
+    if (vm.count("decode-threads")) {
+        opts.decode_threads = vm["decode-threads"].as<unsigned int>();
+        if (opts.decode_threads == 0) {
+            throw std::runtime_error{
+                "Number of decode threads must be at least 1"};
+        }
+        // The libosmium thread pool is created when the first file is
+        // opened and takes its size from this environment variable.
+        // NOLINTNEXTLINE(concurrency-mt-unsafe)
+        ::setenv("OSMIUM_POOL_THREADS",
+                 std::to_string(opts.decode_threads).c_str(), 1);
+    }
+
+    if (vm.count("area-threads")) {
+        opts.area_threads = vm["area-threads"].as<unsigned int>();
+        if (opts.area_threads == 0) {
+            throw std::runtime_error{
+                "Number of area threads must be at least 1"};
+        }
+    }
+
+    if (vm.count("relations-cache")) {
+        opts.relations_cache = vm["relations-cache"].as<std::string>();
+    }
+
+    if (vm.count("threads")) {
+        opts.num_threads = vm["threads"].as<unsigned int>();
+        if (opts.num_threads == 0) {
+            throw std::runtime_error{"Number of threads must be at least 1"};
+        }
+    }
+
     if (vm.count("filter")) {
         auto const filters = vm["filter"].as<std::vector<std::string>>();
         for (auto const &filter : filters) {
             if (filter == "with-tags") {
                 opts.filter_with_tags = true;
             } else {
-                std::cerr << "Warning! Unknown filter option: " << filter
-                          << '\n';
+                if (!opts.tag_filter) {
+                    opts.tag_filter = std::make_shared<TagFilter>();
+                }
+                opts.tag_filter->add(filter);
             }
         }
     }
 
+    if (vm.count("bbox") && vm.count("polygon")) {
+        throw std::runtime_error{"Use only one of --bbox and --polygon"};
+    }
+
+    if (vm.count("bbox")) {
+        opts.bbox = vm["bbox"].as<std::string>();
+        region = std::make_unique<Region>(Region::from_bbox(opts.bbox));
+        opts.filter_region = true;
+    }
+
+    if (vm.count("polygon")) {
+        opts.polygon_file = vm["polygon"].as<std::string>();
+        region = std::make_unique<Region>(
+            Region::from_poly_file(opts.polygon_file));
+        opts.filter_region = true;
+    }
+
+    if (vm.count("update")) {
+        opts.update = true;
+        if (!opts.database.empty()) {
+            throw std::runtime_error{
+                "Update mode can't write directly into the database"};
+        }
+        if (opts.filter_region) {
+            throw std::runtime_error{
+                "Can't use region filters in update mode"};
+        }
+    }
+
     if (vm.count("input-filename")) {
         input_filename = vm["input-filename"].as<std::string>();
     }
@@ -190,7 +395,14 @@ void parse_command_line(int argc, char *argv[], std::string &input_filename,
              vm["tables"].as<std::vector<std::string>>()) {
             tables.emplace_back(create_table(opts, table_config));
             auto const &new_table = *tables.back();
-            if (!new_table.filename().empty()) {
+            if (opts.update) {
+                new_table.check_update();
+            }
+            new_table.check_shards();
+            if (opts.partition) {
+                new_table.check_partition();
+            }
+            if (!new_table.filename().empty() && opts.database.empty()) {
                 new_table.sql_data_definition();
             }
             if (new_table.column_flags() &
@@ -205,14 +417,129 @@ void parse_command_line(int argc, char *argv[], std::string &input_filename,
                 sql_column_config_flags::time_range) {
                 opts.use_diff_handler = true;
             }
-            if (opts.use_location_handler && opts.use_diff_handler) {
+            if (opts.assemble_areas && opts.use_diff_handler) {
+                throw std::runtime_error{
+                    "Can't use time ranges and areas together"};
+            }
+            if (opts.filter_region && opts.use_diff_handler) {
                 throw std::runtime_error{
-                    "Can't use time ranges and geometries together"};
+                    "Can't use time ranges and region filters together"};
             }
         }
     } else {
         throw std::runtime_error{"No output tables found"};
     }
+
+    if (opts.update) {
+        if (opts.use_diff_handler || opts.with_history) {
+            throw std::runtime_error{"Can't use history in update mode"};
+        }
+        if (opts.use_location_handler) {
+            // The locations of the nodes not in the change file come from
+            // the index of the earlier run, the ways using nodes that moved
+            // from the way store next to it.
+            auto const filename = location_index_file(opts.location_index);
+            if (filename.empty()) {
+                throw std::runtime_error{
+                    "Update mode needs the file-based location index of the "
+                    "earlier run (--location-index TYPE,FILE)"};
+            }
+            // The sparse index would keep the old location of a node next
+            // to the new one.
+            if (!opts.location_index.starts_with("dense_file_array,")) {
+                throw std::runtime_error{
+                    "Update mode needs the dense_file_array location index"};
+            }
+            if (!std::filesystem::exists(way_store_filename(filename))) {
+                throw std::runtime_error{"Way store '" +
+                                         way_store_filename(filename) +
+                                         "' of the earlier run not found"};
+            }
+            opts.reuse_location_index = true;
+        }
+    }
+}
+
+/**
+ * The tables filled in one pass. Buffers are handed to the tables either
+ * directly or through the worker threads. Buffers can come from several
+ * threads (the reader and the area assembly), they are handed on one at a
+ * time.
+ */
+class PassTables
+{
+
+    Handler m_handler;
+    std::unique_ptr<TableWorkers> m_workers;
+    std::mutex m_mutex;
+
+public:
+    explicit PassTables(std::vector<Table *> const &tables) : m_handler(tables)
+    {
+        if (opts.num_threads > 1 && !tables.empty()) {
+            m_workers =
+                std::make_unique<TableWorkers>(tables, opts.num_threads);
+        }
+    }
+
+    void operator()(osmium::memory::Buffer &&buffer)
+    {
+        std::lock_guard<std::mutex> const lock{m_mutex};
+        if (m_workers) {
+            (*m_workers)(std::move(buffer));
+        } else {
+            osmium::apply(buffer, m_handler);
+        }
+    }
+
+    void finish()
+    {
+        if (m_workers) {
+            m_workers->finish();
+        }
+    }
+
+    TableWorkers const *workers() const noexcept { return m_workers.get(); }
+
+}; // class PassTables
+
+// Read all buffers and hand them on, collecting the stats for reading.
+template <typename TFunc>
+void read_buffers(osmium::io::Reader &reader, StageStats &stats, TFunc &&next)
+{
+    StopWatch watch;
+    while (osmium::memory::Buffer buffer = reader.read()) {
+        stats.add_input_wait(watch.lap());
+        stats.add_buffer(buffer.committed());
+        next(std::move(buffer));
+        stats.add_output_wait(watch.lap());
+    }
+}
+
+std::unique_ptr<index_type> create_location_index()
+{
+    auto const filename = location_index_file(opts.location_index);
+    if (!filename.empty() && !opts.reuse_location_index) {
+        // Start with an empty file, old contents could be from another
+        // input file.
+        std::ofstream const file{filename, std::ios::trunc};
+        if (!file) {
+            throw std::runtime_error{"Can't create location index file '" +
+                                     filename + "'"};
+        }
+    }
+    return map_factory_type::instance().create_map(opts.location_index);
+}
+
+// Full runs with a file-based location index keep the ways next to it for
+// later updates.
+std::unique_ptr<WayStoreWriter> create_way_store()
+{
+    auto const filename = location_index_file(opts.location_index);
+    if (filename.empty() || opts.update) {
+        return {};
+    }
+    return std::make_unique<WayStoreWriter>(way_store_filename(filename));
 }
 
 } // anonymous namespace
@@ -221,9 +548,12 @@ int main(int argc, char *argv[])
 {
     std::vector<std::unique_ptr<Table>> tables;
     std::string input_filename{"-"};
+    std::unique_ptr<Region> region;
+
+    register_compact_location_store();
 
     try {
-        parse_command_line(argc, argv, input_filename, tables);
+        parse_command_line(argc, argv, input_filename, tables, region);
     } catch (boost::program_options::error const &e) {
         std::cerr << "Error parsing command line: " << e.what() << '\n';
         return 2;
@@ -237,93 +567,384 @@ int main(int argc, char *argv[])
     vout << "Options:\n";
     vout << "  With history: " << yes_no(opts.with_history);
     vout << "  Use diff handler: " << yes_no(opts.use_diff_handler);
+    vout << "  Update mode: " << yes_no(opts.update);
     vout << "  Use location index: " << yes_no(opts.use_location_handler);
+    if (opts.use_location_handler) {
+        vout << "  Location index: " << opts.location_index
+             << (opts.reuse_location_index ? " (reused)\n" : "\n");
+    }
     vout << "  Assemble areas: " << yes_no(opts.assemble_areas);
+    vout << "  Binary format: " << yes_no(opts.binary_format);
+    vout << "  Database: "
+         << (opts.database.empty() ? "(none)" : opts.database) << '\n';
+    vout << "  Shards: " << opts.shards << '\n';
+    vout << "  Partitions: " << yes_no(opts.partition);
+    vout << "  Sort by: "
+         << (opts.sort_by == sort_method::hilbert     ? "hilbert"
+             : opts.sort_by == sort_method::tile      ? "tile"
+             : opts.sort_by == sort_method::id        ? "id"
+             : opts.sort_by == sort_method::changeset ? "changeset"
+                                                      : "(none)")
+         << '\n';
+    if (opts.sort_by != sort_method::none) {
+        vout << "  Sort memory: " << (opts.sort_memory / (1024UL * 1024UL))
+             << " MB\n";
+    }
+    vout << "  Output buffers: " << opts.buffer_count << " x "
+         << (opts.buffer_size / 1024) << " kB\n";
+    vout << "  io_uring: " << yes_no(opts.io_uring);
+    vout << "  Direct I/O: " << yes_no(opts.direct_io);
+    vout << "  Decode threads: "
+         << (opts.decode_threads == 0 ? std::string{"auto"}
+                                      : std::to_string(opts.decode_threads))
+         << '\n';
+    vout << "  Threads: " << opts.num_threads << '\n';
+    if (opts.assemble_areas) {
+        vout << "  Area threads: " << opts.area_threads << '\n';
+    }
 
     vout << "Filter:\n";
     vout << "  With tags: " << yes_no(opts.filter_with_tags);
+    vout << "  Tag filter: " << yes_no(opts.tag_filter != nullptr);
+    if (!opts.bbox.empty()) {
+        vout << "  Bounding box: " << opts.bbox << '\n';
+    }
+    if (!opts.polygon_file.empty()) {
+        vout << "  Polygon: " << opts.polygon_file << '\n';
+    }
 
     vout << "Tables:\n";
-
-    osmium::osm_entity_bits::type read_entities =
-        opts.use_location_handler ? osmium::osm_entity_bits::node
-                                  : osmium::osm_entity_bits::nothing;
     for (auto const &table : tables) {
-        if (table->read_entities() == osmium::osm_entity_bits::area) {
-            read_entities |= osmium::osm_entity_bits::nwr;
-        } else {
-            read_entities |= table->read_entities();
-        }
         vout << "  " << table->name() << ":\n";
         vout << "    filename: " << table->filename() << '\n';
         vout << "    stream:   " << table->stream_name() << '\n';
         vout << "    columns:  " << table->columns_string() << '\n';
     }
 
-    // Normally a "users" table is only filled with the users seen in the
-    // other tables that are specified. But if the "users" table is the only
-    // one, we export all users.
-    if (tables.size() == 1 &&
-        dynamic_cast<UsersTable *>(tables.front().get())) {
-        read_entities = osmium::osm_entity_bits::all;
-    }
+    auto const passes = plan_passes(tables, opts);
 
     try {
 
-        if (read_entities == osmium::osm_entity_bits::nothing) {
+        if (passes.front().entities == osmium::osm_entity_bits::nothing) {
             throw std::runtime_error{"Nothing to do"};
         }
 
-        vout << "Reading entities: " << list_entities(read_entities) << '\n';
+        vout << "Plan:\n";
+        for (std::size_t n = 0; n < passes.size(); ++n) {
+            vout << "  pass " << (n + 1) << ": " << describe_pass(passes[n])
+                 << '\n';
+        }
+
+#ifdef OPE_WITH_LIBPQ
+        // All tables are set up on a single connection before any of the
+        // COPY connections are opened.
+        if (!opts.database.empty()) {
+            vout << "Setting up tables in database...\n";
+            std::string sql;
+            for (auto const &table : tables) {
+                sql += table->sql_setup();
+            }
+            pg_execute(opts.database, sql);
+        }
+#endif
+
+        for (auto &table : tables) {
+            table->open();
+        }
 
         vout << "Transforming data...\n";
 
         osmium::io::File const input_file{input_filename};
 
         if (opts.use_diff_handler) {
-            DiffHandler handler{&tables};
-            osmium::io::Reader reader{input_file, read_entities};
-            osmium::apply_diff(reader, handler);
+            // The diff handler needs to see the objects in order across
+            // buffer boundaries, so this always runs on a single thread.
+            auto const &pass = passes.front();
+            DiffHandler handler{pass.tables};
+            osmium::io::Reader reader{input_file, pass.entities};
+            if (pass.locations) {
+                HistoryLocationIndex index;
+                HistoryLocationsForWays location_handler{index};
+                PreparedSource source{reader, location_handler};
+                osmium::apply_diff(source, handler);
+                vout << "History location index: " << index.size()
+                     << " node versions, "
+                     << (index.used_memory() / (1024 * 1024)) << " MB\n";
+            } else {
+                osmium::apply_diff(reader, handler);
+            }
             reader.close();
+        } else if (opts.update) {
+            // The change file is small enough to be read into memory. Only
+            // the newest version of each object counts, its rows replace
+            // all rows of the object in the tables.
+            auto const &pass = passes.front();
+            auto buffer = osmium::io::read_file(input_file, pass.entities);
+            osmium::ObjectPointerCollection objects;
+            osmium::apply(buffer, objects);
+            objects.sort(osmium::object_order_type_id_reverse_version{});
+
+            // Node locations from the change file are added to the index,
+            // so it is up to date for the next update. Nodes come first, so
+            // the ways get the new locations.
+            std::unique_ptr<index_type> index;
+            std::unique_ptr<location_handler_type> location_handler;
+            if (pass.locations) {
+                index = create_location_index();
+                location_handler =
+                    std::make_unique<location_handler_type>(*index);
+                location_handler->ignore_errors();
+            }
+            std::vector<osmium::object_id_type> moved_nodes;
+            std::vector<osmium::Way const *> changed_ways;
+
+            Handler handler{pass.tables};
+            osmium::OSMObject const *previous = nullptr;
+            std::size_t changed = 0;
+            std::size_t deleted = 0;
+            for (auto &object : objects) {
+                if (previous && previous->type() == object.type() &&
+                    previous->id() == object.id()) {
+                    continue; // older version
+                }
+                previous = &object;
+                ++changed;
+
+                if (location_handler) {
+                    if (object.type() == osmium::item_type::node) {
+                        auto const &node =
+                            static_cast<osmium::Node const &>(object);
+                        if (index->get_noexcept(node.positive_id()) !=
+                            node.location()) {
+                            moved_nodes.push_back(node.id());
+                        }
+                    } else if (object.type() == osmium::item_type::way) {
+                        changed_ways.push_back(
+                            static_cast<osmium::Way const *>(&object));
+                    }
+                    osmium::apply_item(object, *location_handler);
+                }
+                for (auto *table : pass.tables) {
+                    if (table->matches(object.type())) {
+                        table->add_delete_row(object);
+                    }
+                }
+                if (object.visible()) {
+                    osmium::apply_item(object, handler);
+                } else {
+                    ++deleted;
+                }
+            }
+
+            vout << "Changed objects: " << changed << " ("
+                 << deleted << " deleted)\n";
+
+            // Ways not in the change file get new rows in the tables with
+            // way geometries if one of their nodes moved.
+            if (location_handler) {
+                std::vector<Table *> geometry_tables;
+                for (auto *table : pass.tables) {
+                    if (table->column_flags() &
+                        sql_column_config_flags::location_store) {
+                        geometry_tables.push_back(table);
+                    }
+                }
+                Handler geometry_handler{geometry_tables};
+
+                std::sort(moved_nodes.begin(), moved_nodes.end());
+                std::size_t moved = 0;
+                update_way_store(
+                    way_store_filename(
+                        location_index_file(opts.location_index)),
+                    changed_ways, moved_nodes, [&](osmium::Way &way) {
+                        for (auto *table : geometry_tables) {
+                            if (table->matches(way.type())) {
+                                table->add_delete_row(way);
+                            }
+                        }
+                        osmium::apply_item(way, *location_handler,
+                                           geometry_handler);
+                        ++moved;
+                    });
+
+                vout << "Ways with moved nodes: " << moved << '\n';
+            }
         } else {
-            using index_type =
-                osmium::index::map::FlexMem<osmium::unsigned_object_id_type,
-                                            osmium::Location>;
-            using location_handler_type =
-                osmium::handler::NodeLocationsForWays<index_type>;
-            Handler handler{&tables};
+            std::vector<std::string> pipeline_stats;
+
+            // Objects outside the region are removed before the buffers are
+            // handed to the tables. This has to happen in order and after
+            // the locations are added, so that ways crossing the boundary of
+            // the region get all their locations.
+            std::unique_ptr<RegionFilter> region_filter;
+            if (region) {
+                region_filter = std::make_unique<RegionFilter>(*region);
+            }
+
+            auto const start_pass = [&vout](PassTables const &pass_tables) {
+                if (auto const *workers = pass_tables.workers()) {
+                    vout << "Formatting rows on " << workers->size()
+                         << " threads in " << workers->num_lanes()
+                         << " lanes.\n";
+                }
+            };
+
+            auto const add_worker_stats = [&pipeline_stats](
+                                              PassTables const &pass_tables,
+                                              std::string const &prefix) {
+                if (auto const *workers = pass_tables.workers()) {
+                    for (std::size_t n = 0; n < workers->size(); ++n) {
+                        pipeline_stats.push_back(
+                            std::format("{}format {}: {}", prefix, n,
+                                        workers->worker_stats(n)));
+                    }
+                }
+            };
+
             if (opts.assemble_areas) {
+                auto const &first = passes.front();
+                auto const &second = passes.back();
+
+                // The tables of the second pass are set up first, because
+                // the area assembly delivers the areas to them.
+                PassTables second_tables{second.tables};
+
+                // Areas come from other threads, so they get a filter of
+                // their own.
+                std::unique_ptr<RegionFilter> area_filter;
+                if (region) {
+                    area_filter = std::make_unique<RegionFilter>(*region);
+                }
+
                 osmium::area::Assembler::config_type const assembler_config;
-                osmium::area::MultipolygonManager<osmium::area::Assembler>
-                    mp_manager{assembler_config};
-                vout << "First pass reading relations...\n";
-                osmium::relations::read_relations(input_file, mp_manager);
+                AreaAssemblerPool assembler_pool{
+                    assembler_config, opts.area_threads,
+                    [&](osmium::memory::Buffer &&buffer) {
+                        if (area_filter) {
+                            (*area_filter)(buffer);
+                        }
+                        second_tables(std::move(buffer));
+                    }};
+                ParallelMultipolygonManager mp_manager{assembler_pool};
+
+                vout << "First pass...\n";
+                {
+                    PassTables first_tables{first.tables};
+                    start_pass(first_tables);
+                    relations_func next;
+                    if (first.objects) {
+                        next = [&first_tables](
+                                   osmium::memory::Buffer &&buffer) {
+                            first_tables(std::move(buffer));
+                        };
+                    }
+                    if (read_area_relations(input_file, opts.relations_cache,
+                                            mp_manager, next)) {
+                        vout << "Relations read from cache file '"
+                             << opts.relations_cache << "'.\n";
+                    }
+                    first_tables.finish();
+                    add_worker_stats(first_tables, "pass 1 ");
+                }
                 vout << "First pass done.\n";
                 osmium::relations::print_used_memory(std::cerr,
                                                      mp_manager.used_memory());
-                index_type index;
-                location_handler_type location_handler{index};
+
+                auto index = create_location_index();
+                location_handler_type location_handler{*index};
                 location_handler.ignore_errors();
+                auto way_store = create_way_store();
+
                 vout << "Second pass...\n";
-                osmium::io::Reader reader{input_file, read_entities};
-                osmium::apply(
-                    reader, location_handler,
-                    mp_manager.handler(
-                        [&handler](osmium::memory::Buffer const &buffer) {
-                            osmium::apply(buffer, handler);
-                        }));
+                start_pass(second_tables);
+                StageStats read_stats;
+                osmium::io::Reader reader{input_file, second.entities};
+                read_buffers(
+                    reader, read_stats,
+                    [&](osmium::memory::Buffer &&buffer) {
+                        osmium::apply(buffer, location_handler,
+                                      mp_manager.handler());
+                        if (way_store) {
+                            way_store->add(buffer);
+                        }
+                        if (second.objects) {
+                            if (region_filter) {
+                                (*region_filter)(buffer);
+                            }
+                            second_tables(std::move(buffer));
+                        }
+                    });
                 reader.close();
+                if (way_store) {
+                    way_store->close();
+                }
+                assembler_pool.finish();
+                second_tables.finish();
                 vout << "Second pass done.\n";
-            } else if (opts.use_location_handler) {
-                index_type index;
-                location_handler_type location_handler{index};
-                osmium::io::Reader reader{input_file, read_entities};
-                osmium::apply(reader, location_handler, handler);
-                reader.close();
+
+                pipeline_stats.push_back("pass 2 read: " +
+                                         read_stats.summary());
+                add_worker_stats(second_tables, "pass 2 ");
             } else {
-                osmium::io::Reader reader{input_file, read_entities};
-                osmium::apply(reader, handler);
-                reader.close();
+                auto const &pass = passes.front();
+                PassTables pass_tables{pass.tables};
+                start_pass(pass_tables);
+
+                auto const process = [&](osmium::memory::Buffer &&buffer) {
+                    if (region_filter) {
+                        (*region_filter)(buffer);
+                    }
+                    pass_tables(std::move(buffer));
+                };
+
+                StageStats read_stats;
+                if (pass.locations) {
+                    auto index = create_location_index();
+                    location_handler_type location_handler{*index};
+                    auto way_store = create_way_store();
+                    // Locations are added on a thread of their own between
+                    // reading and formatting.
+                    BufferStage locations{
+                        max_stage_queue_size,
+                        [&location_handler,
+                         &way_store](osmium::memory::Buffer &buffer) {
+                            osmium::apply(buffer, location_handler);
+                            if (way_store) {
+                                way_store->add(buffer);
+                            }
+                        },
+                        process};
+                    osmium::io::Reader reader{input_file, pass.entities};
+                    read_buffers(
+                        reader, read_stats,
+                        [&locations](osmium::memory::Buffer &&buffer) {
+                            locations(std::move(buffer));
+                        });
+                    reader.close();
+                    locations.finish();
+                    if (way_store) {
+                        way_store->close();
+                    }
+                    pipeline_stats.push_back("read: " + read_stats.summary());
+                    pipeline_stats.push_back(std::format(
+                        "locations: {}, queue average {:.1f} max {}",
+                        locations.stats().summary(),
+                        locations.queue().average_depth(),
+                        locations.queue().max_depth()));
+                } else {
+                    osmium::io::Reader reader{input_file, pass.entities};
+                    read_buffers(reader, read_stats, process);
+                    reader.close();
+                    pipeline_stats.push_back("read: " + read_stats.summary());
+                }
+
+                pass_tables.finish();
+                add_worker_stats(pass_tables, "");
+            }
+
+            vout << "Pipeline stats:\n";
+            for (auto const &line : pipeline_stats) {
+                vout << "  " << line << '\n';
             }
         }
 
@@ -332,6 +953,11 @@ int main(int argc, char *argv[])
             table->close();
         }
 
+        for (auto const &table : tables) {
+            vout << "  write " << table->name() << ": "
+                 << table->write_stats().summary() << '\n';
+        }
+
     } catch (std::exception const &e) {
         std::cerr << e.what() << '\n';
         return 1;
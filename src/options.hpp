@@ -1,12 +1,61 @@
 #pragma once
 
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+class TagFilter;
+
+// How rows are distributed over the output files with --shards
+enum class shard_method
+{
+    hash,
+    range,
+    tile,
+    objtype
+};
+
+// Order of the rows in the output with --sort-by
+enum class sort_method
+{
+    none,
+    hilbert,
+    tile,
+    id,
+    changeset
+};
+
 struct Options
 {
     bool verbose = false;
     bool with_history = false;
     bool with_primary_key = true;
     bool filter_with_tags = false;
+    std::shared_ptr<TagFilter> tag_filter; // nullptr = no tag filter
+    bool filter_region = false;
+    std::string bbox;
+    std::string polygon_file;
     bool use_diff_handler = false;
     bool use_location_handler = false;
     bool assemble_areas = false;
+    bool binary_format = false;
+    unsigned int num_threads = 1;
+    unsigned int decode_threads = 0; // 0 = libosmium default
+    unsigned int area_threads = 1;
+    std::size_t buffer_size = 1000 * 1024;
+    std::size_t buffer_count = 2;
+    bool io_uring = false;
+    bool direct_io = false;
+    std::string database;
+    unsigned int shards = 1;
+    shard_method shard_by = shard_method::hash;
+    std::uint64_t shard_range = 0; // ids per shard with shard_method::range
+    bool partition = false; // shards are partitions of one table
+    sort_method sort_by = sort_method::none;
+    std::size_t sort_memory = 1024UL * 1024UL * 1024UL; // for each table
+    std::string location_index{"flex_mem"};
+    bool reuse_location_index = false;
+    bool update = false; // input is a change file
+    std::string relations_cache;
 };
@@ -0,0 +1,99 @@
+#include "pg-sink.hpp"
+
+#include <stdexcept>
+#include <utility>
+
+PgCopySink::PgCopySink(std::string const &conninfo,
+                       std::string const &copy_command, std::string sql_after)
+: m_sql_after(std::move(sql_after))
+{
+    m_conn = PQconnectdb(conninfo.c_str());
+    if (PQstatus(m_conn) != CONNECTION_OK) {
+        error("Connecting to database failed");
+    }
+
+    exec(copy_command, PGRES_COPY_IN);
+}
+
+PgCopySink::~PgCopySink()
+{
+    if (m_conn) {
+        PQfinish(m_conn);
+    }
+}
+
+void PgCopySink::error(std::string const &message)
+{
+    std::string const full_message{message + ": " + PQerrorMessage(m_conn)};
+    PQfinish(m_conn);
+    m_conn = nullptr;
+    throw std::runtime_error{full_message};
+}
+
+void PgCopySink::exec(std::string const &sql, ExecStatusType expected)
+{
+    PGresult *result = PQexec(m_conn, sql.c_str());
+    auto const status = PQresultStatus(result);
+    PQclear(result);
+    if (status != expected) {
+        error("Database error");
+    }
+}
+
+void PgCopySink::write(std::string_view data)
+{
+    if (PQputCopyData(m_conn, data.data(), static_cast<int>(data.size())) !=
+        1) {
+        error("Sending COPY data failed");
+    }
+}
+
+void PgCopySink::close()
+{
+    if (!m_conn) {
+        return;
+    }
+
+    if (PQputCopyEnd(m_conn, nullptr) != 1) {
+        error("Ending COPY failed");
+    }
+
+    bool ok = true;
+    while (PGresult *result = PQgetResult(m_conn)) {
+        if (PQresultStatus(result) != PGRES_COMMAND_OK) {
+            ok = false;
+        }
+        PQclear(result);
+    }
+    if (!ok) {
+        error("COPY failed");
+    }
+
+    exec(m_sql_after, PGRES_COMMAND_OK);
+
+    PQfinish(m_conn);
+    m_conn = nullptr;
+}
+
+void pg_execute(std::string const &conninfo, std::string const &sql)
+{
+    PGconn *conn = PQconnectdb(conninfo.c_str());
+    std::string message;
+    if (PQstatus(conn) != CONNECTION_OK) {
+        message = "Connecting to database failed";
+    } else {
+        PGresult *result = PQexec(conn, sql.c_str());
+        if (PQresultStatus(result) != PGRES_COMMAND_OK) {
+            message = "Database error";
+        }
+        PQclear(result);
+    }
+    if (!message.empty()) {
+        message += ": ";
+        message += PQerrorMessage(conn);
+    }
+    PQfinish(conn);
+    if (!message.empty()) {
+        throw std::runtime_error{message};
+    }
+}
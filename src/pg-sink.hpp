@@ -0,0 +1,49 @@
+#pragma once
+
+#include "sink.hpp"
+
+#include <libpq-fe.h>
+
+#include <string>
+#include <string_view>
+
+/**
+ * Sink streaming data directly into a PostgreSQL table using the COPY
+ * protocol. Every sink has its own database connection. The table must
+ * exist already (see pg_execute()).
+ *
+ * The SQL in sql_after is run once all data has been copied.
+ */
+class PgCopySink : public Sink
+{
+
+    PGconn *m_conn = nullptr;
+    std::string m_sql_after;
+
+    void exec(std::string const &sql, ExecStatusType expected);
+
+    [[noreturn]] void error(std::string const &message);
+
+public:
+    PgCopySink(std::string const &conninfo, std::string const &copy_command,
+               std::string sql_after);
+
+    ~PgCopySink() override;
+
+    PgCopySink(PgCopySink const &) = delete;
+    PgCopySink &operator=(PgCopySink const &) = delete;
+
+    PgCopySink(PgCopySink &&) = delete;
+    PgCopySink &operator=(PgCopySink &&) = delete;
+
+    void write(std::string_view data) override;
+
+    void close() override;
+
+}; // class PgCopySink
+
+/**
+ * Run the SQL (can be several statements) on a new connection to the
+ * database.
+ */
+void pg_execute(std::string const &conninfo, std::string const &sql);
@@ -0,0 +1,132 @@
+
+#include "plan.hpp"
+
+#include "util.hpp"
+
+namespace oeb = osmium::osm_entity_bits;
+
+namespace {
+
+// With a region filter, ways are kept if they have a node in the region and
+// relations if they have a member in it. So the nodes (and ways) have to be
+// read even if no table needs them.
+osmium::osm_entity_bits::type
+add_region_entities(osmium::osm_entity_bits::type entities,
+                    Options const &options) noexcept
+{
+    if (!options.filter_region) {
+        return entities;
+    }
+    if (entities & oeb::relation) {
+        entities |= oeb::way;
+    }
+    if (entities & oeb::way) {
+        entities |= oeb::node;
+    }
+    return entities;
+}
+
+} // anonymous namespace
+
+std::vector<pass_type>
+plan_passes(std::vector<std::unique_ptr<Table>> const &tables,
+            Options const &options)
+{
+    // Nodes are only needed for the location index if it isn't filled
+    // already from an earlier run. In update mode the nodes from the change
+    // file update the index from the earlier run.
+    auto const location_entities =
+        options.use_location_handler &&
+                (!options.reuse_location_index || options.update)
+            ? oeb::node
+            : oeb::nothing;
+
+    if (!options.assemble_areas) {
+        pass_type pass;
+        pass.entities = location_entities;
+        pass.locations = options.use_location_handler;
+        pass.objects = true;
+        for (auto const &table : tables) {
+            pass.entities |= table->read_entities();
+            pass.tables.push_back(table.get());
+        }
+
+        // Normally a "users" table is only filled with the users seen in
+        // the other tables that are specified. But if the "users" table is
+        // the only one, we export all users.
+        if (tables.size() == 1 &&
+            dynamic_cast<UsersTable *>(tables.front().get())) {
+            pass.entities = oeb::all;
+        }
+
+        pass.entities = add_region_entities(pass.entities, options);
+        return {pass};
+    }
+
+    pass_type first;
+    first.entities = oeb::relation;
+    first.area_relations = true;
+
+    pass_type second;
+    second.entities = oeb::way | location_entities;
+    second.locations = true;
+    second.areas = true;
+
+    // Tables like the "users" table don't need anything read for them,
+    // they get whatever is read for the other tables.
+    std::vector<Table *> followers;
+
+    for (auto const &table : tables) {
+        auto const entities = table->read_entities();
+        if (entities == oeb::nothing) {
+            followers.push_back(table.get());
+        } else if (entities == oeb::area) {
+            second.tables.push_back(table.get());
+        } else if ((entities & ~oeb::relation) == oeb::nothing &&
+                   !options.filter_region) {
+            first.tables.push_back(table.get());
+            first.objects = true;
+        } else {
+            second.entities |= entities;
+            second.tables.push_back(table.get());
+            second.objects = true;
+        }
+    }
+
+    for (auto *table : followers) {
+        if (!first.tables.empty()) {
+            first.tables.push_back(table);
+        }
+        second.tables.push_back(table);
+    }
+
+    second.entities = add_region_entities(second.entities, options);
+    return {first, second};
+}
+
+std::string describe_pass(pass_type const &pass)
+{
+    std::string out{"read: "};
+    out += list_entities(pass.entities);
+
+    if (pass.area_relations) {
+        out += "; relations for areas";
+    }
+    if (pass.locations) {
+        out += "; node locations";
+    }
+    if (pass.areas) {
+        out += "; assemble areas";
+    }
+
+    out += "; tables:";
+    if (pass.tables.empty()) {
+        out += " (none)";
+    }
+    for (auto const *table : pass.tables) {
+        out += ' ';
+        out += table->name();
+    }
+
+    return out;
+}
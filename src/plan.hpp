@@ -0,0 +1,54 @@
+#pragma once
+
+#include "options.hpp"
+#include "table.hpp"
+
+#include <osmium/osm/entity_bits.hpp>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+/**
+ * One pass over the input file: What is read and which tables get the
+ * objects read.
+ */
+struct pass_type
+{
+    osmium::osm_entity_bits::type entities = osmium::osm_entity_bits::nothing;
+
+    // The tables filled in this pass
+    std::vector<Table *> tables;
+
+    // The objects read are handed to the tables. Not set if the tables only
+    // get assembled areas (area tables and followers like "users").
+    bool objects = false;
+
+    // Relations are read into the multipolygon manager (first pass for areas)
+    bool area_relations = false;
+
+    // Node locations are added to the ways
+    bool locations = false;
+
+    // Areas are assembled (second pass for areas)
+    bool areas = false;
+};
+
+/**
+ * Decide how many passes over the input file are needed and what is done in
+ * each.
+ *
+ * Without areas everything is done in a single pass. With areas the first
+ * pass reads only the relations. Tables that only need relations are filled
+ * in this pass, too, unless there is a region filter which needs the ways
+ * to decide which relations to keep. Everything else is done in the second
+ * pass, which only reads what the areas and the remaining tables need.
+ *
+ * The "users" table gets the objects of every pass that has other tables.
+ */
+std::vector<pass_type>
+plan_passes(std::vector<std::unique_ptr<Table>> const &tables,
+            Options const &options);
+
+/// One-line description of a pass for verbose output.
+std::string describe_pass(pass_type const &pass);
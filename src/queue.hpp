@@ -0,0 +1,78 @@
+#pragma once
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <mutex>
+#include <utility>
+
+/**
+ * Simple thread-safe queue with a maximum size. Pushing to a full queue
+ * blocks until some other thread pops an element, popping from an empty
+ * queue blocks until some other thread pushes an element.
+ */
+template <typename T>
+class Queue
+{
+
+    std::mutex m_mutex;
+    std::condition_variable m_not_empty;
+    std::condition_variable m_not_full;
+    std::deque<T> m_data;
+    std::size_t m_max_size;
+
+    // Queue depth statistics, updated on every push
+    std::size_t m_pushes = 0;
+    std::size_t m_depth_sum = 0;
+    std::size_t m_max_depth = 0;
+
+public:
+    explicit Queue(std::size_t max_size) : m_max_size(max_size) {}
+
+    void push(T value)
+    {
+        std::unique_lock<std::mutex> lock{m_mutex};
+        m_not_full.wait(lock, [this] { return m_data.size() < m_max_size; });
+        m_data.push_back(std::move(value));
+        ++m_pushes;
+        m_depth_sum += m_data.size();
+        m_max_depth = std::max(m_max_depth, m_data.size());
+        lock.unlock();
+        m_not_empty.notify_one();
+    }
+
+    T pop()
+    {
+        std::unique_lock<std::mutex> lock{m_mutex};
+        m_not_empty.wait(lock, [this] { return !m_data.empty(); });
+        T value{std::move(m_data.front())};
+        m_data.pop_front();
+        lock.unlock();
+        m_not_full.notify_one();
+        return value;
+    }
+
+    std::size_t size()
+    {
+        std::lock_guard<std::mutex> const lock{m_mutex};
+        return m_data.size();
+    }
+
+    /// Average number of elements in the queue right after a push.
+    double average_depth()
+    {
+        std::lock_guard<std::mutex> const lock{m_mutex};
+        return m_pushes == 0 ? 0.0
+                             : static_cast<double>(m_depth_sum) /
+                                   static_cast<double>(m_pushes);
+    }
+
+    /// Maximum number of elements that were in the queue at any time.
+    std::size_t max_depth()
+    {
+        std::lock_guard<std::mutex> const lock{m_mutex};
+        return m_max_depth;
+    }
+
+}; // class Queue
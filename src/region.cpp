@@ -0,0 +1,345 @@
+#include "region.hpp"
+
+#include <osmium/osm/area.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <stdexcept>
+#include <utility>
+
+namespace {
+
+// Parse "LON LAT" from a line of a poly file.
+osmium::Location parse_poly_location(std::string const &line)
+{
+    char *end = nullptr;
+    double const lon = std::strtod(line.c_str(), &end);
+    char *end2 = nullptr;
+    double const lat = std::strtod(end, &end2);
+    if (end == line.c_str() || end2 == end) {
+        throw std::runtime_error{"Invalid coordinates in poly file: '" +
+                                 line + "'"};
+    }
+
+    osmium::Location const location{lon, lat};
+    if (!location.valid()) {
+        throw std::runtime_error{"Invalid coordinates in poly file: '" +
+                                 line + "'"};
+    }
+    return location;
+}
+
+std::string trim(std::string const &str)
+{
+    auto const first = str.find_first_not_of(" \t\r");
+    if (first == std::string::npos) {
+        return {};
+    }
+    auto const last = str.find_last_not_of(" \t\r");
+    return str.substr(first, last - first + 1);
+}
+
+} // anonymous namespace
+
+Region::Region(std::vector<ring_type> const &rings)
+{
+    for (auto const &ring : rings) {
+        for (auto const &location : ring) {
+            m_envelope.extend(location);
+        }
+    }
+
+    if (!m_envelope.valid() ||
+        m_envelope.bottom_left().x() == m_envelope.top_right().x() ||
+        m_envelope.bottom_left().y() == m_envelope.top_right().y()) {
+        throw std::runtime_error{"Region is empty"};
+    }
+
+    auto const min_x = m_envelope.bottom_left().x();
+    auto const min_y = m_envelope.bottom_left().y();
+    m_cell_width = (static_cast<std::int64_t>(m_envelope.top_right().x()) -
+                    min_x) / grid_size + 1;
+    m_cell_height = (static_cast<std::int64_t>(m_envelope.top_right().y()) -
+                     min_y) / grid_size + 1;
+
+    m_row_edges.resize(grid_size);
+    m_cells.resize(grid_size * grid_size, cell_state::outside);
+
+    for (auto const &ring : rings) {
+        if (ring.size() < 3) {
+            throw std::runtime_error{"Region ring with less than 3 points"};
+        }
+        for (std::size_t n = 0; n < ring.size(); ++n) {
+            // The ring is closed if the last point isn't the same as the
+            // first.
+            auto const &from = ring[n];
+            auto const &to = ring[(n + 1) % ring.size()];
+            if (from != to) {
+                add_edge(edge_type{from.x(), from.y(), to.x(), to.y()});
+            }
+        }
+    }
+
+    // Cells without an edge in them are either completely inside or
+    // completely outside, their center tells which.
+    for (std::size_t r = 0; r < grid_size; ++r) {
+        auto const y = static_cast<std::int32_t>(
+            min_y + static_cast<std::int64_t>(r) * m_cell_height +
+            m_cell_height / 2);
+        for (std::size_t c = 0; c < grid_size; ++c) {
+            auto &cell = m_cells[r * grid_size + c];
+            if (cell == cell_state::boundary) {
+                continue;
+            }
+            auto const x = static_cast<std::int32_t>(
+                min_x + static_cast<std::int64_t>(c) * m_cell_width +
+                m_cell_width / 2);
+            cell = ray_cast(x, y, r) ? cell_state::inside
+                                     : cell_state::outside;
+        }
+    }
+}
+
+Region Region::from_bbox(std::string const &bbox)
+{
+    double values[4] = {0.0, 0.0, 0.0, 0.0};
+    char const *str = bbox.c_str();
+    for (std::size_t n = 0; n < 4; ++n) {
+        char *end = nullptr;
+        values[n] = std::strtod(str, &end);
+        if (end == str || (n < 3 && *end != ',') || (n == 3 && *end != '\0')) {
+            throw std::runtime_error{
+                "Invalid bounding box (use MINLON,MINLAT,MAXLON,MAXLAT): '" +
+                bbox + "'"};
+        }
+        if (n < 3) {
+            str = end + 1;
+        }
+    }
+
+    osmium::Location const bottom_left{values[0], values[1]};
+    osmium::Location const top_right{values[2], values[3]};
+    if (!bottom_left.valid() || !top_right.valid() ||
+        values[0] >= values[2] || values[1] >= values[3]) {
+        throw std::runtime_error{"Invalid bounding box: '" + bbox + "'"};
+    }
+
+    ring_type const ring{bottom_left,
+                         osmium::Location{top_right.x(), bottom_left.y()},
+                         top_right,
+                         osmium::Location{bottom_left.x(), top_right.y()}};
+    return Region{std::vector<ring_type>{ring}};
+}
+
+Region Region::from_poly_file(std::string const &filename)
+{
+    std::ifstream file{filename};
+    if (!file) {
+        throw std::runtime_error{"Can't open poly file '" + filename + "'"};
+    }
+
+    std::vector<ring_type> rings;
+    std::string line;
+
+    // First line is the name of the polygon.
+    std::getline(file, line);
+
+    bool done = false;
+    while (std::getline(file, line)) {
+        line = trim(line);
+        if (line.empty()) {
+            continue;
+        }
+        if (line == "END") {
+            done = true;
+            break;
+        }
+
+        // Start of a ring (a '!' in front of the name marks an inner ring,
+        // but inner and outer rings are treated the same).
+        ring_type ring;
+        while (std::getline(file, line)) {
+            line = trim(line);
+            if (line == "END") {
+                break;
+            }
+            if (!line.empty()) {
+                ring.push_back(parse_poly_location(line));
+            }
+        }
+        rings.push_back(std::move(ring));
+    }
+
+    if (!done) {
+        throw std::runtime_error{"Missing END in poly file '" + filename +
+                                 "'"};
+    }
+
+    return Region{rings};
+}
+
+std::size_t Region::column(std::int32_t const x) const noexcept
+{
+    return static_cast<std::size_t>(
+        (static_cast<std::int64_t>(x) - m_envelope.bottom_left().x()) /
+        m_cell_width);
+}
+
+std::size_t Region::row(std::int32_t const y) const noexcept
+{
+    return static_cast<std::size_t>(
+        (static_cast<std::int64_t>(y) - m_envelope.bottom_left().y()) /
+        m_cell_height);
+}
+
+void Region::add_edge(edge_type const &edge)
+{
+    auto const min_y = std::min(edge.y1, edge.y2);
+    auto const max_y = std::max(edge.y1, edge.y2);
+    auto const first_row = row(min_y);
+    auto const last_row = row(max_y);
+
+    for (auto r = first_row; r <= last_row; ++r) {
+        m_row_edges[r].push_back(edge);
+
+        // The part of the edge inside this row
+        auto const row_min_y = std::max<std::int64_t>(
+            min_y, m_envelope.bottom_left().y() +
+                       static_cast<std::int64_t>(r) * m_cell_height);
+        auto const row_max_y = std::min<std::int64_t>(
+            max_y, m_envelope.bottom_left().y() +
+                       static_cast<std::int64_t>(r + 1) * m_cell_height - 1);
+
+        double x_a = edge.x1;
+        double x_b = edge.x2;
+        if (edge.y1 != edge.y2) {
+            double const dx_dy =
+                (static_cast<double>(edge.x2) - edge.x1) /
+                (static_cast<double>(edge.y2) - edge.y1);
+            x_a = edge.x1 + (static_cast<double>(row_min_y) - edge.y1) * dx_dy;
+            x_b = edge.x1 + (static_cast<double>(row_max_y) - edge.y1) * dx_dy;
+        }
+
+        auto const to_x = [this](double x) {
+            return static_cast<std::int32_t>(
+                std::clamp(x, static_cast<double>(m_envelope.bottom_left().x()),
+                           static_cast<double>(m_envelope.top_right().x())));
+        };
+
+        // Mark one more cell on each side to be safe from rounding errors.
+        auto const first_col = column(to_x(std::floor(std::min(x_a, x_b))));
+        auto const last_col = column(to_x(std::ceil(std::max(x_a, x_b))));
+        auto const from = first_col == 0 ? 0 : first_col - 1;
+        auto const to = std::min(last_col + 1, grid_size - 1);
+        for (auto c = from; c <= to; ++c) {
+            m_cells[r * grid_size + c] = cell_state::boundary;
+        }
+    }
+}
+
+bool Region::ray_cast(std::int32_t const x, std::int32_t const y,
+                      std::size_t const row) const noexcept
+{
+    bool inside = false;
+    for (auto const &edge : m_row_edges[row]) {
+        if ((edge.y1 > y) != (edge.y2 > y)) {
+            double const cross_x =
+                edge.x1 + (static_cast<double>(edge.x2) - edge.x1) *
+                              (static_cast<double>(y) - edge.y1) /
+                              (static_cast<double>(edge.y2) - edge.y1);
+            if (x < cross_x) {
+                inside = !inside;
+            }
+        }
+    }
+    return inside;
+}
+
+bool Region::contains(osmium::Location const location) const noexcept
+{
+    if (!location.valid() || !m_envelope.contains(location)) {
+        return false;
+    }
+
+    auto const r = row(location.y());
+    auto const state = m_cells[r * grid_size + column(location.x())];
+    if (state != cell_state::boundary) {
+        return state == cell_state::inside;
+    }
+
+    return ray_cast(location.x(), location.y(), r);
+}
+
+RegionFilter::RegionFilter(Region region) : m_region(std::move(region)) {}
+
+bool RegionFilter::keep_area(osmium::Area const &area) const noexcept
+{
+    for (auto const &ring : area.outer_rings()) {
+        for (auto const &node_ref : ring) {
+            if (m_region.contains(node_ref.location())) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+bool RegionFilter::keep(osmium::OSMObject const &object)
+{
+    switch (object.type()) {
+    case osmium::item_type::node: {
+        auto const &node = static_cast<osmium::Node const &>(object);
+        if (!m_region.contains(node.location())) {
+            return false;
+        }
+        m_nodes.set(node.positive_id());
+        return true;
+    }
+    case osmium::item_type::way: {
+        auto const &way = static_cast<osmium::Way const &>(object);
+        for (auto const &node_ref : way.nodes()) {
+            if (m_nodes.get(node_ref.positive_ref())) {
+                m_ways.set(way.positive_id());
+                return true;
+            }
+        }
+        return false;
+    }
+    case osmium::item_type::relation: {
+        auto const &relation = static_cast<osmium::Relation const &>(object);
+        for (auto const &member : relation.members()) {
+            auto const ref = member.positive_ref();
+            if ((member.type() == osmium::item_type::node &&
+                 m_nodes.get(ref)) ||
+                (member.type() == osmium::item_type::way && m_ways.get(ref)) ||
+                (member.type() == osmium::item_type::relation &&
+                 m_relations.get(ref))) {
+                m_relations.set(relation.positive_id());
+                return true;
+            }
+        }
+        return false;
+    }
+    case osmium::item_type::area:
+        return keep_area(static_cast<osmium::Area const &>(object));
+    default:
+        break;
+    }
+    return true;
+}
+
+void RegionFilter::operator()(osmium::memory::Buffer &buffer)
+{
+    osmium::memory::Buffer out{buffer.committed() + 64,
+                               osmium::memory::Buffer::auto_grow::yes};
+    for (auto const &entity : buffer) {
+        if (entity.type() == osmium::item_type::changeset ||
+            keep(static_cast<osmium::OSMObject const &>(entity))) {
+            out.add_item(entity);
+            out.commit();
+        }
+    }
+    buffer = std::move(out);
+}
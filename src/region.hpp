@@ -0,0 +1,108 @@
+#pragma once
+
+#include <osmium/index/id_set.hpp>
+#include <osmium/memory/buffer.hpp>
+#include <osmium/osm.hpp>
+#include <osmium/osm/box.hpp>
+#include <osmium/osm/location.hpp>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/**
+ * A region given as bounding box or (multi)polygon. Points are tested with
+ * a grid index: Cells completely inside or outside of the polygon answer
+ * the test directly, only for cells on the boundary a point-in-polygon test
+ * is done against the edges in the row of the grid the point is in.
+ *
+ * Rings are combined with the even-odd rule, so inner rings (holes) can be
+ * given just like outer rings.
+ */
+class Region
+{
+public:
+    using ring_type = std::vector<osmium::Location>;
+
+    explicit Region(std::vector<ring_type> const &rings);
+
+    /// Region from "MINLON,MINLAT,MAXLON,MAXLAT".
+    static Region from_bbox(std::string const &bbox);
+
+    /// Region from a polygon file in the Osmosis poly format.
+    static Region from_poly_file(std::string const &filename);
+
+    osmium::Box const &envelope() const noexcept { return m_envelope; }
+
+    bool contains(osmium::Location location) const noexcept;
+
+private:
+    struct edge_type
+    {
+        std::int32_t x1;
+        std::int32_t y1;
+        std::int32_t x2;
+        std::int32_t y2;
+    };
+
+    enum class cell_state : std::uint8_t
+    {
+        outside = 0,
+        inside = 1,
+        boundary = 2
+    };
+
+    static constexpr std::size_t grid_size = 256;
+
+    osmium::Box m_envelope;
+    std::int64_t m_cell_width = 1;
+    std::int64_t m_cell_height = 1;
+
+    // Edges crossing each row of the grid
+    std::vector<std::vector<edge_type>> m_row_edges;
+
+    std::vector<cell_state> m_cells;
+
+    std::size_t column(std::int32_t x) const noexcept;
+
+    std::size_t row(std::int32_t y) const noexcept;
+
+    void add_edge(edge_type const &edge);
+
+    bool ray_cast(std::int32_t x, std::int32_t y,
+                  std::size_t row) const noexcept;
+
+}; // class Region
+
+/**
+ * Removes the objects outside a region from buffers.
+ *
+ * Nodes are kept if they are inside the region, ways if one of their nodes
+ * is kept, relations if one of their members is kept. Areas are kept if one
+ * of their locations is inside the region. Changesets are always kept.
+ *
+ * The ids of kept objects are remembered, so the buffers must be handed in
+ * the order of the input file and the input file must be sorted (nodes
+ * before ways before relations). Relations referring to relations later in
+ * the file are only kept if they have other members in the region.
+ */
+class RegionFilter
+{
+
+    Region m_region;
+    osmium::index::IdSetDense<osmium::unsigned_object_id_type> m_nodes;
+    osmium::index::IdSetDense<osmium::unsigned_object_id_type> m_ways;
+    osmium::index::IdSetDense<osmium::unsigned_object_id_type> m_relations;
+
+    bool keep_area(osmium::Area const &area) const noexcept;
+
+public:
+    explicit RegionFilter(Region region);
+
+    /// Decide whether this object is kept, remember its id if it is.
+    bool keep(osmium::OSMObject const &object);
+
+    /// Remove all objects not kept from the buffer.
+    void operator()(osmium::memory::Buffer &buffer);
+
+}; // class RegionFilter
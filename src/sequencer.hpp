@@ -0,0 +1,93 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <map>
+#include <mutex>
+#include <utility>
+
+/**
+ * Brings results produced out of order on several threads back into order.
+ * Each result has a sequence number, the callback is called for results in
+ * the order of those numbers without gaps. The callback runs on whatever
+ * thread added the result that completed a sequence, but never on two
+ * threads at the same time.
+ *
+ * To limit the memory used by waiting results, add() blocks while the
+ * result is max_ahead or more numbers ahead of the next one needed.
+ */
+template <typename T>
+class Sequencer
+{
+
+    std::function<void(T &&)> m_callback;
+    std::map<std::uint64_t, T> m_pending;
+    std::uint64_t m_next = 0;
+    std::uint64_t m_max_ahead;
+    bool m_cancelled = false;
+    std::mutex m_mutex;
+    std::condition_variable m_advanced;
+
+public:
+    explicit Sequencer(
+        std::function<void(T &&)> callback,
+        std::uint64_t max_ahead = std::numeric_limits<std::uint64_t>::max())
+    : m_callback(std::move(callback)), m_max_ahead(max_ahead)
+    {
+    }
+
+    void add(std::uint64_t seq, T &&value)
+    {
+        std::unique_lock<std::mutex> lock{m_mutex};
+
+        m_advanced.wait(lock, [&]() {
+            return m_cancelled || seq - m_next < m_max_ahead;
+        });
+        if (m_cancelled) {
+            return;
+        }
+
+        if (seq != m_next) {
+            m_pending.emplace(seq, std::move(value));
+            return;
+        }
+
+        m_callback(std::move(value));
+        ++m_next;
+
+        auto it = m_pending.begin();
+        while (it != m_pending.end() && it->first == m_next) {
+            m_callback(std::move(it->second));
+            it = m_pending.erase(it);
+            ++m_next;
+        }
+
+        m_advanced.notify_all();
+    }
+
+    /**
+     * Stop waiting for results, for instance because one of the threads
+     * producing them failed. Wakes up all blocked add() calls, results
+     * added after this are dropped.
+     */
+    void cancel()
+    {
+        {
+            std::lock_guard<std::mutex> const lock{m_mutex};
+            m_cancelled = true;
+            m_pending.clear();
+        }
+        m_advanced.notify_all();
+    }
+
+    /// Number of results waiting for an earlier result.
+    std::size_t pending()
+    {
+        std::lock_guard<std::mutex> const lock{m_mutex};
+        return m_pending.size();
+    }
+
+}; // class Sequencer
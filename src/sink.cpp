@@ -0,0 +1,176 @@
+#include "sink.hpp"
+
+#include "options.hpp"
+
+#ifdef OPE_WITH_IO_URING
+#include "uring.hpp"
+#endif
+
+#include <cerrno>
+#include <fcntl.h>
+#include <iostream>
+#include <stdexcept>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+#include <utility>
+
+extern Options opts;
+
+FileSink::FileSink(std::string filename) : m_filename(std::move(filename))
+{
+    if (m_filename.empty()) {
+        m_fd = 1;
+        return;
+    }
+
+    m_fd = ::open(m_filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC,
+                  0666); // NOLINT(hicpp-signed-bitwise, hicpp-vararg)
+    if (m_fd < 0) {
+        throw std::runtime_error{"can't open file: " + m_filename};
+    }
+}
+
+FileSink::~FileSink()
+{
+    try {
+        close();
+    } catch (...) {
+        // ignore exceptions in destructor
+    }
+}
+
+void FileSink::write(std::string_view data)
+{
+    while (!data.empty()) {
+        auto const written = ::write(m_fd, data.data(), data.size());
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            throw std::runtime_error{"write error: " + m_filename};
+        }
+        data.remove_prefix(static_cast<std::size_t>(written));
+    }
+}
+
+void FileSink::close()
+{
+    if (m_fd > 1) {
+        if (::close(m_fd) != 0) {
+            m_fd = -1;
+            throw std::runtime_error{"error closing file: " + m_filename};
+        }
+    }
+    m_fd = -1;
+}
+
+std::unique_ptr<Sink> open_file_sink(std::string const &filename)
+{
+#ifdef OPE_WITH_IO_URING
+    if (opts.io_uring && !filename.empty()) {
+        auto writer = UringWriter::shared(opts.buffer_size, opts.direct_io);
+        if (writer) {
+            return std::make_unique<UringSink>(std::move(writer), filename);
+        }
+        static bool warned = false;
+        if (!warned) {
+            std::cerr << "Warning! io_uring not available, using write()\n";
+            warned = true;
+        }
+    }
+#endif
+    return std::make_unique<FileSink>(filename);
+}
+
+AsyncSink::AsyncSink(std::unique_ptr<Sink> sink, std::size_t buffer_count,
+                     std::size_t buffer_size)
+: m_sink(std::move(sink)), m_full(buffer_count), m_free(buffer_count)
+{
+    for (std::size_t n = 1; n < buffer_count; ++n) {
+        std::string buffer;
+        buffer.reserve(buffer_size);
+        m_free.push(std::move(buffer));
+    }
+    m_thread = std::thread{&AsyncSink::run, this};
+}
+
+AsyncSink::~AsyncSink()
+{
+    try {
+        stop();
+    } catch (...) {
+        // ignore exceptions in destructor
+    }
+}
+
+void AsyncSink::run()
+{
+    while (true) {
+        auto buffer = m_full.pop();
+        bool const last = buffer.empty();
+
+        // After an error keep recycling buffers so that the writer doesn't
+        // block, they are just not written any more.
+        if (!m_failed) {
+            try {
+                if (last) {
+                    m_sink->close();
+                } else {
+                    m_sink->write_buffer(buffer);
+                }
+            } catch (...) {
+                m_error = std::current_exception();
+                m_failed = true;
+            }
+        }
+
+        if (last) {
+            return;
+        }
+
+        buffer.clear();
+        m_free.push(std::move(buffer));
+    }
+}
+
+void AsyncSink::stop()
+{
+    if (m_thread.joinable()) {
+        m_full.push(std::string{});
+        m_thread.join();
+    }
+}
+
+void AsyncSink::check_error()
+{
+    if (m_failed) {
+        std::rethrow_exception(m_error);
+    }
+}
+
+void AsyncSink::write(std::string_view data)
+{
+    check_error();
+    if (!data.empty()) {
+        auto buffer = m_free.pop();
+        buffer.assign(data);
+        m_full.push(std::move(buffer));
+    }
+}
+
+void AsyncSink::write_buffer(std::string &buffer)
+{
+    check_error();
+    if (!buffer.empty()) {
+        auto next = m_free.pop();
+        std::swap(next, buffer);
+        m_full.push(std::move(next));
+    }
+}
+
+void AsyncSink::close()
+{
+    stop();
+    check_error();
+}
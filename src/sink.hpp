@@ -0,0 +1,132 @@
+#pragma once
+
+#include "queue.hpp"
+
+#include <atomic>
+#include <cstddef>
+#include <exception>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <thread>
+
+/**
+ * Where the data for a table ends up. Tables collect rows in a buffer and
+ * hand it to their sink from time to time.
+ */
+class Sink
+{
+public:
+    Sink() = default;
+
+    Sink(Sink const &) = delete;
+    Sink &operator=(Sink const &) = delete;
+
+    Sink(Sink &&) = delete;
+    Sink &operator=(Sink &&) = delete;
+
+    virtual ~Sink() = default;
+
+    virtual void write(std::string_view data) = 0;
+
+    /**
+     * Write the contents of the buffer. The buffer is empty afterwards, but
+     * it might not be the same buffer any more. Sinks can use this to take
+     * over the buffer instead of copying the data.
+     */
+    virtual void write_buffer(std::string &buffer)
+    {
+        write(buffer);
+        buffer.clear();
+    }
+
+    /// Finish writing, no more writes are allowed after this.
+    virtual void close() = 0;
+
+}; // class Sink
+
+/**
+ * Sink writing to a file. If the filename is empty, STDOUT is used.
+ */
+class FileSink : public Sink
+{
+
+    std::string m_filename;
+    int m_fd = -1;
+
+public:
+    explicit FileSink(std::string filename);
+
+    ~FileSink() override;
+
+    FileSink(FileSink const &) = delete;
+    FileSink &operator=(FileSink const &) = delete;
+
+    FileSink(FileSink &&) = delete;
+    FileSink &operator=(FileSink &&) = delete;
+
+    void write(std::string_view data) override;
+
+    void close() override;
+
+}; // class FileSink
+
+/**
+ * Open the file with the given name for writing. Uses io_uring if that is
+ * enabled in the options and available, a FileSink otherwise.
+ */
+std::unique_ptr<Sink> open_file_sink(std::string const &filename);
+
+/**
+ * Sink handing the data to another sink on a separate I/O thread. It works
+ * with a fixed number of buffers: write_buffer() swaps the full buffer of
+ * the caller with an empty one and returns immediately. The caller only
+ * waits if all buffers are waiting to be written.
+ */
+class AsyncSink : public Sink
+{
+
+    std::unique_ptr<Sink> m_sink;
+
+    // Full buffers waiting to be written, an empty buffer marks the end.
+    Queue<std::string> m_full;
+
+    // Empty buffers ready to be filled again.
+    Queue<std::string> m_free;
+
+    // Set by the I/O thread, m_failed is set after m_error.
+    std::exception_ptr m_error{};
+    std::atomic<bool> m_failed{false};
+
+    std::thread m_thread;
+
+    void run();
+
+    void stop();
+
+    void check_error();
+
+public:
+    /**
+     * Create an AsyncSink writing to sink. The buffer_count includes the
+     * buffer of the caller, so with a buffer_count of 2 this is double
+     * buffering.
+     */
+    AsyncSink(std::unique_ptr<Sink> sink, std::size_t buffer_count,
+              std::size_t buffer_size);
+
+    ~AsyncSink() override;
+
+    AsyncSink(AsyncSink const &) = delete;
+    AsyncSink &operator=(AsyncSink const &) = delete;
+
+    AsyncSink(AsyncSink &&) = delete;
+    AsyncSink &operator=(AsyncSink &&) = delete;
+
+    void write(std::string_view data) override;
+
+    void write_buffer(std::string &buffer) override;
+
+    void close() override;
+
+}; // class AsyncSink
@@ -0,0 +1,23 @@
+
+#include "stats.hpp"
+
+#include <format>
+
+namespace {
+
+double seconds(StageStats::clock::duration duration) noexcept
+{
+    return std::chrono::duration<double>(duration).count();
+}
+
+} // anonymous namespace
+
+std::string StageStats::summary() const
+{
+    auto const mb = static_cast<double>(m_bytes) / (1024 * 1024);
+    auto const busy = seconds(m_busy);
+    return std::format("{} buffers, {:.1f} MB, busy {:.2f}s ({:.1f} MB/s), "
+                       "waiting for input {:.2f}s, for output {:.2f}s",
+                       m_buffers, mb, busy, busy > 0 ? mb / busy : 0.0,
+                       seconds(m_input_wait), seconds(m_output_wait));
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <string>
+
+/**
+ * Statistics for one stage of the processing pipeline: how much data went
+ * through it and how long it was working or waiting for the stages before
+ * and after it. Comparing these for all stages shows the bottleneck.
+ */
+class StageStats
+{
+public:
+    using clock = std::chrono::steady_clock;
+
+    void add_buffer(std::size_t bytes) noexcept
+    {
+        ++m_buffers;
+        m_bytes += bytes;
+    }
+
+    void add_busy(clock::duration duration) noexcept { m_busy += duration; }
+
+    void add_input_wait(clock::duration duration) noexcept
+    {
+        m_input_wait += duration;
+    }
+
+    void add_output_wait(clock::duration duration) noexcept
+    {
+        m_output_wait += duration;
+    }
+
+    /// One line summary of the stats.
+    std::string summary() const;
+
+private:
+    std::size_t m_buffers = 0;
+    std::size_t m_bytes = 0;
+    clock::duration m_busy{};
+    clock::duration m_input_wait{};
+    clock::duration m_output_wait{};
+
+}; // class StageStats
+
+/// Measures the time between calls to lap().
+class StopWatch
+{
+
+    StageStats::clock::time_point m_start = StageStats::clock::now();
+
+public:
+    StageStats::clock::duration lap() noexcept
+    {
+        auto const now = StageStats::clock::now();
+        auto const duration = now - m_start;
+        m_start = now;
+        return duration;
+    }
+
+}; // class StopWatch
@@ -0,0 +1,182 @@
+#include "table-workers.hpp"
+
+#include <osmium/visitor.hpp>
+
+#include <algorithm>
+#include <format>
+
+namespace {
+
+// Maximum number of buffers waiting for each worker. Limits memory use if
+// formatting is slower than reading.
+constexpr std::size_t max_queue_size = 8;
+
+// Maximum number of chunks each lane of a table can be ahead of the slowest
+// lane. Limits the memory used by finished chunks waiting in the sequencer.
+constexpr std::size_t max_chunks_ahead = 2;
+
+// Decide how many lanes each table gets. Every table gets one, threads left
+// over are shared between the tables that can be formatted in parallel.
+std::vector<std::size_t>
+lanes_per_table(std::vector<Table *> const &tables, std::size_t num_threads)
+{
+    std::vector<std::size_t> lanes(tables.size(), 1);
+
+    std::vector<std::size_t> parallel;
+    for (std::size_t n = 0; n < tables.size(); ++n) {
+        if (tables[n]->parallel_formatting()) {
+            parallel.push_back(n);
+        }
+    }
+
+    if (num_threads > tables.size() && !parallel.empty()) {
+        auto const extra = num_threads - tables.size();
+        for (std::size_t n = 0; n < extra; ++n) {
+            ++lanes[parallel[n % parallel.size()]];
+        }
+    }
+
+    return lanes;
+}
+
+} // anonymous namespace
+
+TableWorkers::TableWorkers(std::vector<Table *> const &tables,
+                           unsigned int num_threads)
+{
+    auto const lanes = lanes_per_table(tables, num_threads);
+    for (auto const count : lanes) {
+        m_num_lanes += count;
+    }
+
+    auto const num_workers = std::min<std::size_t>(num_threads, m_num_lanes);
+    for (std::size_t n = 0; n < num_workers; ++n) {
+        m_workers.push_back(std::make_unique<worker_type>(max_queue_size));
+    }
+
+    std::size_t next_worker = 0;
+    for (std::size_t n = 0; n < tables.size(); ++n) {
+        Table *table = tables[n];
+        auto const count = lanes[n];
+
+        Sequencer<std::string> *sequencer = nullptr;
+        if (count > 1) {
+            m_sequencers.push_back(std::make_unique<Sequencer<std::string>>(
+                [table](std::string &&rows) { table->append_rows(rows); },
+                count * max_chunks_ahead));
+            sequencer = m_sequencers.back().get();
+        }
+
+        for (std::size_t index = 0; index < count; ++index) {
+            std::unique_ptr<Table> formatter;
+            if (count > 1) {
+                formatter = table->create_formatter();
+            }
+            Handler handler{{formatter ? formatter.get() : table}};
+            m_workers[next_worker]->lanes.push_back(lane_type{
+                std::move(formatter), std::move(handler), sequencer, index,
+                count, table->name()});
+            next_worker = (next_worker + 1) % num_workers;
+        }
+    }
+
+    for (auto &worker : m_workers) {
+        worker->thread = std::thread{run, worker.get()};
+    }
+    m_running = true;
+}
+
+TableWorkers::~TableWorkers()
+{
+    try {
+        stop();
+    } catch (...) {
+        // ignore exceptions in destructor
+    }
+}
+
+void TableWorkers::run(worker_type *worker)
+{
+    std::uint64_t seq = 0;
+    StopWatch watch;
+    while (auto const buffer = worker->queue.pop()) {
+        worker->stats.add_input_wait(watch.lap());
+        // After an error keep taking buffers from the queue so that the
+        // reader doesn't block, they are just not processed any more.
+        if (!worker->error) {
+            worker->stats.add_buffer(buffer->committed());
+            try {
+                for (auto &lane : worker->lanes) {
+                    if (seq % lane.count != lane.index) {
+                        continue;
+                    }
+                    osmium::apply(*buffer, lane.handler);
+                    if (lane.sequencer) {
+                        lane.sequencer->add(seq, lane.formatter->take_rows());
+                    }
+                }
+            } catch (...) {
+                worker->error = std::current_exception();
+                // The other lanes of the tables would wait forever for the
+                // chunks of this worker.
+                for (auto &lane : worker->lanes) {
+                    if (lane.sequencer) {
+                        lane.sequencer->cancel();
+                    }
+                }
+            }
+        }
+        worker->stats.add_busy(watch.lap());
+        ++seq;
+    }
+}
+
+void TableWorkers::operator()(osmium::memory::Buffer &&buffer)
+{
+    auto const shared_buffer =
+        std::make_shared<osmium::memory::Buffer const>(std::move(buffer));
+    for (auto &worker : m_workers) {
+        worker->queue.push(shared_buffer);
+    }
+}
+
+void TableWorkers::stop()
+{
+    if (!m_running) {
+        return;
+    }
+    m_running = false;
+
+    for (auto &worker : m_workers) {
+        worker->queue.push(nullptr);
+    }
+    for (auto &worker : m_workers) {
+        worker->thread.join();
+    }
+}
+
+void TableWorkers::finish()
+{
+    stop();
+
+    for (auto const &worker : m_workers) {
+        if (worker->error) {
+            std::rethrow_exception(worker->error);
+        }
+    }
+}
+
+std::string TableWorkers::worker_stats(std::size_t n) const
+{
+    auto &worker = *m_workers[n];
+    std::string tables;
+    for (auto const &lane : worker.lanes) {
+        if (!tables.empty()) {
+            tables += ' ';
+        }
+        tables += lane.name;
+    }
+    return std::format("[{}] {}, queue average {:.1f} max {}", tables,
+                       worker.stats.summary(), worker.queue.average_depth(),
+                       worker.queue.max_depth());
+}
@@ -0,0 +1,103 @@
+#pragma once
+
+#include "handler.hpp"
+#include "queue.hpp"
+#include "sequencer.hpp"
+#include "stats.hpp"
+#include "table.hpp"
+
+#include <osmium/memory/buffer.hpp>
+
+#include <cstdint>
+#include <exception>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+ * A pool of worker threads formatting rows for the output tables.
+ *
+ * Each table is formatted in one or more "lanes". If there are more threads
+ * than tables, tables that allow it get several lanes. With n lanes every
+ * lane formats every n-th buffer into a formatter of its own and the
+ * resulting chunks of rows are appended to the table in input order. So the
+ * output is the same as if everything ran on a single thread.
+ *
+ * Lanes are distributed over the workers. Every worker sees all buffers in
+ * the order they were handed to the pool.
+ */
+class TableWorkers
+{
+
+    using buffer_ptr = std::shared_ptr<osmium::memory::Buffer const>;
+
+    struct lane_type
+    {
+        // Formatter for this lane, only used if the table has several lanes.
+        std::unique_ptr<Table> formatter;
+
+        Handler handler;
+
+        // Puts chunks from all lanes of a table back in order, only used if
+        // the table has several lanes.
+        Sequencer<std::string> *sequencer;
+
+        std::size_t index;
+        std::size_t count;
+
+        // Name of the table, for the stats
+        std::string name;
+    };
+
+    struct worker_type
+    {
+        std::vector<lane_type> lanes;
+        Queue<buffer_ptr> queue;
+        StageStats stats{};
+        std::exception_ptr error{};
+        std::thread thread{};
+
+        explicit worker_type(std::size_t max_queue_size)
+        : queue(max_queue_size)
+        {
+        }
+    };
+
+    std::vector<std::unique_ptr<Sequencer<std::string>>> m_sequencers;
+    std::vector<std::unique_ptr<worker_type>> m_workers;
+    std::size_t m_num_lanes = 0;
+    bool m_running = false;
+
+    static void run(worker_type *worker);
+
+    void stop();
+
+public:
+    TableWorkers(std::vector<Table *> const &tables, unsigned int num_threads);
+
+    TableWorkers(TableWorkers const &) = delete;
+    TableWorkers &operator=(TableWorkers const &) = delete;
+
+    TableWorkers(TableWorkers &&) = delete;
+    TableWorkers &operator=(TableWorkers &&) = delete;
+
+    ~TableWorkers();
+
+    std::size_t size() const noexcept { return m_workers.size(); }
+
+    std::size_t num_lanes() const noexcept { return m_num_lanes; }
+
+    /// Hand a buffer to all workers. Blocks if the workers are too far behind.
+    void operator()(osmium::memory::Buffer &&buffer);
+
+    /**
+     * Wait for all workers to process the remaining buffers. Rethrows the
+     * first exception thrown in any of the workers.
+     */
+    void finish();
+
+    /// Summary of the stats of worker n, only valid after finish().
+    std::string worker_stats(std::size_t n) const;
+
+}; // class TableWorkers
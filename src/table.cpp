@@ -1,11 +1,19 @@
 
 #include "table.hpp"
 
+#include "compression.hpp"
 #include "options.hpp"
 
+#ifdef OPE_WITH_LIBPQ
+#include "pg-sink.hpp"
+#endif
+
+#include <algorithm>
 #include <cmath>
+#include <filesystem>
 #include <format>
 #include <iostream>
+#include <limits>
 
 extern Options opts;
 
@@ -182,6 +190,62 @@ column_config_type const &get_column_config(std::string const &format_string)
     throw std::runtime_error{"Unknown column config: " + format_string};
 }
 
+binary_type binary_type_for_sql_type(std::string_view const sql_type) noexcept
+{
+    // clang-format off
+    static const std::vector<std::pair<std::string_view, binary_type>> types{
+        {"BIGINT[]",     binary_type::int8_array},
+        {"BIGINT",       binary_type::int8},
+        {"INT",          binary_type::int4},
+        {"BOOLEAN",      binary_type::boolean},
+        {"REAL",         binary_type::float4},
+        {"TIMESTAMP",    binary_type::timestamp},
+        {"TSTZRANGE",    binary_type::tstzrange},
+        {"JSONB",        binary_type::jsonb},
+        {"JSON",         binary_type::text},
+        {"HSTORE",       binary_type::hstore},
+        {"GEOMETRY",     binary_type::geometry},
+        {"TEXT",         binary_type::text},
+        {"CHAR",         binary_type::text},
+        {"nwr_enum",     binary_type::text},
+    };
+    // clang-format on
+
+    for (auto const &[prefix, type] : types) {
+        if (sql_type.starts_with(prefix)) {
+            return type;
+        }
+    }
+
+    return binary_type::unsupported;
+}
+
+// Is this one of the column types written by Table::write_object_column()?
+bool is_object_column(column_type const format) noexcept
+{
+    switch (format) {
+    case column_type::objtype:
+    case column_type::id:
+    case column_type::version:
+    case column_type::deleted:
+    case column_type::visible:
+    case column_type::changeset:
+    case column_type::timestamp_iso:
+    case column_type::timestamp_sec:
+    case column_type::timestamp_range:
+    case column_type::uid:
+    case column_type::user:
+    case column_type::lon_real:
+    case column_type::lon_int:
+    case column_type::lat_real:
+    case column_type::lat_int:
+        return true;
+    default:
+        break;
+    }
+    return false;
+}
+
 } // anonymous namespace
 
 void Table::setup_columns()
@@ -195,20 +259,31 @@ void Table::setup_columns()
         cs += *it++;
         cs += *it++;
         m_columns.emplace_back(get_column_config(cs));
-        m_column_flags = static_cast<sql_column_config_flags>(
-            m_column_flags | m_columns.back().flags);
+        auto &column = m_columns.back();
+        m_column_flags =
+            static_cast<sql_column_config_flags>(m_column_flags | column.flags);
+        column.binary = binary_type_for_sql_type(column.sql_type);
+        if (m_binary && column.binary == binary_type::unsupported) {
+            throw std::runtime_error{"Column type " + column.sql_type +
+                                     " not supported in binary format"};
+        }
+    }
+
+    while (m_prefix_columns < m_columns.size() &&
+           is_object_column(m_columns[m_prefix_columns].format)) {
+        ++m_prefix_columns;
     }
 }
 
 Table::Table(std::string filename, stream_config_type const &stream_config,
              std::string columns_string)
 : m_filename(std::move(filename)), m_columns_string(std::move(columns_string)),
-  m_stream_config(&stream_config)
+  m_stream_config(&stream_config), m_flush_size(opts.buffer_size),
+  m_binary(opts.binary_format)
 {
 
     if (m_filename.empty()) { // no name means STDOUT
         m_name = m_stream_config->name;
-        m_fd = 1;
     } else {
         auto const last_slash = m_filename.find_last_of('/');
         if (last_slash == std::string::npos) {
@@ -224,18 +299,128 @@ Table::Table(std::string filename, stream_config_type const &stream_config,
         } else {
             m_filename += ".pgcopy";
         }
+    }
 
-        m_fd = ::open(m_filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC,
-                      0666); // NOLINT(hicpp-signed-bitwise, hicpp-vararg)
-        if (m_fd < 0) {
-            throw std::runtime_error{"can't open file: " + m_filename};
+    setup_columns();
+
+    // Leave some space for the row that goes over the flush size.
+    m_buffer.reserve(m_flush_size + (m_flush_size / 8));
+}
+
+std::string Table::shard_filename(std::size_t n) const
+{
+    // The shard number goes before the suffix: "dir/ways_3.pgcopy.zst"
+    auto const slash = m_filename.find_last_of('/');
+    auto const dot = m_filename.find_first_of(
+        '.', slash == std::string::npos ? 0 : slash + 1);
+    if (dot == std::string::npos) {
+        return m_filename + "_" + std::to_string(n);
+    }
+    return m_filename.substr(0, dot) + "_" + std::to_string(n) +
+           m_filename.substr(dot);
+}
+
+std::vector<std::string> Table::output_filenames() const
+{
+    auto const count = shard_count();
+    if (count <= 1) {
+        return {m_filename};
+    }
+
+    std::vector<std::string> filenames;
+    for (std::size_t n = 0; n < count; ++n) {
+        filenames.push_back(shard_filename(n));
+    }
+    return filenames;
+}
+
+void Table::select_shard(std::size_t const shard)
+{
+    if (shard == m_current_shard || m_shards.empty()) {
+        return;
+    }
+
+    std::swap(m_buffer, m_shards[m_current_shard].buffer);
+    std::swap(m_sink, m_shards[m_current_shard].sink);
+    std::swap(m_sorter, m_shards[m_current_shard].sorter);
+    std::swap(m_buffer, m_shards[shard].buffer);
+    std::swap(m_sink, m_shards[shard].sink);
+    std::swap(m_sorter, m_shards[shard].sorter);
+    m_current_shard = shard;
+}
+
+void Table::open()
+{
+    auto const add_buffers = [this](std::unique_ptr<Sink> sink) {
+        if (opts.buffer_count > 1) {
+            return std::unique_ptr<Sink>{std::make_unique<AsyncSink>(
+                std::move(sink), opts.buffer_count, m_buffer.capacity())};
+        }
+        return sink;
+    };
+
+    if (!opts.database.empty()) {
+#ifdef OPE_WITH_LIBPQ
+        // The table was already created by sql_setup() of all tables.
+        m_sink = add_buffers(std::make_unique<PgCopySink>(
+            opts.database,
+            std::format("COPY \"{}\" FROM STDIN{}", m_name,
+                        m_binary ? " WITH (FORMAT binary)" : ""),
+            sql_finish(false)));
+#else
+        throw std::runtime_error{
+            "Can't write to database: compiled without PostgreSQL support"};
+#endif
+    } else if (shard_count() > 1) {
+        if (m_filename.empty()) {
+            throw std::runtime_error{"Can't split output to STDOUT"};
         }
+        auto const filenames = output_filenames();
+        m_shards.resize(filenames.size());
+        for (std::size_t n = 0; n < filenames.size(); ++n) {
+            m_shards[n].sink = add_buffers(create_file_sink(filenames[n]));
+            m_shards[n].buffer.reserve(m_buffer.capacity());
+        }
+        m_current_shard = 0;
+        std::swap(m_buffer, m_shards[0].buffer);
+        std::swap(m_sink, m_shards[0].sink);
+    } else {
+        m_sink = add_buffers(create_file_sink(m_filename));
     }
 
-    setup_columns();
+    if (opts.update) {
+        m_delete_sink = create_file_sink(delete_filename());
+    }
+
+    auto const count = std::max<std::size_t>(m_shards.size(), 1);
+    for (std::size_t n = 0; n < count; ++n) {
+        select_shard(n);
+        if (m_binary) {
+            // signature, flags, length of header extension
+            static std::string_view const signature{"PGCOPY\n\377\r\n\0",
+                                                    11};
+            m_buffer.append(signature.begin(), signature.end());
+            add_int32_binary(m_buffer, 0);
+            add_int32_binary(m_buffer, 0);
+        }
+        if (opts.sort_by != sort_method::none) {
+            // The header goes out before the sorted rows.
+            flush();
+            m_sorter = std::make_unique<ExternalSorter>(
+                sort_filename_prefix(n), opts.sort_memory / count);
+        }
+    }
+    select_shard(0);
+}
 
-    constexpr std::size_t min_buffer_size = 1024'000;
-    m_buffer.reserve(min_buffer_size);
+std::string Table::sort_filename_prefix(std::size_t n) const
+{
+    if (m_filename.empty()) {
+        return (std::filesystem::temp_directory_path() /
+                std::format("{}_{}.sort", m_name, n))
+            .string();
+    }
+    return output_filenames()[n] + ".sort";
 }
 
 void Table::flush()
@@ -244,37 +429,78 @@ void Table::flush()
         return;
     }
 
-    auto const written = ::write(m_fd, m_buffer.data(), m_buffer.size());
-    if (written < 0 || static_cast<std::size_t>(written) != m_buffer.size()) {
-        throw std::runtime_error{"write error"};
-    }
-    m_buffer.clear();
+    StopWatch watch;
+    m_write_stats.add_buffer(m_buffer.size());
+    m_sink->write_buffer(m_buffer);
+    m_write_stats.add_busy(watch.lap());
 }
 
 void Table::close()
 {
-    if (m_fd != -1 && m_fd != 1) {
-        ::close(m_fd);
-        m_fd = -1;
+    if (!m_sink) {
+        return;
+    }
+
+    auto const count = std::max<std::size_t>(m_shards.size(), 1);
+    for (std::size_t n = 0; n < count; ++n) {
+        select_shard(n);
+        if (m_sorter) {
+            m_sorter->finish([this](std::string_view rows) {
+                m_buffer.append(rows);
+                if (m_buffer.size() > m_flush_size) {
+                    flush();
+                }
+            });
+            m_sorter.reset();
+        }
+        if (m_binary) {
+            // file trailer
+            add_int16_binary(m_buffer, -1);
+        }
+        flush();
+        m_sink->close();
+    }
+
+    m_sink.reset();
+    m_shards.clear();
+
+    if (m_delete_sink) {
+        m_delete_sink->write_buffer(m_delete_buffer);
+        m_delete_sink->close();
+        m_delete_sink.reset();
     }
 }
 
 namespace {
 
-std::string primary_key(std::string const &table_name, std::string const &keys)
+// Statements creating keys and indexes are commented out in the SQL
+// scripts, so the user can decide which ones are needed. They are run when
+// writing into the database directly.
+char const *comment_prefix(bool commented) noexcept
+{
+    return commented ? "-- " : "";
+}
+
+std::string primary_key(std::string const &table_name, std::string const &keys,
+                        bool commented)
 {
     return std::format(
-        "-- ALTER TABLE \"{0}\" ADD PRIMARY KEY({1}); -- %PK:{0}%\n",
-        table_name, keys);
+        "{2}ALTER TABLE \"{0}\" ADD PRIMARY KEY({1}); -- %PK:{0}%\n",
+        table_name, keys, comment_prefix(commented));
 }
 
 } // anonymous namespace
 
-std::string Table::sql_primary_key() const
+bool Table::key_has_objtype() const noexcept
+{
+    return m_stream_config->entities == osmium::osm_entity_bits::nwr;
+}
+
+std::string Table::primary_key_columns() const
 {
     // TODO: should be different for different streams, disable if the fields are not all there
     std::string primary_keys;
-    if (m_stream_config->entities == osmium::osm_entity_bits::nwr) {
+    if (key_has_objtype()) {
         primary_keys += "objtype, ";
     }
     primary_keys += "id, ";
@@ -283,14 +509,58 @@ std::string Table::sql_primary_key() const
     }
     primary_keys.resize(primary_keys.size() - 2);
 
-    return primary_key(name(), primary_keys);
+    return primary_keys;
 }
 
-void Table::sql_data_definition() const
+std::string Table::sql_primary_key(bool commented) const
 {
-    std::string sql;
+    auto const columns = primary_key_columns();
+
+    if (opts.partition && opts.shard_by == shard_method::tile) {
+        // The tile isn't part of the primary key, so it can only be added to
+        // each partition.
+        std::string sql;
+        for (std::size_t n = 0; n < shard_count(); ++n) {
+            sql += primary_key(partition_name(n), columns, commented);
+        }
+        return sql;
+    }
 
-    sql += "\\timing\n\n";
+    return primary_key(name(), columns, commented);
+}
+
+namespace {
+
+constexpr char const *const nwr_enum_type =
+    "CREATE TYPE \"nwr_enum\" AS ENUM ('Node', 'Way', 'Relation'); "
+    "-- %ENUM:nwr_enum%\n";
+
+constexpr char const *const rel_member_type =
+    "CREATE TYPE \"rel_member\" AS ( -- %TYPE:rel_member%\n"
+    "    \"objtype\" CHAR(1), -- %TYPE:rel_member:objtype%\n"
+    "    \"ref\" BIGINT, -- %TYPE:rel_member:ref%\n"
+    "    \"role\" TEXT -- %TYPE:rel_member:role%\n"
+    ");\n";
+
+// Create a type, either replacing an existing one or keeping it. Keeping it
+// is needed when several tables are created at the same time.
+std::string create_type(char const *name, char const *type_sql,
+                        bool replace_types)
+{
+    if (replace_types) {
+        return std::format("DROP TYPE IF EXISTS \"{}\" CASCADE;\n\n{}\n",
+                           name, type_sql);
+    }
+    return std::format("DO $$ BEGIN\n{}EXCEPTION WHEN duplicate_object THEN "
+                       "NULL;\nEND $$;\n\n",
+                       type_sql);
+}
+
+} // anonymous namespace
+
+std::string Table::sql_create_table(bool replace_types) const
+{
+    std::string sql;
 
     if (m_column_flags & sql_column_config_flags::hstore) {
         sql += "CREATE EXTENSION IF NOT EXISTS hstore;\n\n";
@@ -303,49 +573,136 @@ void Table::sql_data_definition() const
     sql += std::format("DROP TABLE IF EXISTS \"{}\" CASCADE;\n\n", m_name);
 
     if (m_column_flags & sql_column_config_flags::nwr_enum) {
-        sql += "DROP TYPE IF EXISTS \"nwr_enum\" CASCADE;\n\n";
-        sql += "CREATE TYPE \"nwr_enum\" AS ENUM ('Node', 'Way', 'Relation'); "
-               "-- %ENUM:nwr_enum%\n\n";
+        sql += create_type("nwr_enum", nwr_enum_type, replace_types);
     }
 
     if (m_column_flags & sql_column_config_flags::rel_member) {
-        sql += "DROP TYPE IF EXISTS \"rel_member\" CASCADE;\n\n"
-               "CREATE TYPE \"rel_member\" AS ( -- %TYPE:rel_member%\n"
-               "    \"objtype\" CHAR(1), -- %TYPE:rel_member:objtype%\n"
-               "    \"ref\" BIGINT, -- %TYPE:rel_member:ref%\n"
-               "    \"role\" TEXT -- %TYPE:rel_member:role%\n"
-               ");\n\n";
+        sql += create_type("rel_member", rel_member_type, replace_types);
     }
 
-    sql += std::format("CREATE TABLE \"{}\" (\n", m_name);
+    std::string table_sql = std::format("CREATE TABLE \"{}\" (\n", m_name);
 
     for (auto const &column : m_columns) {
-        sql += std::format("    \"{0}\" {1}, -- %COL:{2}:{0}%\n",
-                           column.sql_name, column.sql_type, m_name);
+        table_sql += std::format("    \"{0}\" {1}, -- %COL:{2}:{0}%\n",
+                                 column.sql_name, column.sql_type, m_name);
     }
 
-    auto const pos = sql.find_last_of(',');
+    auto const pos = table_sql.find_last_of(',');
     if (pos != std::string::npos) {
-        sql.erase(pos, 1);
+        table_sql.erase(pos, 1);
+    }
+    table_sql += ")";
+
+    if (opts.partition) {
+        auto const *key = partition_key();
+        assert(key);
+        table_sql += std::format(
+            " PARTITION BY {} (\"{}\");\n\n",
+            opts.shard_by == shard_method::objtype ? "LIST" : "RANGE",
+            key->sql_name);
+        table_sql += sql_partitions();
+    } else {
+        table_sql += ";\n\n";
     }
-    sql += ");\n\n";
 
-    sql += std::format("\\copy \"{}\" from '{}'\n\n", m_name, m_filename);
+    return sql + table_sql;
+}
 
-    sql += std::format("ANALYZE \"{}\";\n\n", m_name);
+std::string Table::sql_finish(bool commented) const
+{
+    std::string sql = std::format("ANALYZE \"{}\";\n\n", m_name);
 
     if (opts.with_primary_key) {
-        sql += sql_primary_key();
+        sql += sql_primary_key(commented);
+    }
+
+    // Rows sorted by id or changeset are physically ordered by that column,
+    // so a small BRIN index is enough.
+    if (auto const *column = sort_column()) {
+        sql += std::format("{2}CREATE INDEX \"{0}_{1}_brin\" ON \"{0}\" USING "
+                           "BRIN (\"{1}\"); -- %BIDX:{0}:{1}%\n",
+                           m_name, column->sql_name,
+                           comment_prefix(commented));
     }
 
     if (m_column_flags & sql_column_config_flags::geom_index) {
-        sql += std::format("-- CREATE INDEX \"{0}_geom_idx\" ON \"{0}\" USING "
+        sql += std::format("{1}CREATE INDEX \"{0}_geom_idx\" ON \"{0}\" USING "
                            "GIST (geom); -- %GIDX:{0}:geom%\n",
-                           m_name);
+                           m_name, comment_prefix(commented));
     }
 
     sql += '\n';
 
+    return sql;
+}
+
+std::string Table::sql_copy() const
+{
+    std::string sql;
+
+    auto const filenames = output_filenames();
+    if (filenames.size() > 1) {
+        sql += "-- These can be run in parallel in separate sessions\n";
+    }
+
+    for (std::size_t n = 0; n < filenames.size(); ++n) {
+        auto const &filename = filenames[n];
+        // Copying into the partitions directly saves routing each row.
+        auto const table = opts.partition ? partition_name(n) : m_name;
+        auto const decompress = decompress_command(filename);
+        if (decompress.empty()) {
+            sql += std::format("\\copy \"{}\" from '{}'", table, filename);
+        } else {
+            sql += std::format("\\copy \"{}\" from program '{} {}'", table,
+                               decompress, filename);
+        }
+        sql += std::format("{}\n", m_binary ? " WITH (FORMAT binary)" : "");
+    }
+    sql += '\n';
+
+    return sql;
+}
+
+std::string Table::sql_update() const
+{
+    std::string columns{"\"id\" BIGINT"};
+    std::string condition{"t.\"id\" = d.\"id\""};
+    if (key_has_objtype()) {
+        columns = "\"objtype\" CHAR(1), " + columns;
+        condition = "t.\"objtype\" = d.\"objtype\" AND " + condition;
+    }
+
+    std::string sql{"BEGIN;\n\n"};
+
+    sql += std::format(
+        "CREATE TEMP TABLE \"{}_delete\" ({}) ON COMMIT DROP;\n\n", m_name,
+        columns);
+    sql += std::format("\\copy \"{}_delete\" from '{}'\n\n", m_name,
+                       delete_filename());
+    sql += std::format("DELETE FROM \"{0}\" t USING \"{0}_delete\" d WHERE "
+                       "{1};\n\n",
+                       m_name, condition);
+    sql += sql_copy();
+    sql += "COMMIT;\n\n";
+    sql += std::format("ANALYZE \"{}\";\n\n", m_name);
+
+    return sql;
+}
+
+void Table::sql_data_definition() const
+{
+    std::string sql;
+
+    sql += "\\timing\n\n";
+
+    if (opts.update) {
+        sql += sql_update();
+    } else {
+        sql += sql_create_table(true);
+        sql += sql_copy();
+        sql += sql_finish(true);
+    }
+
     std::string const sqlfilename{m_path + "/" + m_name + ".sql"};
     try {
         std::ofstream sqlfile{sqlfilename};
@@ -357,54 +714,715 @@ void Table::sql_data_definition() const
     }
 }
 
+void Table::check_update() const
+{
+    if (m_filename.empty()) {
+        throw std::runtime_error{"Update mode needs output files"};
+    }
+
+    auto const entities = m_stream_config->entities;
+    if (entities == osmium::osm_entity_bits::nothing ||
+        (entities & (osmium::osm_entity_bits::changeset |
+                     osmium::osm_entity_bits::area))) {
+        throw std::runtime_error{"Table '" + m_name +
+                                 "' can't be used in update mode"};
+    }
+
+    if (!find_column(column_type::id) ||
+        (key_has_objtype() && !find_column(column_type::objtype))) {
+        throw std::runtime_error{
+            "Table '" + m_name + "' needs " +
+            (key_has_objtype() ? "objtype and id columns" : "an id column") +
+            " in update mode"};
+    }
+}
+
+column_config_type const *Table::find_column(column_type format) const noexcept
+{
+    auto const it = std::find_if(m_columns.begin(), m_columns.end(),
+                                 [format](column_config_type const &column) {
+                                     return column.format == format;
+                                 });
+    return it == m_columns.end() ? nullptr : &*it;
+}
+
+column_config_type const *Table::partition_key() const noexcept
+{
+    switch (opts.shard_by) {
+    case shard_method::objtype:
+        return key_has_objtype() ? find_column(column_type::objtype)
+                                 : nullptr;
+    case shard_method::range:
+        return find_column(column_type::id);
+    case shard_method::tile:
+        return find_column(column_type::quadtile);
+    case shard_method::hash:
+        break;
+    }
+    return nullptr;
+}
+
+column_config_type const *Table::sort_column() const noexcept
+{
+    if (opts.sort_by != sort_method::id &&
+        opts.sort_by != sort_method::changeset) {
+        return nullptr;
+    }
+
+    // Rows of the changeset tables are sorted by changeset id with both
+    // methods. It is in the id column (changeset tags and comments) or in
+    // the changeset column (changesets).
+    if (m_stream_config->entities & osmium::osm_entity_bits::changeset) {
+        if (auto const *column = find_column(column_type::id)) {
+            return column;
+        }
+        return find_column(column_type::changeset);
+    }
+
+    return find_column(opts.sort_by == sort_method::id
+                           ? column_type::id
+                           : column_type::changeset);
+}
+
+void Table::check_partition() const
+{
+    if (!partition_key()) {
+        throw std::runtime_error{
+            "Table '" + m_name + "' can't be partitioned: it needs " +
+            (opts.shard_by == shard_method::objtype
+                 ? "objects of all types and an objtype column"
+             : opts.shard_by == shard_method::range ? "an id column"
+                                                    : "a tile column")};
+    }
+}
+
+void Table::check_shards() const
+{
+    if (opts.shard_by == shard_method::objtype && !key_has_objtype()) {
+        throw std::runtime_error{
+            "Table '" + m_name +
+            "' can't be split by object type: it needs objects of all types "
+            "(nodes, ways, and relations only)"};
+    }
+}
+
+std::string Table::delete_filename() const
+{
+    return m_path + "/" + m_name + "_delete.pgcopy";
+}
+
+void Table::add_delete_row(osmium::OSMObject const &object)
+{
+    if (key_has_objtype()) {
+        add_char(m_delete_buffer, osmium::item_type_to_char(object.type()));
+        add_char(m_delete_buffer, '\t');
+    }
+    add_int(m_delete_buffer, object.id());
+    add_char(m_delete_buffer, '\n');
+
+    if (m_delete_buffer.size() > m_flush_size) {
+        m_delete_sink->write_buffer(m_delete_buffer);
+    }
+}
+
 namespace {
 
-template <typename TFunc>
-void append_coordinate(osmium::OSMObject const &object, std::string &buffer,
-                       TFunc &&func)
+// Number of seconds between the Unix epoch and the PostgreSQL epoch
+// (2000-01-01) used in the binary format for timestamps.
+constexpr std::int64_t pg_epoch_offset = 946684800;
+
+std::int64_t pg_timestamp(osmium::Timestamp const timestamp) noexcept
+{
+    return (static_cast<std::int64_t>(timestamp.seconds_since_epoch()) -
+            pg_epoch_offset) *
+           1000000;
+}
+
+// Flags for ranges in the binary format
+constexpr char range_lb_inc = 0x02;
+constexpr char range_ub_inf = 0x10;
+
+} // anonymous namespace
+
+void Table::finish_binary_column()
+{
+    auto const length =
+        m_column_null
+            ? std::uint32_t{0xffffffffU}
+            : static_cast<std::uint32_t>(m_buffer.size() - m_column_start -
+                                         sizeof(std::int32_t));
+    for (std::size_t i = 0; i < sizeof(std::int32_t); ++i) {
+        m_buffer[m_column_start + i] =
+            static_cast<char>((length >> (8U * (3U - i))) & 0xffU);
+    }
+}
+
+void Table::write_null()
+{
+    if (m_binary) {
+        m_column_null = true;
+    } else {
+        add_null(m_buffer);
+    }
+}
+
+void Table::write_bool(bool const value)
+{
+    if (m_binary && current_binary_type() == binary_type::boolean) {
+        add_char(m_buffer, value ? '\1' : '\0');
+    } else {
+        add_bool(m_buffer, value);
+    }
+}
+
+void Table::write_char(char const value) { add_char(m_buffer, value); }
+
+void Table::write_int(std::int64_t const value)
+{
+    if (m_binary) {
+        switch (current_binary_type()) {
+        case binary_type::int4:
+            add_int32_binary(m_buffer, static_cast<std::int32_t>(value));
+            return;
+        case binary_type::int8:
+            add_int64_binary(m_buffer, value);
+            return;
+        default:
+            break;
+        }
+    }
+    add_int(m_buffer, value);
+}
+
+void Table::write_coordinate(std::int32_t const value)
 {
-    if (object.type() != osmium::item_type::node ||
-        !static_cast<osmium::Node const &>(object).location()) {
-        add_null(buffer);
+    if (m_binary) {
+        add_float4_binary(m_buffer,
+                          static_cast<float>(
+                              static_cast<double>(value) /
+                              osmium::Location::coordinate_precision));
+    } else {
+        add_coordinate(m_buffer, value);
+    }
+}
+
+void Table::write_text(char const *value)
+{
+    if (m_binary) {
+        m_buffer.append(value);
+    } else {
+        append_pg_escaped(m_buffer, value);
+    }
+}
+
+void Table::write_timestamp(osmium::Timestamp const timestamp)
+{
+    if (m_binary) {
+        add_int64_binary(m_buffer, pg_timestamp(timestamp));
+    } else {
+        m_buffer.append(timestamp.to_iso());
+    }
+}
+
+void Table::write_timestamp_range(osmium::Timestamp const start,
+                                  osmium::Timestamp const finish)
+{
+    if (!m_binary) {
+        std::format_to(std::back_inserter(m_buffer), "{}",
+                       timestamp_range{start, finish});
+        return;
+    }
+
+    bool const has_upper = finish.valid() && finish >= start;
+    add_char(m_buffer, has_upper ? range_lb_inc
+                                 : static_cast<char>(range_lb_inc |
+                                                     range_ub_inf));
+    add_int32_binary(m_buffer, sizeof(std::int64_t));
+    add_int64_binary(m_buffer, pg_timestamp(start));
+    if (has_upper) {
+        add_int32_binary(m_buffer, sizeof(std::int64_t));
+        add_int64_binary(m_buffer, pg_timestamp(finish));
+    }
+}
+
+void Table::write_geometry(std::string const &wkb) { m_buffer.append(wkb); }
+
+void Table::write_tags_json(osmium::TagList const &tags)
+{
+    if (!m_binary) {
+        add_tags_json(m_buffer, tags);
+        return;
+    }
+
+    if (current_binary_type() == binary_type::jsonb) {
+        add_char(m_buffer, '\1'); // jsonb format version
+    }
+    add_tags_json_binary(m_buffer, tags);
+}
+
+void Table::write_tags_hstore(osmium::TagList const &tags)
+{
+    if (m_binary) {
+        add_tags_hstore_binary(m_buffer, tags);
+    } else {
+        add_tags_hstore(m_buffer, tags);
+    }
+}
+
+void Table::write_nodes_array(osmium::WayNodeList const &nodes)
+{
+    if (m_binary) {
+        add_way_nodes_array_binary(m_buffer, nodes);
+    } else {
+        add_way_nodes_array(m_buffer, nodes);
+    }
+}
+
+void Table::write_members_json(osmium::RelationMemberList const &members)
+{
+    if (!m_binary) {
+        add_members_json(m_buffer, members);
+        return;
+    }
+
+    if (current_binary_type() == binary_type::jsonb) {
+        add_char(m_buffer, '\1'); // jsonb format version
+    }
+    add_members_json_binary(m_buffer, members);
+}
+
+void Table::write_members_type(osmium::RelationMemberList const &members)
+{
+    // The binary format is not supported for this type, this is checked
+    // when setting up the columns.
+    assert(!m_binary);
+    add_members_type(m_buffer, members);
+}
+
+namespace {
+
+osmium::Location node_location(osmium::OSMObject const &object) noexcept
+{
+    if (object.type() != osmium::item_type::node) {
+        return osmium::Location{};
+    }
+    return static_cast<osmium::Node const &>(object).location();
+}
+
+inline unsigned int lon2x(double lon) noexcept
+{
+    return static_cast<unsigned int>(
+        std::round((lon + 180.0) * 65535.0 / 360.0));
+}
+
+inline unsigned int lat2y(double lat) noexcept
+{
+    return static_cast<unsigned int>(
+        std::round((lat + 90.0) * 65535.0 / 180.0));
+}
+
+// NOLINTNEXTLINE(bugprone-easily-swappable-parameters)
+inline unsigned int xy2tile(unsigned int x, unsigned int y) noexcept
+{
+    unsigned int tile = 0;
+
+    for (int i = 15; i >= 0; --i) {
+        tile = (tile << 1U) | ((x >> static_cast<unsigned int>(i)) & 1U);
+        tile = (tile << 1U) | ((y >> static_cast<unsigned int>(i)) & 1U);
+    }
+
+    return tile;
+}
+
+inline unsigned int quadtile(osmium::Location const location) noexcept
+{
+    return xy2tile(lon2x(location.lon()), lat2y(location.lat()));
+}
+
+} // anonymous namespace
+
+namespace {
+
+// Shard for a quadtile if the output is split into count shards. The high
+// bits of the tile select the shard, so each shard gets a compact area.
+std::size_t tile_shard(unsigned int tile, std::size_t count) noexcept
+{
+    return static_cast<std::size_t>(
+        (static_cast<std::uint64_t>(tile) * count) >> 32U);
+}
+
+// Location used for sharding by tile: Nodes by their location, ways by the
+// location of their first node (if locations are available). Everything
+// else is sharded by id.
+osmium::Location shard_location(osmium::OSMObject const &object) noexcept
+{
+    if (object.type() == osmium::item_type::way) {
+        auto const &nodes = static_cast<osmium::Way const &>(object).nodes();
+        return nodes.empty() ? osmium::Location{} : nodes.front().location();
+    }
+    return node_location(object);
+}
+
+// Smallest quadtile in shard n, the inverse of tile_shard().
+std::uint64_t tile_shard_start(std::size_t n, std::size_t count) noexcept
+{
+    return ((static_cast<std::uint64_t>(n) << 32U) + count - 1) / count;
+}
+
+} // anonymous namespace
+
+std::size_t Table::shard_count() const noexcept
+{
+    if (opts.shard_by == shard_method::objtype) {
+        return 3;
+    }
+
+    // With partitions by tile there is an extra partition for the rows
+    // without tile.
+    if (opts.partition && opts.shard_by == shard_method::tile) {
+        return opts.shards + 1;
+    }
+
+    return opts.shards;
+}
+
+std::size_t Table::shard_for_id(std::uint64_t const id) const noexcept
+{
+    auto const count = m_shards.size();
+    if (opts.shard_by == shard_method::range) {
+        return static_cast<std::size_t>(
+            std::min<std::uint64_t>(id / opts.shard_range, count - 1));
+    }
+
+    // Fibonacci hashing spreads ids evenly even if they are consecutive.
+    return static_cast<std::size_t>(((id * 0x9e3779b97f4a7c15ULL) >> 32U) %
+                                    count);
+}
+
+void Table::select_shard_for(osmium::OSMObject const &object)
+{
+    if (m_shards.empty()) {
+        return;
+    }
+
+    switch (opts.shard_by) {
+    case shard_method::objtype:
+        select_shard(osmium::item_type_to_nwr_index(object.type()));
         return;
+    case shard_method::range:
+        // Negative ids go into the first shard.
+        select_shard(shard_for_id(
+            object.id() < 0 ? 0 : static_cast<std::uint64_t>(object.id())));
+        return;
+    case shard_method::tile:
+        if (opts.partition) {
+            // Partitions must match the tile column exactly, rows where it
+            // is NULL go into the last (default) partition.
+            auto const location = node_location(object);
+            select_shard(location ? tile_shard(quadtile(location), opts.shards)
+                                  : opts.shards);
+            return;
+        }
+        if (auto const location = shard_location(object); location.valid()) {
+            select_shard(tile_shard(quadtile(location), m_shards.size()));
+            return;
+        }
+        break;
+    case shard_method::hash:
+        break;
     }
 
-    auto const location = static_cast<osmium::Node const &>(object).location();
-    std::format_to(std::back_inserter(buffer), "{}",
-                   std::forward<TFunc>(func)(location));
+    select_shard(shard_for_id(object.positive_id()));
 }
 
-inline unsigned int lon2x(double lon) noexcept
-{
-    return static_cast<unsigned int>(
-        std::round((lon + 180.0) * 65535.0 / 360.0));
+void Table::select_shard_for(osmium::Changeset const &changeset)
+{
+    if (m_shards.empty()) {
+        return;
+    }
+
+    // The tile column of changesets is always NULL, so with partitions by
+    // tile they go into the last (default) partition.
+    if (opts.partition && opts.shard_by == shard_method::tile) {
+        select_shard(opts.shards);
+        return;
+    }
+
+    select_shard(opts.shard_by == shard_method::objtype
+                     ? 0
+                     : shard_for_id(changeset.id()));
+}
+
+namespace {
+
+osmium::Location box_center(osmium::Box const &box) noexcept
+{
+    if (!box.valid()) {
+        return osmium::Location{};
+    }
+    auto const center = [](std::int32_t a, std::int32_t b) {
+        return static_cast<std::int32_t>(
+            (static_cast<std::int64_t>(a) + b) / 2);
+    };
+    return osmium::Location{center(box.bottom_left().x(), box.top_right().x()),
+                            center(box.bottom_left().y(), box.top_right().y())};
+}
+
+// Location rows are sorted by: Nodes by their location, ways and areas by
+// the center of their bounding box. Invalid for everything else.
+osmium::Location sort_location(osmium::OSMObject const &object) noexcept
+{
+    switch (object.type()) {
+    case osmium::item_type::node:
+        return static_cast<osmium::Node const &>(object).location();
+    case osmium::item_type::way:
+        return box_center(
+            static_cast<osmium::Way const &>(object).nodes().envelope());
+    case osmium::item_type::area: {
+        osmium::Box box;
+        for (auto const &ring :
+             static_cast<osmium::Area const &>(object).outer_rings()) {
+            box.extend(ring.envelope());
+        }
+        return box_center(box);
+    }
+    default:
+        break;
+    }
+    return osmium::Location{};
+}
+
+ExternalSorter::key_type
+location_sort_key(osmium::Location const location) noexcept
+{
+    if (!location.valid()) {
+        // Objects without location go to the end.
+        constexpr auto max = std::numeric_limits<std::uint64_t>::max();
+        return {max, max};
+    }
+
+    if (opts.sort_by == sort_method::tile) {
+        return {quadtile(location), 0};
+    }
+
+    // Shift the coordinates into the unsigned range.
+    return {hilbert_index(static_cast<std::uint32_t>(
+                              static_cast<std::int64_t>(location.x()) +
+                              1800000000),
+                          static_cast<std::uint32_t>(
+                              static_cast<std::int64_t>(location.y()) +
+                              900000000)),
+            0};
+}
+
+// Sort key for the usual order of OSM files: by type, id, and version. Ids
+// are shifted so that negative ids come before positive ones.
+ExternalSorter::key_type id_sort_key(osmium::OSMObject const &object) noexcept
+{
+    constexpr unsigned int id_bits = 60;
+    std::uint64_t const type =
+        object.type() == osmium::item_type::area
+            ? 3
+            : osmium::item_type_to_nwr_index(object.type());
+    std::uint64_t const id =
+        (static_cast<std::uint64_t>(object.id()) + (1ULL << (id_bits - 1))) &
+        ((1ULL << id_bits) - 1);
+    return {(type << id_bits) | id, object.version()};
+}
+
+} // anonymous namespace
+
+void Table::set_sort_key(osmium::OSMObject const &object)
+{
+    if (!m_sorter) {
+        return;
+    }
+
+    switch (opts.sort_by) {
+    case sort_method::id:
+        m_sort_key = id_sort_key(object);
+        break;
+    case sort_method::changeset:
+        m_sort_key = {object.changeset(), 0};
+        break;
+    default:
+        m_sort_key = location_sort_key(sort_location(object));
+        break;
+    }
+}
+
+void Table::set_sort_key(osmium::Changeset const &changeset)
+{
+    if (!m_sorter) {
+        return;
+    }
+
+    if (opts.sort_by == sort_method::id ||
+        opts.sort_by == sort_method::changeset) {
+        m_sort_key = {changeset.id(), 0};
+    } else {
+        m_sort_key = location_sort_key(box_center(changeset.bounds()));
+    }
+}
+
+std::string Table::partition_name(std::size_t n) const
+{
+    return m_name + "_" + std::to_string(n);
+}
+
+std::string Table::sql_partitions() const
+{
+    std::string sql;
+
+    auto const count = shard_count();
+    for (std::size_t n = 0; n < count; ++n) {
+        std::string bounds;
+        switch (opts.shard_by) {
+        case shard_method::objtype:
+            bounds = std::format("FOR VALUES IN ('{}')", "nwr"[n]);
+            break;
+        case shard_method::range:
+            bounds = std::format(
+                "FOR VALUES FROM ({}) TO ({})",
+                n == 0 ? "MINVALUE" : std::to_string(n * opts.shard_range),
+                n + 1 == count ? "MAXVALUE"
+                               : std::to_string((n + 1) * opts.shard_range));
+            break;
+        case shard_method::tile:
+            if (n == opts.shards) {
+                bounds = "DEFAULT";
+                break;
+            }
+            bounds = std::format(
+                "FOR VALUES FROM ({}) TO ({})",
+                n == 0 ? "MINVALUE"
+                       : std::to_string(tile_shard_start(n, opts.shards)),
+                n + 1 == opts.shards
+                    ? "MAXVALUE"
+                    : std::to_string(tile_shard_start(n + 1, opts.shards)));
+            break;
+        case shard_method::hash:
+            // Rejected when parsing the options, the hash function of
+            // PostgreSQL is different.
+            assert(false);
+            break;
+        }
+        sql += std::format("CREATE TABLE \"{}\" PARTITION OF \"{}\" {};\n",
+                           partition_name(n), m_name, bounds);
+    }
+    sql += '\n';
+
+    return sql;
 }
 
-inline unsigned int lat2y(double lat) noexcept
+bool Table::write_object_column(column_type const format,
+                                osmium::OSMObject const &object,
+                                osmium::Timestamp const next_version_timestamp)
 {
-    return static_cast<unsigned int>(
-        std::round((lat + 90.0) * 65535.0 / 180.0));
+    switch (format) {
+    case column_type::objtype:
+        write_char(osmium::item_type_to_char(object.type()));
+        break;
+    case column_type::id:
+        write_int(object.id());
+        break;
+    case column_type::version:
+        write_int(object.version());
+        break;
+    case column_type::deleted:
+        write_bool(object.deleted());
+        break;
+    case column_type::visible:
+        write_bool(object.visible());
+        break;
+    case column_type::changeset:
+        write_int(object.changeset());
+        break;
+    case column_type::timestamp_iso:
+        write_timestamp(object.timestamp());
+        break;
+    case column_type::timestamp_sec:
+        write_int(object.timestamp().seconds_since_epoch());
+        break;
+    case column_type::timestamp_range:
+        write_timestamp_range(object.timestamp(), next_version_timestamp);
+        break;
+    case column_type::uid:
+        write_int(object.uid());
+        break;
+    case column_type::user:
+        write_text(object.user());
+        break;
+    case column_type::lon_real:
+        if (auto const location = node_location(object)) {
+            write_coordinate(location.x());
+        } else {
+            write_null();
+        }
+        break;
+    case column_type::lon_int:
+        if (auto const location = node_location(object)) {
+            write_int(location.x());
+        } else {
+            write_null();
+        }
+        break;
+    case column_type::lat_real:
+        if (auto const location = node_location(object)) {
+            write_coordinate(location.y());
+        } else {
+            write_null();
+        }
+        break;
+    case column_type::lat_int:
+        if (auto const location = node_location(object)) {
+            write_int(location.y());
+        } else {
+            write_null();
+        }
+        break;
+    default:
+        return false;
+    }
+    return true;
 }
 
-// NOLINTNEXTLINE(bugprone-easily-swappable-parameters)
-inline unsigned int xy2tile(unsigned int x, unsigned int y) noexcept
+void Table::format_object_prefix(osmium::OSMObject const &object,
+                                 osmium::Timestamp const next_version_timestamp)
 {
-    unsigned int tile = 0;
+    m_prefix.clear();
+    if (m_prefix_columns == 0) {
+        return;
+    }
 
-    for (int i = 15; i >= 0; --i) {
-        tile = (tile << 1U) | ((x >> static_cast<unsigned int>(i)) & 1U);
-        tile = (tile << 1U) | ((y >> static_cast<unsigned int>(i)) & 1U);
+    // Use the usual functions to write into the prefix instead of the buffer.
+    std::swap(m_buffer, m_prefix);
+    for (std::size_t i = 0; i < m_prefix_columns; ++i) {
+        start_column();
+        write_object_column(m_columns[i].format, object,
+                            next_version_timestamp);
     }
+    std::swap(m_buffer, m_prefix);
 
-    return tile;
+    // In the binary format the length of the last column is only filled in
+    // when the next column starts, so remember where it is.
+    m_prefix_column_start = m_column_start;
+    m_prefix_column_null = m_column_null;
+    m_delimiter = false;
 }
 
-inline unsigned int quadtile(osmium::Location const location) noexcept
+void Table::write_object_prefix()
 {
-    return xy2tile(lon2x(location.lon()), lat2y(location.lat()));
-}
+    if (m_prefix_columns == 0) {
+        return;
+    }
 
-} // anonymous namespace
+    m_column_start = m_buffer.size() + m_prefix_column_start;
+    m_column_null = m_prefix_column_null;
+    m_column_index = m_prefix_columns;
+    m_delimiter = true;
+    m_buffer.append(m_prefix);
+}
 
 void ObjectsTable::add_row(osmium::OSMObject const &object,
                            osmium::Timestamp const next_version_timestamp)
@@ -412,360 +1430,263 @@ void ObjectsTable::add_row(osmium::OSMObject const &object,
     for (auto const &column : m_columns) {
         start_column();
         switch (column.format) {
-        case column_type::objtype:
-            std::format_to(std::back_inserter(m_buffer), "{}", object.type());
-            break;
-        case column_type::id:
-            std::format_to(std::back_inserter(m_buffer), "{}", object.id());
-            break;
         case column_type::orig_id:
             if (object.type() == osmium::item_type::area) {
-                std::format_to(
-                    std::back_inserter(m_buffer), "{}",
-                    static_cast<osmium::Area const &>(object).orig_id());
+                write_int(static_cast<osmium::Area const &>(object).orig_id());
             } else {
-                add_null(m_buffer);
+                write_null();
             }
             break;
         case column_type::orig_type:
             if (object.type() == osmium::item_type::area) {
-                add_bool(m_buffer,
-                         static_cast<osmium::Area const &>(object).from_way(),
-                         'w', 'r');
+                write_char(
+                    static_cast<osmium::Area const &>(object).from_way() ? 'w'
+                                                                         : 'r');
             } else {
-                add_null(m_buffer);
+                write_null();
             }
             break;
-        case column_type::version:
-            std::format_to(std::back_inserter(m_buffer), "{}",
-                           object.version());
-            break;
-        case column_type::deleted:
-            add_bool(m_buffer, object.deleted());
-            break;
-        case column_type::visible:
-            add_bool(m_buffer, object.visible());
-            break;
-        case column_type::changeset:
-            std::format_to(std::back_inserter(m_buffer), "{}",
-                           object.changeset());
-            break;
-        case column_type::timestamp_iso:
-            std::format_to(std::back_inserter(m_buffer), "{}",
-                           object.timestamp().to_iso());
-            break;
-        case column_type::timestamp_sec:
-            std::format_to(std::back_inserter(m_buffer), "{}",
-                           object.timestamp().seconds_since_epoch());
-            break;
-        case column_type::timestamp_range:
-            std::format_to(
-                std::back_inserter(m_buffer), "{}",
-                timestamp_range{object.timestamp(), next_version_timestamp});
-            break;
-        case column_type::uid:
-            std::format_to(std::back_inserter(m_buffer), "{}", object.uid());
-            break;
-        case column_type::user:
-            append_pg_escaped(m_buffer, object.user());
-            break;
         case column_type::tags_jsonb:
             /* fallthrough */
         case column_type::tags_json:
-            add_tags_json(m_buffer, object.tags());
+            write_tags_json(object.tags());
             break;
         case column_type::tags_hstore:
-            add_tags_hstore(m_buffer, object.tags());
-            break;
-        case column_type::lon_real:
-            append_coordinate(object, m_buffer,
-                              [](osmium::Location location) -> std::string {
-                                  return std::to_string(location.lon());
-                              });
-            break;
-        case column_type::lon_int:
-            append_coordinate(object, m_buffer,
-                              [](osmium::Location location) -> std::string {
-                                  return std::to_string(location.x());
-                              });
-            break;
-        case column_type::lat_real:
-            append_coordinate(object, m_buffer,
-                              [](osmium::Location location) -> std::string {
-                                  return std::to_string(location.lat());
-                              });
-            break;
-        case column_type::lat_int:
-            append_coordinate(object, m_buffer,
-                              [](osmium::Location location) -> std::string {
-                                  return std::to_string(location.y());
-                              });
+            write_tags_hstore(object.tags());
             break;
         case column_type::quadtile:
-            append_coordinate(object, m_buffer,
-                              [](osmium::Location location) -> std::string {
-                                  return std::to_string(quadtile(location));
-                              });
+            if (auto const location = node_location(object)) {
+                write_int(quadtile(location));
+            } else {
+                write_null();
+            }
             break;
         case column_type::nodes_array:
             if (object.type() == osmium::item_type::way) {
-                add_way_nodes_array(
-                    m_buffer, static_cast<osmium::Way const &>(object).nodes());
+                write_nodes_array(
+                    static_cast<osmium::Way const &>(object).nodes());
             } else {
-                add_null(m_buffer);
+                write_null();
             }
             break;
         case column_type::members_jsonb:
             /* fallthrough */
         case column_type::members_json:
             if (object.type() == osmium::item_type::relation) {
-                add_members_json(
-                    m_buffer,
+                write_members_json(
                     static_cast<osmium::Relation const &>(object).members());
             } else {
-                add_null(m_buffer);
+                write_null();
             }
             break;
         case column_type::members_type:
             if (object.type() == osmium::item_type::relation) {
-                add_members_type(
-                    m_buffer,
+                write_members_type(
                     static_cast<osmium::Relation const &>(object).members());
             } else {
-                add_null(m_buffer);
+                write_null();
             }
             break;
         case column_type::geometry:
             /* fallthrough */
         case column_type::geometry_point:
-            if (object.type() == osmium::item_type::node &&
-                static_cast<osmium::Node const &>(object).location()) {
-                std::format_to(std::back_inserter(m_buffer), "{}",
-                               m_factory.create_point(
-                                   static_cast<osmium::Node const &>(object)));
+            if (node_location(object)) {
+                write_geometry(m_factory.create_point(
+                    static_cast<osmium::Node const &>(object)));
             } else {
-                add_null(m_buffer);
+                write_null();
             }
             break;
         case column_type::geometry_linestring:
             if (object.type() == osmium::item_type::way) {
                 try {
-                    m_buffer.append(m_factory.create_linestring(
+                    write_geometry(m_factory.create_linestring(
                         static_cast<osmium::Way const &>(object)));
                 } catch (osmium::geometry_error const &) {
-                    add_null(m_buffer);
+                    write_null();
+                } catch (osmium::invalid_location const &) {
+                    // Nodes can be missing in history data
+                    write_null();
                 }
             } else {
-                add_null(m_buffer);
+                write_null();
             }
             break;
         case column_type::geometry_polygon:
             if (object.type() == osmium::item_type::area) {
                 try {
-                    m_buffer.append(m_factory.create_multipolygon(
+                    write_geometry(m_factory.create_multipolygon(
                         static_cast<osmium::Area const &>(object)));
                 } catch (osmium::geometry_error const &) {
-                    add_null(m_buffer);
+                    write_null();
                 }
             } else {
-                add_null(m_buffer);
+                write_null();
             }
             break;
         case column_type::redaction:
-            add_null(m_buffer);
+            write_null();
             break;
         default:
+            write_object_column(column.format, object, next_version_timestamp);
             break;
         }
     }
     end_row();
 }
 
-void TagsTable::add_row(osmium::OSMObject const &object,
-                        osmium::Timestamp const next_version_timestamp)
+TagsTable::TagsTable(std::string const &filename,
+                     stream_config_type const &stream_config,
+                     std::string const &columns_string)
+: Table(filename, stream_config, columns_string),
+  m_add_rows(&TagsTable::add_rows_generic)
+{
+    if (has_child_columns<column_type::tag_key, column_type::tag_value>()) {
+        m_add_rows =
+            &TagsTable::add_rows<column_type::tag_key, column_type::tag_value>;
+    }
+}
+
+void TagsTable::write_tag_column(column_type const format,
+                                 osmium::Tag const &tag, std::int64_t const n,
+                                 osmium::OSMObject const &object,
+                                 osmium::Timestamp const next_version_timestamp)
 {
-    std::size_t n = 0;
+    switch (format) {
+    case column_type::tag_seq:
+        write_int(n);
+        break;
+    case column_type::tag_key:
+        write_text(tag.key());
+        break;
+    case column_type::tag_value:
+        write_text(tag.value());
+        break;
+    case column_type::tag_kv:
+        write_text(tag.key());
+        write_char('=');
+        write_text(tag.value());
+        break;
+    default:
+        write_object_column(format, object, next_version_timestamp);
+        break;
+    }
+}
+
+template <column_type... Formats>
+void TagsTable::add_rows(osmium::OSMObject const &object,
+                         osmium::Timestamp const next_version_timestamp)
+{
+    format_object_prefix(object, next_version_timestamp);
+    std::int64_t n = 0;
     for (auto const &tag : object.tags()) {
-        for (auto const &column : m_columns) {
+        write_object_prefix();
+        ((start_column(),
+          write_tag_column(Formats, tag, n, object, next_version_timestamp)),
+         ...);
+        end_row();
+        ++n;
+    }
+}
+
+void TagsTable::add_rows_generic(osmium::OSMObject const &object,
+                                 osmium::Timestamp const next_version_timestamp)
+{
+    format_object_prefix(object, next_version_timestamp);
+    std::int64_t n = 0;
+    for (auto const &tag : object.tags()) {
+        write_object_prefix();
+        for (auto i = m_prefix_columns; i < m_columns.size(); ++i) {
             start_column();
-            switch (column.format) {
-            case column_type::objtype:
-                std::format_to(std::back_inserter(m_buffer), "{}",
-                               object.type());
-                break;
-            case column_type::id:
-                std::format_to(std::back_inserter(m_buffer), "{}", object.id());
-                break;
-            case column_type::version:
-                std::format_to(std::back_inserter(m_buffer), "{}",
-                               object.version());
-                break;
-            case column_type::deleted:
-                add_bool(m_buffer, object.deleted());
-                break;
-            case column_type::visible:
-                add_bool(m_buffer, object.visible());
-                break;
-            case column_type::changeset:
-                std::format_to(std::back_inserter(m_buffer), "{}",
-                               object.changeset());
-                break;
-            case column_type::timestamp_iso:
-                std::format_to(std::back_inserter(m_buffer), "{}",
-                               object.timestamp().to_iso());
-                break;
-            case column_type::timestamp_sec:
-                std::format_to(std::back_inserter(m_buffer), "{}",
-                               object.timestamp().seconds_since_epoch());
-                break;
-            case column_type::timestamp_range:
-                std::format_to(std::back_inserter(m_buffer), "{}",
-                               timestamp_range{object.timestamp(),
-                                               next_version_timestamp});
-                break;
-            case column_type::uid:
-                std::format_to(std::back_inserter(m_buffer), "{}",
-                               object.uid());
-                break;
-            case column_type::user:
-                append_pg_escaped(m_buffer, object.user());
-                break;
-            case column_type::tag_seq:
-                std::format_to(std::back_inserter(m_buffer), "{}", n);
-                break;
-            case column_type::tag_key:
-                append_pg_escaped(m_buffer, tag.key());
-                break;
-            case column_type::tag_value:
-                append_pg_escaped(m_buffer, tag.value());
-                break;
-            case column_type::tag_kv:
-                append_pg_escaped(m_buffer, tag.key());
-                add_char(m_buffer, '=');
-                append_pg_escaped(m_buffer, tag.value());
-                break;
-            case column_type::lon_real:
-                append_coordinate(object, m_buffer,
-                                  [](osmium::Location location) -> std::string {
-                                      return std::to_string(location.lon());
-                                  });
-                break;
-            case column_type::lon_int:
-                append_coordinate(object, m_buffer,
-                                  [](osmium::Location location) -> std::string {
-                                      return std::to_string(location.x());
-                                  });
-                break;
-            case column_type::lat_real:
-                append_coordinate(object, m_buffer,
-                                  [](osmium::Location location) -> std::string {
-                                      return std::to_string(location.lat());
-                                  });
-                break;
-            case column_type::lat_int:
-                append_coordinate(object, m_buffer,
-                                  [](osmium::Location location) -> std::string {
-                                      return std::to_string(location.y());
-                                  });
-                break;
-            default:
-                break;
-            }
+            write_tag_column(m_columns[i].format, tag, n, object,
+                             next_version_timestamp);
         }
         end_row();
         ++n;
     }
 }
 
-void WayNodesTable::add_row(osmium::OSMObject const &object,
-                            osmium::Timestamp const next_version_timestamp)
+void TagsTable::add_row(osmium::OSMObject const &object,
+                        osmium::Timestamp const next_version_timestamp)
 {
-    assert(object.type() == osmium::item_type::way);
-    std::size_t n = 0;
-    for (auto const &nr : static_cast<osmium::Way const &>(object).nodes()) {
-        for (auto const &column : m_columns) {
+    if (!object.tags().empty()) {
+        (this->*m_add_rows)(object, next_version_timestamp);
+    }
+}
+
+WayNodesTable::WayNodesTable(std::string const &filename,
+                             stream_config_type const &stream_config,
+                             std::string const &columns_string)
+: Table(filename, stream_config, columns_string),
+  m_add_rows(&WayNodesTable::add_rows_generic)
+{
+    if (has_child_columns<column_type::node_seq, column_type::node_ref>()) {
+        m_add_rows = &WayNodesTable::add_rows<column_type::node_seq,
+                                              column_type::node_ref>;
+    }
+}
+
+void WayNodesTable::write_node_column(
+    column_type const format, osmium::NodeRef const &nr, std::int64_t const n,
+    osmium::OSMObject const &object,
+    osmium::Timestamp const next_version_timestamp)
+{
+    switch (format) {
+    case column_type::node_seq:
+        write_int(n);
+        break;
+    case column_type::node_ref:
+        write_int(nr.ref());
+        break;
+    default:
+        write_object_column(format, object, next_version_timestamp);
+        break;
+    }
+}
+
+template <column_type... Formats>
+void WayNodesTable::add_rows(osmium::Way const &way,
+                             osmium::Timestamp const next_version_timestamp)
+{
+    format_object_prefix(way, next_version_timestamp);
+    std::int64_t n = 0;
+    for (auto const &nr : way.nodes()) {
+        write_object_prefix();
+        ((start_column(),
+          write_node_column(Formats, nr, n, way, next_version_timestamp)),
+         ...);
+        end_row();
+        ++n;
+    }
+}
+
+void WayNodesTable::add_rows_generic(
+    osmium::Way const &way, osmium::Timestamp const next_version_timestamp)
+{
+    format_object_prefix(way, next_version_timestamp);
+    std::int64_t n = 0;
+    for (auto const &nr : way.nodes()) {
+        write_object_prefix();
+        for (auto i = m_prefix_columns; i < m_columns.size(); ++i) {
             start_column();
-            switch (column.format) {
-            case column_type::objtype:
-                std::format_to(std::back_inserter(m_buffer), "{}",
-                               object.type());
-                break;
-            case column_type::id:
-                std::format_to(std::back_inserter(m_buffer), "{}", object.id());
-                break;
-            case column_type::version:
-                std::format_to(std::back_inserter(m_buffer), "{}",
-                               object.version());
-                break;
-            case column_type::deleted:
-                add_bool(m_buffer, object.deleted());
-                break;
-            case column_type::visible:
-                add_bool(m_buffer, object.visible());
-                break;
-            case column_type::changeset:
-                std::format_to(std::back_inserter(m_buffer), "{}",
-                               object.changeset());
-                break;
-            case column_type::timestamp_iso:
-                std::format_to(std::back_inserter(m_buffer), "{}",
-                               object.timestamp().to_iso());
-                break;
-            case column_type::timestamp_sec:
-                std::format_to(std::back_inserter(m_buffer), "{}",
-                               object.timestamp().seconds_since_epoch());
-                break;
-            case column_type::timestamp_range:
-                std::format_to(std::back_inserter(m_buffer), "{}",
-                               timestamp_range{object.timestamp(),
-                                               next_version_timestamp});
-                break;
-            case column_type::uid:
-                std::format_to(std::back_inserter(m_buffer), "{}",
-                               object.uid());
-                break;
-            case column_type::user:
-                append_pg_escaped(m_buffer, object.user());
-                break;
-            case column_type::lon_real:
-                append_coordinate(object, m_buffer,
-                                  [](osmium::Location location) -> std::string {
-                                      return std::to_string(location.lon());
-                                  });
-                break;
-            case column_type::lon_int:
-                append_coordinate(object, m_buffer,
-                                  [](osmium::Location location) -> std::string {
-                                      return std::to_string(location.x());
-                                  });
-                break;
-            case column_type::lat_real:
-                append_coordinate(object, m_buffer,
-                                  [](osmium::Location location) -> std::string {
-                                      return std::to_string(location.lat());
-                                  });
-                break;
-            case column_type::lat_int:
-                append_coordinate(object, m_buffer,
-                                  [](osmium::Location location) -> std::string {
-                                      return std::to_string(location.y());
-                                  });
-                break;
-            case column_type::node_seq:
-                std::format_to(std::back_inserter(m_buffer), "{}", n);
-                break;
-            case column_type::node_ref:
-                std::format_to(std::back_inserter(m_buffer), "{}", nr.ref());
-                break;
-            default:
-                break;
-            }
+            write_node_column(m_columns[i].format, nr, n, way,
+                              next_version_timestamp);
         }
         end_row();
         ++n;
     }
 }
 
+void WayNodesTable::add_row(osmium::OSMObject const &object,
+                            osmium::Timestamp const next_version_timestamp)
+{
+    assert(object.type() == osmium::item_type::way);
+    auto const &way = static_cast<osmium::Way const &>(object);
+    if (!way.nodes().empty()) {
+        (this->*m_add_rows)(way, next_version_timestamp);
+    }
+}
+
 namespace {
 
 char const *item_type_to_enum(osmium::item_type const type) noexcept
@@ -785,111 +1706,96 @@ char const *item_type_to_enum(osmium::item_type const type) noexcept
 
 } // anonymous namespace
 
-void MembersTable::add_row(osmium::OSMObject const &object,
-                           osmium::Timestamp const next_version_timestamp)
+MembersTable::MembersTable(std::string const &filename,
+                           stream_config_type const &stream_config,
+                           std::string const &columns_string)
+: Table(filename, stream_config, columns_string),
+  m_add_rows(&MembersTable::add_rows_generic)
 {
-    assert(object.type() == osmium::item_type::relation);
-    std::size_t n = 0;
-    for (auto const &member :
-         static_cast<osmium::Relation const &>(object).members()) {
-        for (auto const &column : m_columns) {
+    if (has_child_columns<column_type::member_seq,
+                          column_type::member_type_char,
+                          column_type::member_ref,
+                          column_type::member_role>()) {
+        m_add_rows = &MembersTable::add_rows<
+            column_type::member_seq, column_type::member_type_char,
+            column_type::member_ref, column_type::member_role>;
+    }
+}
+
+void MembersTable::write_member_column(
+    column_type const format, osmium::RelationMember const &member,
+    std::int64_t const n, osmium::OSMObject const &object,
+    osmium::Timestamp const next_version_timestamp)
+{
+    switch (format) {
+    case column_type::member_seq:
+        write_int(n);
+        break;
+    case column_type::member_type_char:
+        write_char(osmium::item_type_to_char(member.type()));
+        break;
+    case column_type::member_type_enum:
+        write_text(item_type_to_enum(member.type()));
+        break;
+    case column_type::member_ref:
+        write_int(member.ref());
+        break;
+    case column_type::member_role:
+        write_text(member.role());
+        break;
+    default:
+        write_object_column(format, object, next_version_timestamp);
+        break;
+    }
+}
+
+template <column_type... Formats>
+void MembersTable::add_rows(osmium::Relation const &relation,
+                            osmium::Timestamp const next_version_timestamp)
+{
+    format_object_prefix(relation, next_version_timestamp);
+    std::int64_t n = 0;
+    for (auto const &member : relation.members()) {
+        write_object_prefix();
+        ((start_column(), write_member_column(Formats, member, n, relation,
+                                              next_version_timestamp)),
+         ...);
+        end_row();
+        ++n;
+    }
+}
+
+void MembersTable::add_rows_generic(
+    osmium::Relation const &relation,
+    osmium::Timestamp const next_version_timestamp)
+{
+    format_object_prefix(relation, next_version_timestamp);
+    std::int64_t n = 0;
+    for (auto const &member : relation.members()) {
+        write_object_prefix();
+        for (auto i = m_prefix_columns; i < m_columns.size(); ++i) {
             start_column();
-            switch (column.format) {
-            case column_type::objtype:
-                std::format_to(std::back_inserter(m_buffer), "{}",
-                               object.type());
-                break;
-            case column_type::id:
-                std::format_to(std::back_inserter(m_buffer), "{}", object.id());
-                break;
-            case column_type::version:
-                std::format_to(std::back_inserter(m_buffer), "{}",
-                               object.version());
-                break;
-            case column_type::deleted:
-                add_bool(m_buffer, object.deleted());
-                break;
-            case column_type::visible:
-                add_bool(m_buffer, object.visible());
-                break;
-            case column_type::changeset:
-                std::format_to(std::back_inserter(m_buffer), "{}",
-                               object.changeset());
-                break;
-            case column_type::timestamp_iso:
-                std::format_to(std::back_inserter(m_buffer), "{}",
-                               object.timestamp().to_iso());
-                break;
-            case column_type::timestamp_sec:
-                std::format_to(std::back_inserter(m_buffer), "{}",
-                               object.timestamp().seconds_since_epoch());
-                break;
-            case column_type::timestamp_range:
-                std::format_to(std::back_inserter(m_buffer), "{}",
-                               timestamp_range{object.timestamp(),
-                                               next_version_timestamp});
-                break;
-            case column_type::uid:
-                std::format_to(std::back_inserter(m_buffer), "{}",
-                               object.uid());
-                break;
-            case column_type::user:
-                append_pg_escaped(m_buffer, object.user());
-                break;
-            case column_type::lon_real:
-                append_coordinate(object, m_buffer,
-                                  [](osmium::Location location) -> std::string {
-                                      return std::to_string(location.lon());
-                                  });
-                break;
-            case column_type::lon_int:
-                append_coordinate(object, m_buffer,
-                                  [](osmium::Location location) -> std::string {
-                                      return std::to_string(location.x());
-                                  });
-                break;
-            case column_type::lat_real:
-                append_coordinate(object, m_buffer,
-                                  [](osmium::Location location) -> std::string {
-                                      return std::to_string(location.lat());
-                                  });
-                break;
-            case column_type::lat_int:
-                append_coordinate(object, m_buffer,
-                                  [](osmium::Location location) -> std::string {
-                                      return std::to_string(location.y());
-                                  });
-                break;
-            case column_type::member_seq:
-                std::format_to(std::back_inserter(m_buffer), "{}", n);
-                break;
-            case column_type::member_type_char:
-                std::format_to(std::back_inserter(m_buffer), "{}",
-                               member.type());
-                break;
-            case column_type::member_type_enum:
-                std::format_to(std::back_inserter(m_buffer), "{}",
-                               item_type_to_enum(member.type()));
-                break;
-            case column_type::member_ref:
-                std::format_to(std::back_inserter(m_buffer), "{}",
-                               member.ref());
-                break;
-            case column_type::member_role:
-                append_pg_escaped(m_buffer, member.role());
-                break;
-            default:
-                break;
-            }
+            write_member_column(m_columns[i].format, member, n, relation,
+                                next_version_timestamp);
         }
         end_row();
         ++n;
     }
 }
 
-std::string UsersTable::sql_primary_key() const
+void MembersTable::add_row(osmium::OSMObject const &object,
+                           osmium::Timestamp const next_version_timestamp)
+{
+    assert(object.type() == osmium::item_type::relation);
+    auto const &relation = static_cast<osmium::Relation const &>(object);
+    if (!relation.members().empty()) {
+        (this->*m_add_rows)(relation, next_version_timestamp);
+    }
+}
+
+std::string UsersTable::primary_key_columns() const
 {
-    return primary_key(name(), "uid");
+    return "uid";
 }
 
 void UsersTable::add_row(osmium::OSMObject const &object,
@@ -905,22 +1811,22 @@ void UsersTable::add_row(osmium::OSMObject const &object,
         start_column();
         switch (column.format) {
         case column_type::uid:
-            std::format_to(std::back_inserter(m_buffer), "{}", object.uid());
+            write_int(object.uid());
             break;
         case column_type::user:
-            append_pg_escaped(m_buffer, object.user());
+            write_text(object.user());
             break;
         default:
-            add_null(m_buffer);
+            write_null();
             break;
         }
     }
     end_row();
 }
 
-std::string ChangesetsTable::sql_primary_key() const
+std::string ChangesetsTable::primary_key_columns() const
 {
-    return primary_key(name(), "id");
+    return "id";
 }
 
 namespace {
@@ -953,182 +1859,172 @@ void ChangesetsTable::add_changeset_row(osmium::Changeset const &changeset)
         start_column();
         switch (column.format) {
         case column_type::changeset:
-            std::format_to(std::back_inserter(m_buffer), "{}", changeset.id());
+            write_int(changeset.id());
             break;
         case column_type::uid:
-            std::format_to(std::back_inserter(m_buffer), "{}", changeset.uid());
+            write_int(changeset.uid());
             break;
         case column_type::user:
-            append_pg_escaped(m_buffer, changeset.user());
+            write_text(changeset.user());
             break;
         case column_type::num_changes:
-            std::format_to(std::back_inserter(m_buffer), "{}",
-                           changeset.num_changes());
+            write_int(changeset.num_changes());
             break;
         case column_type::comments_count:
-            std::format_to(std::back_inserter(m_buffer), "{}",
-                           changeset.num_comments());
+            write_int(changeset.num_comments());
             break;
         case column_type::open:
-            std::format_to(std::back_inserter(m_buffer), "{}",
-                           changeset.open() ? 't' : 'f');
+            write_bool(changeset.open());
             break;
         case column_type::created_at_iso:
-            std::format_to(std::back_inserter(m_buffer), "{}",
-                           changeset.created_at().to_iso());
+            write_timestamp(changeset.created_at());
             break;
         case column_type::created_at_sec:
-            std::format_to(std::back_inserter(m_buffer), "{}",
-                           changeset.created_at().seconds_since_epoch());
+            write_int(changeset.created_at().seconds_since_epoch());
             break;
         case column_type::closed_at_iso:
             if (changeset.closed_at().valid()) {
-                std::format_to(std::back_inserter(m_buffer), "{}",
-                               changeset.closed_at().to_iso());
+                write_timestamp(changeset.closed_at());
             } else {
-                add_null(m_buffer);
+                write_null();
             }
             break;
         case column_type::closed_at_sec:
             if (changeset.closed_at().valid()) {
-                std::format_to(std::back_inserter(m_buffer), "{}",
-                               changeset.closed_at().seconds_since_epoch());
+                write_int(changeset.closed_at().seconds_since_epoch());
             } else {
-                add_null(m_buffer);
+                write_null();
             }
             break;
         case column_type::timestamp_range:
-            std::format_to(
-                std::back_inserter(m_buffer), "{}",
-                timestamp_range{changeset.created_at(), changeset.closed_at()});
+            write_timestamp_range(changeset.created_at(),
+                                  changeset.closed_at());
             break;
         case column_type::tags_jsonb:
             /* fallthrough */
         case column_type::tags_json:
-            add_tags_json(m_buffer, changeset.tags());
+            write_tags_json(changeset.tags());
             break;
         case column_type::tags_hstore:
-            add_tags_hstore(m_buffer, changeset.tags());
+            write_tags_hstore(changeset.tags());
             break;
         case column_type::lon_real:
             if (changeset.bounds().valid()) {
-                std::format_to(std::back_inserter(m_buffer), "{:.7f}",
-                               changeset.bounds().bottom_left().lon());
+                write_coordinate(changeset.bounds().bottom_left().x());
             } else {
-                add_null(m_buffer);
+                write_null();
             }
             break;
         case column_type::lon_int:
             if (changeset.bounds().valid()) {
-                std::format_to(std::back_inserter(m_buffer), "{}",
-                               changeset.bounds().bottom_left().x());
+                write_int(changeset.bounds().bottom_left().x());
             } else {
-                add_null(m_buffer);
+                write_null();
             }
             break;
         case column_type::lat_real:
             if (changeset.bounds().valid()) {
-                std::format_to(std::back_inserter(m_buffer), "{:.7f}",
-                               changeset.bounds().bottom_left().lat());
+                write_coordinate(changeset.bounds().bottom_left().y());
             } else {
-                add_null(m_buffer);
+                write_null();
             }
             break;
         case column_type::lat_int:
             if (changeset.bounds().valid()) {
-                std::format_to(std::back_inserter(m_buffer), "{}",
-                               changeset.bounds().bottom_left().y());
+                write_int(changeset.bounds().bottom_left().y());
             } else {
-                add_null(m_buffer);
+                write_null();
             }
             break;
         case column_type::max_lon_real:
             if (changeset.bounds().valid()) {
-                std::format_to(std::back_inserter(m_buffer), "{:.7f}",
-                               changeset.bounds().top_right().lon());
+                write_coordinate(changeset.bounds().top_right().x());
             } else {
-                add_null(m_buffer);
+                write_null();
             }
             break;
         case column_type::max_lon_int:
             if (changeset.bounds().valid()) {
-                std::format_to(std::back_inserter(m_buffer), "{}",
-                               changeset.bounds().top_right().x());
+                write_int(changeset.bounds().top_right().x());
             } else {
-                add_null(m_buffer);
+                write_null();
             }
             break;
         case column_type::max_lat_real:
             if (changeset.bounds().valid()) {
-                std::format_to(std::back_inserter(m_buffer), "{:.7f}",
-                               changeset.bounds().top_right().lat());
+                write_coordinate(changeset.bounds().top_right().y());
             } else {
-                add_null(m_buffer);
+                write_null();
             }
             break;
         case column_type::max_lat_int:
             if (changeset.bounds().valid()) {
-                std::format_to(std::back_inserter(m_buffer), "{}",
-                               changeset.bounds().top_right().y());
+                write_int(changeset.bounds().top_right().y());
             } else {
-                add_null(m_buffer);
+                write_null();
             }
             break;
         case column_type::bounds_box2d:
+            // There is no binary format for this type, this is checked when
+            // setting up the columns.
             if (changeset.bounds().valid()) {
                 auto const &b = changeset.bounds();
-                std::format_to(std::back_inserter(m_buffer),
-                               "BOX({:.7f} {:.7f},{:.7f} {:.7f})",
-                               b.bottom_left().lon(), b.bottom_left().lat(),
-                               b.top_right().lon(), b.top_right().lat());
+                m_buffer.append("BOX(");
+                add_coordinate(m_buffer, b.bottom_left().x());
+                add_char(m_buffer, ' ');
+                add_coordinate(m_buffer, b.bottom_left().y());
+                add_char(m_buffer, ',');
+                add_coordinate(m_buffer, b.top_right().x());
+                add_char(m_buffer, ' ');
+                add_coordinate(m_buffer, b.top_right().y());
+                add_char(m_buffer, ')');
             } else {
-                add_null(m_buffer);
+                write_null();
             }
             break;
         case column_type::bounds_polygon:
             if (changeset.bounds().valid()) {
-                m_buffer.append(format_box(changeset.bounds(), m_factory));
+                write_geometry(format_box(changeset.bounds(), m_factory));
             } else {
-                add_null(m_buffer);
+                write_null();
             }
             break;
         default:
-            add_null(m_buffer);
+            write_null();
             break;
         }
     }
     end_row();
 }
 
-std::string ChangesetTagsTable::sql_primary_key() const
+std::string ChangesetTagsTable::primary_key_columns() const
 {
-    return primary_key(name(), "id");
+    return "id";
 }
 
 void ChangesetTagsTable::add_changeset_row(osmium::Changeset const &changeset)
 {
-    std::size_t n = 0;
+    std::int64_t n = 0;
     for (auto const &tag : changeset.tags()) {
         for (auto const &column : m_columns) {
             start_column();
             switch (column.format) {
             case column_type::id:
-                std::format_to(std::back_inserter(m_buffer), "{}",
-                               changeset.id());
+                write_int(changeset.id());
                 break;
             case column_type::tag_seq:
-                std::format_to(std::back_inserter(m_buffer), "{}", n);
+                write_int(n);
                 break;
             case column_type::tag_key:
-                append_pg_escaped(m_buffer, tag.key());
+                write_text(tag.key());
                 break;
             case column_type::tag_value:
-                append_pg_escaped(m_buffer, tag.value());
+                write_text(tag.value());
                 break;
             case column_type::tag_kv:
-                append_pg_escaped(m_buffer, tag.key());
-                add_char(m_buffer, '=');
-                append_pg_escaped(m_buffer, tag.value());
+                write_text(tag.key());
+                write_char('=');
+                write_text(tag.value());
                 break;
             default:
                 break;
@@ -1139,9 +2035,9 @@ void ChangesetTagsTable::add_changeset_row(osmium::Changeset const &changeset)
     }
 }
 
-std::string ChangesetCommentsTable::sql_primary_key() const
+std::string ChangesetCommentsTable::primary_key_columns() const
 {
-    return primary_key(name(), "id");
+    return "id";
 }
 
 void ChangesetCommentsTable::add_changeset_row(
@@ -1152,26 +2048,22 @@ void ChangesetCommentsTable::add_changeset_row(
             start_column();
             switch (column.format) {
             case column_type::id:
-                std::format_to(std::back_inserter(m_buffer), "{}",
-                               changeset.id());
+                write_int(changeset.id());
                 break;
             case column_type::uid:
-                std::format_to(std::back_inserter(m_buffer), "{}",
-                               changeset.uid());
+                write_int(changeset.uid());
                 break;
             case column_type::user:
-                append_pg_escaped(m_buffer, comment.user());
+                write_text(comment.user());
                 break;
             case column_type::timestamp_iso:
-                std::format_to(std::back_inserter(m_buffer), "{}",
-                               comment.date().to_iso());
+                write_timestamp(comment.date());
                 break;
             case column_type::timestamp_sec:
-                std::format_to(std::back_inserter(m_buffer), "{}",
-                               comment.date().seconds_since_epoch());
+                write_int(comment.date().seconds_since_epoch());
                 break;
             case column_type::comment_text:
-                append_pg_escaped(m_buffer, comment.text());
+                write_text(comment.text());
                 break;
             default:
                 break;
@@ -1221,6 +2113,11 @@ std::unique_ptr<Table> new_table(std::string const &filename,
 
 } // anonymous namespace
 
+std::unique_ptr<Table> Table::create_formatter() const
+{
+    return new_table(m_filename, *m_stream_config, m_columns_string);
+}
+
 std::unique_ptr<Table> create_table(Options const &opts,
                                     std::string const &config_string)
 {
@@ -1,23 +1,26 @@
 #pragma once
 
+#include "external-sort.hpp"
 #include "formatting.hpp"
 #include "options.hpp"
+#include "sink.hpp"
+#include "stats.hpp"
 #include "util.hpp"
 
 #include <osmium/geom/wkb.hpp>
 #include <osmium/index/id_set.hpp>
 #include <osmium/osm.hpp>
 
+#include <algorithm>
+#include <array>
 #include <cassert>
-#include <fcntl.h>
+#include <cstddef>
+#include <cstdint>
 #include <format>
 #include <fstream>
 #include <memory>
 #include <string>
 #include <string_view>
-#include <sys/stat.h>
-#include <sys/types.h>
-#include <unistd.h>
 #include <utility>
 #include <vector>
 
@@ -119,6 +122,23 @@ enum sql_column_config_flags : unsigned int
     assemble_areas = 0x80
 };
 
+/// How a column is encoded in the binary COPY format.
+enum class binary_type
+{
+    unsupported,
+    text,
+    boolean,
+    int4,
+    int8,
+    float4,
+    timestamp,
+    tstzrange,
+    jsonb,
+    hstore,
+    geometry,
+    int8_array
+};
+
 struct column_config_type
 {
     char const *format_string;
@@ -126,6 +146,7 @@ struct column_config_type
     std::string sql_name;
     std::string sql_type;
     sql_column_config_flags flags;
+    binary_type binary = binary_type::unsupported;
 };
 
 class Table
@@ -137,13 +158,164 @@ class Table
     std::string m_path{};
     stream_config_type const *m_stream_config;
     sql_column_config_flags m_column_flags = none;
-    int m_fd = -1;
+    std::unique_ptr<Sink> m_sink;
+    StageStats m_write_stats;
+
+    struct shard_type
+    {
+        std::string buffer;
+        std::unique_ptr<Sink> sink;
+        std::unique_ptr<ExternalSorter> sorter;
+    };
+
+    // Output split into several files. The buffer, sink, and sorter of the
+    // current shard are in m_buffer, m_sink, and m_sorter, its entry here is
+    // empty. Empty if the output isn't split.
+    std::vector<shard_type> m_shards;
+    std::size_t m_current_shard = 0;
+
+    // Sorts the rows of the objects if sorted output was asked for. Each
+    // object's rows are handed over in possible_flush().
+    std::unique_ptr<ExternalSorter> m_sorter;
+    ExternalSorter::key_type m_sort_key;
+
+    // Update mode: keys of the objects whose rows are deleted
+    std::unique_ptr<Sink> m_delete_sink;
+    std::string m_delete_buffer;
+    std::size_t m_flush_size;
     bool m_delimiter = false;
+    bool m_binary = false;
+
+    // State of the current column for the binary format
+    std::size_t m_column_index = 0;
+    std::size_t m_column_start = 0;
+    bool m_column_null = false;
+
+    // Prefix columns formatted by format_object_prefix() and the binary
+    // column state after them
+    std::string m_prefix;
+    std::size_t m_prefix_column_start = 0;
+    bool m_prefix_column_null = false;
+
+    void finish_binary_column();
+
+    std::string shard_filename(std::size_t n) const;
+
+    void select_shard(std::size_t shard);
+
+    std::size_t shard_for_id(std::uint64_t id) const noexcept;
+
+    // Number of files the output is split into, 1 if it isn't split.
+    std::size_t shard_count() const noexcept;
+
+    std::string partition_name(std::size_t n) const;
+
+    // Prefix for the temporary files of the sorter for shard n.
+    std::string sort_filename_prefix(std::size_t n) const;
+
+    column_config_type const *find_column(column_type format) const noexcept;
+
+    // The column partitioned tables are partitioned by, nullptr if the
+    // table doesn't have it.
+    column_config_type const *partition_key() const noexcept;
+
+    // The column the rows are ordered by with the sort method from the
+    // options, nullptr for spatial sorting or if there is no such column.
+    column_config_type const *sort_column() const noexcept;
+
+    binary_type current_binary_type() const noexcept
+    {
+        assert(m_column_index > 0);
+        return m_columns[m_column_index - 1].binary;
+    }
 
 protected:
     std::vector<column_config_type> m_columns;
     std::string m_buffer;
 
+    /**
+     * Number of columns at the start of each row that only depend on the
+     * object (see write_object_column()). Tables writing several rows for
+     * each object format them only once per object.
+     */
+    std::size_t m_prefix_columns = 0;
+
+    bool binary() const noexcept { return m_binary; }
+
+    osmium::geom::out_type wkb_out_type() const noexcept
+    {
+        return m_binary ? osmium::geom::out_type::binary
+                        : osmium::geom::out_type::hex;
+    }
+
+    // Write values into the current column. In the text format these
+    // append the COPY text representation, in the binary format they append
+    // the binary representation matching the SQL type of the column.
+
+    void write_null();
+
+    void write_bool(bool value);
+
+    void write_char(char value);
+
+    void write_int(std::int64_t value);
+
+    /// Write coordinate given in osmium fixed-point format.
+    void write_coordinate(std::int32_t value);
+
+    void write_text(char const *value);
+
+    void write_timestamp(osmium::Timestamp timestamp);
+
+    void write_timestamp_range(osmium::Timestamp start,
+                               osmium::Timestamp finish);
+
+    void write_geometry(std::string const &wkb);
+
+    void write_tags_json(osmium::TagList const &tags);
+
+    void write_tags_hstore(osmium::TagList const &tags);
+
+    void write_nodes_array(osmium::WayNodeList const &nodes);
+
+    void write_members_json(osmium::RelationMemberList const &members);
+
+    void write_members_type(osmium::RelationMemberList const &members);
+
+    /**
+     * Write a column with data from the object that is the same for all
+     * tables. Returns false if the column type is not one of those.
+     */
+    bool write_object_column(column_type format,
+                             osmium::OSMObject const &object,
+                             osmium::Timestamp next_version_timestamp);
+
+    /// Format the prefix columns for all rows of this object.
+    void format_object_prefix(osmium::OSMObject const &object,
+                              osmium::Timestamp next_version_timestamp);
+
+    /**
+     * Start a row with the prefix columns formatted by the last call to
+     * format_object_prefix(). Afterwards the remaining columns are written
+     * as usual with start_column().
+     */
+    void write_object_prefix();
+
+    /// Are the columns after the prefix columns exactly these?
+    template <column_type... Formats>
+    bool has_child_columns() const noexcept
+    {
+        static constexpr std::array<column_type, sizeof...(Formats)> formats{
+            Formats...};
+        return std::equal(m_columns.begin() +
+                              static_cast<std::ptrdiff_t>(m_prefix_columns),
+                          m_columns.end(), formats.begin(), formats.end(),
+                          [](column_config_type const &column,
+                             column_type const format) {
+                              return column.format == format;
+                          });
+    }
+
 public:
     Table(std::string filename, stream_config_type const &stream_config,
           std::string columns_string);
@@ -195,17 +367,88 @@ public:
         return m_column_flags;
     }
 
+    /// Open the output. Until this is called rows are only collected.
+    void open();
+
+    /**
+     * Create a new table with the same stream and columns that isn't
+     * connected to any output. It can be used to format rows on a different
+     * thread, the rows are then moved over to this table with append_rows().
+     */
+    std::unique_ptr<Table> create_formatter() const;
+
+    /**
+     * Can rows of this table be formatted by several formatters in parallel?
+     * This is not possible if formatting a row depends on earlier rows.
+     */
+    virtual bool parallel_formatting() const noexcept
+    {
+        // The rows for each shard must stay in order and each object's rows
+        // must be handed to the sorter separately.
+        return m_shards.empty() && !m_sorter;
+    }
+
+    /// Take all rows formatted so far out of the table.
+    std::string take_rows()
+    {
+        // Keep the capacity, so the buffer doesn't have to grow again for
+        // the next chunk.
+        std::string rows;
+        rows.reserve(m_buffer.capacity());
+        std::swap(rows, m_buffer);
+        return rows;
+    }
+
+    /// Append rows formatted elsewhere.
+    void append_rows(std::string const &rows)
+    {
+        m_buffer.append(rows);
+        possible_flush();
+    }
+
     void flush();
 
+    /**
+     * Stats for handing the data to the sink. The time is spent writing or,
+     * with several buffers, waiting for a free buffer.
+     */
+    StageStats const &write_stats() const noexcept { return m_write_stats; }
+
     void possible_flush()
     {
-        if (m_buffer.size() > 1000 * 1024) {
+        if (m_sorter) {
+            if (!m_buffer.empty()) {
+                m_sorter->add(m_sort_key, m_buffer);
+                m_buffer.clear();
+            }
+            return;
+        }
+
+        // Tables without output collect all rows until taken out.
+        if (m_sink && m_buffer.size() > m_flush_size) {
             flush();
         }
     }
 
     void start_column()
     {
+        if (m_binary) {
+            if (m_delimiter) {
+                finish_binary_column();
+            } else {
+                add_int16_binary(m_buffer,
+                                 static_cast<std::int16_t>(m_columns.size()));
+                m_delimiter = true;
+                m_column_index = 0;
+            }
+            // placeholder for the length of the column data
+            m_column_start = m_buffer.size();
+            add_int32_binary(m_buffer, 0);
+            m_column_null = false;
+            ++m_column_index;
+            return;
+        }
+
         static std::string_view const tab{"\t"};
         if (m_delimiter) {
             m_buffer.append(tab.begin(), tab.end());
@@ -216,6 +459,14 @@ public:
 
     void end_row()
     {
+        if (m_binary) {
+            if (m_delimiter) {
+                finish_binary_column();
+            }
+            m_delimiter = false;
+            return;
+        }
+
         static std::string_view const newline{"\n"};
         m_buffer.append(newline.begin(), newline.end());
         m_delimiter = false;
@@ -224,24 +475,100 @@ public:
 private:
     void setup_columns();
 
+    std::string sql_create_table(bool replace_types) const;
+
+    std::string sql_copy() const;
+
+    std::string sql_update() const;
+
+    std::string sql_partitions() const;
+
+    // Does the key identifying the object of a row contain the object type?
+    bool key_has_objtype() const noexcept;
+
 public:
     void sql_data_definition() const;
 
-    virtual std::string sql_primary_key() const;
+    /**
+     * SQL creating the table when writing into the database directly. It
+     * is run for all tables on a single connection before open() is called.
+     * Types shared between tables are only created if they don't exist.
+     */
+    std::string sql_setup() const { return sql_create_table(false); }
+
+    /**
+     * SQL run after the data is loaded: ANALYZE and the primary key and
+     * indexes. In the SQL scripts the keys and indexes are commented out.
+     */
+    std::string sql_finish(bool commented) const;
+
+    /// Comma-separated list of the columns in the primary key.
+    virtual std::string primary_key_columns() const;
+
+    std::string sql_primary_key(bool commented) const;
+
+    /**
+     * Throw if this table can't be used in update mode. The rows of an
+     * object are found by its id (and type if there are several) columns.
+     */
+    void check_update() const;
+
+    /**
+     * Throw if this table can't be partitioned the way set in the options.
+     * The partitions are the shards, so each row must go into the shard
+     * matching the partition key column.
+     */
+    void check_partition() const;
+
+    /**
+     * Throw if this table can't be split the way set in the options. There
+     * is one shard per object type when splitting by type, so the table
+     * must have objects of exactly these types.
+     */
+    void check_shards() const;
+
+    /// Names of the output files, one per shard.
+    std::vector<std::string> output_filenames() const;
+
+    /**
+     * Select the shard the rows for this object go to. Must be called
+     * before add_row() if the output is split into several files.
+     */
+    void select_shard_for(osmium::OSMObject const &object);
+
+    void select_shard_for(osmium::Changeset const &changeset);
+
+    /**
+     * Set the key the rows for this object are sorted by. Must be called
+     * before add_row() if the output is sorted.
+     */
+    void set_sort_key(osmium::OSMObject const &object);
+
+    void set_sort_key(osmium::Changeset const &changeset);
+
+    /// File with the keys of the objects to delete in update mode.
+    std::string delete_filename() const;
+
+    /**
+     * Update mode: Delete all rows of this object. Written for every
+     * object in the change file, new rows are added afterwards for the
+     * objects that are not deleted.
+     */
+    void add_delete_row(osmium::OSMObject const &object);
 
 }; // class Table
 
 class ObjectsTable : public Table
 {
 
-    osmium::geom::WKBFactory<> m_factory{osmium::geom::wkb_type::ewkb,
-                                         osmium::geom::out_type::hex};
+    osmium::geom::WKBFactory<> m_factory;
 
 public:
     ObjectsTable(std::string const &filename,
                  stream_config_type const &stream_config,
                  std::string const &columns_string)
-    : Table(filename, stream_config, columns_string)
+    : Table(filename, stream_config, columns_string),
+      m_factory(osmium::geom::wkb_type::ewkb, wkb_out_type())
     {
     }
 
@@ -253,13 +580,28 @@ public:
 class TagsTable : public Table
 {
 
+    using rows_writer = void (TagsTable::*)(osmium::OSMObject const &,
+                                            osmium::Timestamp);
+
+    rows_writer m_add_rows;
+
+    void write_tag_column(column_type format, osmium::Tag const &tag,
+                          std::int64_t n, osmium::OSMObject const &object,
+                          osmium::Timestamp next_version_timestamp);
+
+    // Write the rows for an object with the columns after the prefix known
+    // at compile time.
+    template <column_type... Formats>
+    void add_rows(osmium::OSMObject const &object,
+                  osmium::Timestamp next_version_timestamp);
+
+    void add_rows_generic(osmium::OSMObject const &object,
+                          osmium::Timestamp next_version_timestamp);
+
 public:
     TagsTable(std::string const &filename,
               stream_config_type const &stream_config,
-              std::string const &columns_string)
-    : Table(filename, stream_config, columns_string)
-    {
-    }
+              std::string const &columns_string);
 
     void add_row(osmium::OSMObject const &object,
                  osmium::Timestamp const next_version_timestamp) override;
@@ -269,13 +611,26 @@ public:
 class WayNodesTable : public Table
 {
 
+    using rows_writer = void (WayNodesTable::*)(osmium::Way const &,
+                                                osmium::Timestamp);
+
+    rows_writer m_add_rows;
+
+    void write_node_column(column_type format, osmium::NodeRef const &nr,
+                           std::int64_t n, osmium::OSMObject const &object,
+                           osmium::Timestamp next_version_timestamp);
+
+    template <column_type... Formats>
+    void add_rows(osmium::Way const &way,
+                  osmium::Timestamp next_version_timestamp);
+
+    void add_rows_generic(osmium::Way const &way,
+                          osmium::Timestamp next_version_timestamp);
+
 public:
     WayNodesTable(std::string const &filename,
                   stream_config_type const &stream_config,
-                  std::string const &columns_string)
-    : Table(filename, stream_config, columns_string)
-    {
-    }
+                  std::string const &columns_string);
 
     void add_row(osmium::OSMObject const &object,
                  osmium::Timestamp const next_version_timestamp) override;
@@ -285,13 +640,27 @@ public:
 class MembersTable : public Table
 {
 
+    using rows_writer = void (MembersTable::*)(osmium::Relation const &,
+                                               osmium::Timestamp);
+
+    rows_writer m_add_rows;
+
+    void write_member_column(column_type format,
+                             osmium::RelationMember const &member,
+                             std::int64_t n, osmium::OSMObject const &object,
+                             osmium::Timestamp next_version_timestamp);
+
+    template <column_type... Formats>
+    void add_rows(osmium::Relation const &relation,
+                  osmium::Timestamp next_version_timestamp);
+
+    void add_rows_generic(osmium::Relation const &relation,
+                          osmium::Timestamp next_version_timestamp);
+
 public:
     MembersTable(std::string const &filename,
                  stream_config_type const &stream_config,
-                 std::string const &columns_string)
-    : Table(filename, stream_config, columns_string)
-    {
-    }
+                 std::string const &columns_string);
 
     void add_row(osmium::OSMObject const &object,
                  osmium::Timestamp const next_version_timestamp) override;
@@ -311,7 +680,7 @@ public:
     {
     }
 
-    std::string sql_primary_key() const override;
+    std::string primary_key_columns() const override;
 
     void add_row(osmium::OSMObject const &object,
                  osmium::Timestamp const next_version_timestamp) override;
@@ -321,23 +690,26 @@ public:
         return osmium::osm_entity_bits::nothing;
     }
 
+    // Only the first row for each user is written.
+    bool parallel_formatting() const noexcept override { return false; }
+
 }; // class UsersTable
 
 class ChangesetsTable : public Table
 {
 
-    osmium::geom::WKBFactory<> m_factory{osmium::geom::wkb_type::ewkb,
-                                         osmium::geom::out_type::hex};
+    osmium::geom::WKBFactory<> m_factory;
 
 public:
     ChangesetsTable(std::string const &filename,
                     stream_config_type const &stream_config,
                     std::string const &columns_string)
-    : Table(filename, stream_config, columns_string)
+    : Table(filename, stream_config, columns_string),
+      m_factory(osmium::geom::wkb_type::ewkb, wkb_out_type())
     {
     }
 
-    std::string sql_primary_key() const override;
+    std::string primary_key_columns() const override;
 
     void add_changeset_row(osmium::Changeset const &changeset) override;
 
@@ -354,7 +726,7 @@ public:
     {
     }
 
-    std::string sql_primary_key() const override;
+    std::string primary_key_columns() const override;
 
     void add_changeset_row(osmium::Changeset const &changeset) override;
 
@@ -371,7 +743,7 @@ public:
     {
     }
 
-    std::string sql_primary_key() const override;
+    std::string primary_key_columns() const override;
 
     void add_changeset_row(osmium::Changeset const &changeset) override;
 
@@ -0,0 +1,154 @@
+#include "tag-filter.hpp"
+
+#include <stdexcept>
+
+namespace {
+
+constexpr std::size_t node_rules = 0;
+constexpr std::size_t way_rules = 1;
+constexpr std::size_t relation_rules = 2;
+constexpr std::size_t area_rules = 3;
+constexpr std::size_t no_rules = 4;
+
+// Index into the rules for an object type.
+std::size_t rules_index(osmium::item_type type) noexcept
+{
+    switch (type) {
+    case osmium::item_type::node:
+        return node_rules;
+    case osmium::item_type::way:
+        return way_rules;
+    case osmium::item_type::relation:
+        return relation_rules;
+    case osmium::item_type::area:
+        return area_rules;
+    default:
+        break;
+    }
+    return no_rules;
+}
+
+// Index into the rules for a type letter in a filter expression.
+std::size_t rules_index(char type) noexcept
+{
+    switch (type) {
+    case 'n':
+        return node_rules;
+    case 'w':
+        return way_rules;
+    case 'r':
+        return relation_rules;
+    default:
+        break;
+    }
+    return area_rules;
+}
+
+} // anonymous namespace
+
+std::string_view TagFilter::intern(std::string_view str)
+{
+    m_strings.emplace_back(str);
+    return m_strings.back();
+}
+
+std::size_t TagFilter::key_index(std::string_view key)
+{
+    auto const it = m_keys.find(key);
+    if (it != m_keys.end()) {
+        return it->second;
+    }
+
+    auto const index = m_keys.size();
+    m_keys.emplace(intern(key), index);
+    m_first_chars.set(static_cast<unsigned char>(key.front()));
+    for (auto &rules : m_rules) {
+        rules.emplace_back();
+    }
+    return index;
+}
+
+void TagFilter::add(std::string const &expression)
+{
+    std::string_view str{expression};
+
+    std::array<bool, 4> types{true, true, true, true};
+    auto const slash = str.find('/');
+    if (slash != std::string_view::npos && slash > 0 &&
+        str.substr(0, slash).find_first_not_of("nwra") ==
+            std::string_view::npos) {
+        types = {false, false, false, false};
+        for (char const c : str.substr(0, slash)) {
+            types[rules_index(c)] = true;
+        }
+        str.remove_prefix(slash + 1);
+    }
+
+    auto const equal = str.find('=');
+    auto const key = str.substr(0, equal);
+    if (key.empty()) {
+        throw std::runtime_error{"Missing key in filter expression '" +
+                                 expression + "'"};
+    }
+
+    std::vector<std::string_view> values;
+    if (equal != std::string_view::npos) {
+        auto rest = str.substr(equal + 1);
+        while (true) {
+            auto const comma = rest.find(',');
+            auto const value = rest.substr(0, comma);
+            if (value.empty()) {
+                throw std::runtime_error{
+                    "Empty value in filter expression '" + expression + "'"};
+            }
+            values.push_back(value);
+            if (comma == std::string_view::npos) {
+                break;
+            }
+            rest.remove_prefix(comma + 1);
+        }
+    }
+
+    auto const index = key_index(key);
+    for (std::size_t n = 0; n < types.size(); ++n) {
+        if (!types[n]) {
+            continue;
+        }
+        auto &rule = m_rules[n][index];
+        if (values.empty()) {
+            rule.any_value = true;
+        }
+        for (auto const value : values) {
+            if (!rule.values.contains(value)) {
+                rule.values.insert(intern(value));
+            }
+        }
+    }
+}
+
+bool TagFilter::matches(osmium::OSMObject const &object) const noexcept
+{
+    auto const index = rules_index(object.type());
+    if (index == no_rules) {
+        return false;
+    }
+    auto const &rules = m_rules[index];
+
+    for (auto const &tag : object.tags()) {
+        char const *key = tag.key();
+        if (!m_first_chars.test(static_cast<unsigned char>(*key))) {
+            continue;
+        }
+        auto const it = m_keys.find(std::string_view{key});
+        if (it == m_keys.end()) {
+            continue;
+        }
+        auto const &rule = rules[it->second];
+        if (rule.any_value ||
+            rule.values.contains(std::string_view{tag.value()})) {
+            return true;
+        }
+    }
+
+    return false;
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <osmium/osm/object.hpp>
+
+#include <array>
+#include <bitset>
+#include <cstddef>
+#include <deque>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+/**
+ * Filter on the tags of objects. Built from expressions of the form
+ *
+ *     [TYPES/]KEY[=VALUE[,VALUE...]]
+ *
+ * where TYPES is any combination of the letters n, w, r, and a (nodes, ways,
+ * relations, areas, default is all of them). An object matches if any of
+ * the expressions for its type matches. Objects of a type without any
+ * expression never match.
+ *
+ * The expressions are compiled into hash tables: Each key is stored once
+ * and looked up with a single hash table lookup per tag of the object, the
+ * values for a key and type are in a hash set.
+ */
+class TagFilter
+{
+public:
+    /// Add an expression, throws std::runtime_error if it is invalid.
+    void add(std::string const &expression);
+
+    bool empty() const noexcept { return m_keys.empty(); }
+
+    bool matches(osmium::OSMObject const &object) const noexcept;
+
+private:
+    struct key_rule
+    {
+        bool any_value = false;
+        std::unordered_set<std::string_view> values;
+    };
+
+    // Owns the keys and values, a deque never moves its elements
+    std::deque<std::string> m_strings;
+
+    // Index of each key in the rules
+    std::unordered_map<std::string_view, std::size_t> m_keys;
+
+    // First characters of all keys, to skip most tags without a lookup
+    std::bitset<256> m_first_chars;
+
+    // Rules for each object type by key index
+    std::array<std::vector<key_rule>, 4> m_rules;
+
+    std::string_view intern(std::string_view str);
+
+    std::size_t key_index(std::string_view key);
+
+}; // class TagFilter
@@ -0,0 +1,613 @@
+#include "uring.hpp"
+
+#include <linux/io_uring.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <system_error>
+#include <unistd.h>
+#include <utility>
+
+namespace {
+
+// Alignment of buffers, offsets, and sizes needed for O_DIRECT.
+constexpr std::size_t alignment = 4096;
+
+// Number of buffers the shared writer starts with. This is also the number
+// of writes that can be in flight at the same time.
+constexpr unsigned int default_buffer_count = 32;
+
+// Every file keeps one buffer while filling it, with at least two buffers
+// per file there are always some left to be written.
+constexpr std::size_t min_buffers_per_file = 2;
+
+std::system_error system_error(char const *what)
+{
+    return std::system_error{errno, std::system_category(), what};
+}
+
+unsigned int load_acquire(unsigned int const *ptr) noexcept
+{
+    // NOLINTNEXTLINE(cppcoreguidelines-pro-type-const-cast)
+    return std::atomic_ref<unsigned int>{*const_cast<unsigned int *>(ptr)}
+        .load(std::memory_order_acquire);
+}
+
+void store_release(unsigned int *ptr, unsigned int value) noexcept
+{
+    std::atomic_ref<unsigned int>{*ptr}.store(value,
+                                              std::memory_order_release);
+}
+
+template <typename T>
+T *ring_ptr(void *base, std::uint32_t offset) noexcept
+{
+    return reinterpret_cast<T *>(static_cast<char *>(base) + offset);
+}
+
+} // anonymous namespace
+
+/**
+ * Minimal wrapper around the io_uring system calls. Only used from the
+ * thread of the UringWriter.
+ */
+class UringWriter::Ring
+{
+
+    int m_fd = -1;
+
+    void *m_sq_ring = MAP_FAILED;
+    std::size_t m_sq_ring_size = 0;
+    void *m_cq_ring = MAP_FAILED;
+    std::size_t m_cq_ring_size = 0;
+    io_uring_sqe *m_sqes = nullptr;
+    std::size_t m_sqes_size = 0;
+
+    unsigned int *m_sq_head = nullptr;
+    unsigned int *m_sq_tail = nullptr;
+    unsigned int m_sq_mask = 0;
+    unsigned int *m_sq_array = nullptr;
+    unsigned int m_sq_entries = 0;
+
+    unsigned int *m_cq_head = nullptr;
+    unsigned int *m_cq_tail = nullptr;
+    unsigned int m_cq_mask = 0;
+    io_uring_cqe *m_cqes = nullptr;
+
+    unsigned int m_to_submit = 0;
+
+    void unmap() noexcept
+    {
+        if (m_sqes) {
+            munmap(m_sqes, m_sqes_size);
+        }
+        if (m_cq_ring != MAP_FAILED && m_cq_ring != m_sq_ring) {
+            munmap(m_cq_ring, m_cq_ring_size);
+        }
+        if (m_sq_ring != MAP_FAILED) {
+            munmap(m_sq_ring, m_sq_ring_size);
+        }
+        ::close(m_fd);
+    }
+
+public:
+    explicit Ring(unsigned int entries)
+    {
+        io_uring_params params{};
+        // NOLINTNEXTLINE(cppcoreguidelines-pro-type-vararg)
+        m_fd = static_cast<int>(syscall(__NR_io_uring_setup, entries, &params));
+        if (m_fd < 0) {
+            throw system_error("io_uring_setup failed");
+        }
+
+        m_sq_entries = params.sq_entries;
+        m_sq_ring_size =
+            params.sq_off.array + (params.sq_entries * sizeof(unsigned int));
+        m_cq_ring_size =
+            params.cq_off.cqes + (params.cq_entries * sizeof(io_uring_cqe));
+
+        bool const single_mmap = params.features & IORING_FEAT_SINGLE_MMAP;
+        if (single_mmap) {
+            m_sq_ring_size = std::max(m_sq_ring_size, m_cq_ring_size);
+        }
+
+        m_sq_ring = mmap(nullptr, m_sq_ring_size, PROT_READ | PROT_WRITE,
+                         MAP_SHARED | MAP_POPULATE, m_fd, IORING_OFF_SQ_RING);
+        if (m_sq_ring == MAP_FAILED) {
+            auto const error = system_error("mmap of io_uring failed");
+            unmap();
+            throw error;
+        }
+
+        if (single_mmap) {
+            m_cq_ring = m_sq_ring;
+            m_cq_ring_size = 0;
+        } else {
+            m_cq_ring = mmap(nullptr, m_cq_ring_size, PROT_READ | PROT_WRITE,
+                             MAP_SHARED | MAP_POPULATE, m_fd,
+                             IORING_OFF_CQ_RING);
+        }
+
+        if (m_cq_ring == MAP_FAILED) {
+            auto const error = system_error("mmap of io_uring failed");
+            unmap();
+            throw error;
+        }
+
+        m_sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+        void *sqes = mmap(nullptr, m_sqes_size, PROT_READ | PROT_WRITE,
+                          MAP_SHARED | MAP_POPULATE, m_fd, IORING_OFF_SQES);
+        if (sqes == MAP_FAILED) {
+            auto const error = system_error("mmap of io_uring failed");
+            unmap();
+            throw error;
+        }
+        m_sqes = static_cast<io_uring_sqe *>(sqes);
+
+        m_sq_head = ring_ptr<unsigned int>(m_sq_ring, params.sq_off.head);
+        m_sq_tail = ring_ptr<unsigned int>(m_sq_ring, params.sq_off.tail);
+        m_sq_mask = *ring_ptr<unsigned int>(m_sq_ring, params.sq_off.ring_mask);
+        m_sq_array = ring_ptr<unsigned int>(m_sq_ring, params.sq_off.array);
+
+        m_cq_head = ring_ptr<unsigned int>(m_cq_ring, params.cq_off.head);
+        m_cq_tail = ring_ptr<unsigned int>(m_cq_ring, params.cq_off.tail);
+        m_cq_mask = *ring_ptr<unsigned int>(m_cq_ring, params.cq_off.ring_mask);
+        m_cqes = ring_ptr<io_uring_cqe>(m_cq_ring, params.cq_off.cqes);
+    }
+
+    ~Ring() { unmap(); }
+
+    Ring(Ring const &) = delete;
+    Ring &operator=(Ring const &) = delete;
+
+    Ring(Ring &&) = delete;
+    Ring &operator=(Ring &&) = delete;
+
+    unsigned int entries() const noexcept { return m_sq_entries; }
+
+    bool register_buffers(std::vector<iovec> const &iovecs) noexcept
+    {
+        // NOLINTNEXTLINE(cppcoreguidelines-pro-type-vararg)
+        return syscall(__NR_io_uring_register, m_fd, IORING_REGISTER_BUFFERS,
+                       iovecs.data(), iovecs.size()) == 0;
+    }
+
+    /// Get the next submission queue entry or nullptr if the queue is full.
+    io_uring_sqe *next_sqe() noexcept
+    {
+        auto const head = load_acquire(m_sq_head);
+        auto const tail = *m_sq_tail + m_to_submit;
+        if (tail - head >= m_sq_entries) {
+            return nullptr;
+        }
+        auto const index = tail & m_sq_mask;
+        m_sq_array[index] = index;
+        ++m_to_submit;
+        io_uring_sqe *sqe = &m_sqes[index];
+        std::memset(sqe, 0, sizeof(io_uring_sqe));
+        return sqe;
+    }
+
+    /**
+     * Submit all queued entries and wait for at least min_complete
+     * completions.
+     */
+    void submit_and_wait(unsigned int min_complete)
+    {
+        store_release(m_sq_tail, *m_sq_tail + m_to_submit);
+
+        unsigned int const flags =
+            min_complete > 0 ? IORING_ENTER_GETEVENTS : 0;
+        while (m_to_submit > 0 || min_complete > 0) {
+            // NOLINTNEXTLINE(cppcoreguidelines-pro-type-vararg)
+            auto const result = syscall(__NR_io_uring_enter, m_fd, m_to_submit,
+                                        min_complete, flags, nullptr, 0);
+            if (result < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                throw system_error("io_uring_enter failed");
+            }
+            m_to_submit -= static_cast<unsigned int>(result);
+            min_complete = 0;
+        }
+    }
+
+    /// Call func(user_data, result) for all available completions.
+    template <typename TFunc>
+    void for_each_completion(TFunc &&func)
+    {
+        auto head = *m_cq_head;
+        auto const tail = load_acquire(m_cq_tail);
+        while (head != tail) {
+            auto const &cqe = m_cqes[head & m_cq_mask];
+            std::forward<TFunc>(func)(cqe.user_data, cqe.res);
+            ++head;
+        }
+        store_release(m_cq_head, head);
+    }
+
+}; // class UringWriter::Ring
+
+UringWriter::UringWriter(std::size_t buffer_size, unsigned int buffer_count,
+                         bool direct)
+: m_ring(std::make_unique<Ring>(buffer_count)),
+  m_buffer_size((buffer_size + alignment - 1) / alignment * alignment),
+  m_buffer_count(buffer_count), m_direct(direct)
+{
+    m_memory = static_cast<char *>(
+        std::aligned_alloc(alignment, m_buffer_size * m_buffer_count));
+    if (!m_memory) {
+        throw std::bad_alloc{};
+    }
+
+    std::vector<iovec> iovecs;
+    for (unsigned int n = 0; n < m_buffer_count; ++n) {
+        m_buffers.push_back(m_memory +
+                            (static_cast<std::size_t>(n) * m_buffer_size));
+        iovecs.push_back(iovec{m_buffers.back(), m_buffer_size});
+        m_free_buffers.push_back(n);
+    }
+
+    // This can fail if the memory lock limit is too low, the buffers are
+    // then used without registering them.
+    m_registered = m_ring->register_buffers(iovecs);
+
+    m_thread = std::thread{&UringWriter::run, this};
+}
+
+UringWriter::~UringWriter()
+{
+    {
+        std::lock_guard<std::mutex> const lock{m_mutex};
+        m_stop = true;
+    }
+    m_cond.notify_all();
+    m_thread.join();
+
+    m_ring.reset();
+    for (std::size_t n = m_buffer_count; n < m_buffers.size(); ++n) {
+        std::free(m_buffers[n]); // NOLINT(cppcoreguidelines-no-malloc)
+    }
+    std::free(m_memory); // NOLINT(cppcoreguidelines-no-malloc)
+}
+
+std::shared_ptr<UringWriter> UringWriter::shared(std::size_t buffer_size,
+                                                 bool direct)
+{
+    static std::mutex mutex;
+    static std::weak_ptr<UringWriter> instance;
+
+    std::lock_guard<std::mutex> const lock{mutex};
+    auto writer = instance.lock();
+    if (!writer) {
+        try {
+            writer = std::make_shared<UringWriter>(
+                buffer_size, default_buffer_count, direct);
+        } catch (std::system_error const &) {
+            return nullptr;
+        }
+        instance = writer;
+    }
+
+    return writer;
+}
+
+void UringWriter::add_file()
+{
+    {
+        std::lock_guard<std::mutex> const lock{m_mutex};
+        ++m_files;
+        while (m_buffers.size() < m_files * min_buffers_per_file) {
+            auto *const buffer =
+                static_cast<char *>(std::aligned_alloc(alignment, m_buffer_size));
+            if (!buffer) {
+                --m_files;
+                throw std::bad_alloc{};
+            }
+            m_free_buffers.push_back(
+                static_cast<unsigned int>(m_buffers.size()));
+            m_buffers.push_back(buffer);
+        }
+    }
+    m_cond.notify_all();
+}
+
+void UringWriter::remove_file()
+{
+    std::lock_guard<std::mutex> const lock{m_mutex};
+    --m_files;
+}
+
+std::size_t UringWriter::buffer_count()
+{
+    std::lock_guard<std::mutex> const lock{m_mutex};
+    return m_buffers.size();
+}
+
+UringWriter::buffer_type UringWriter::acquire_buffer()
+{
+    std::unique_lock<std::mutex> lock{m_mutex};
+    m_cond.wait(lock, [this] { return !m_free_buffers.empty(); });
+    auto const index = m_free_buffers.back();
+    m_free_buffers.pop_back();
+    return buffer_type{index, m_buffers[index]};
+}
+
+void UringWriter::submit(file_type &file, buffer_type buffer,
+                         std::size_t size, std::uint64_t offset)
+{
+    {
+        std::lock_guard<std::mutex> const lock{m_mutex};
+        ++file.pending;
+        m_requests.push_back(
+            request_type{&file, file.fd, buffer, 0, size, offset});
+    }
+    m_cond.notify_all();
+}
+
+void UringWriter::wait(file_type &file)
+{
+    std::unique_lock<std::mutex> lock{m_mutex};
+    m_cond.wait(lock, [&file] { return file.pending == 0; });
+    if (file.error) {
+        std::rethrow_exception(std::exchange(file.error, nullptr));
+    }
+}
+
+void UringWriter::submit_requests(std::deque<request_type> &requests,
+                                  std::size_t &in_flight)
+{
+    // Only as many writes as the ring has entries are in flight, so the
+    // completion queue can't overflow.
+    while (!requests.empty() && in_flight < m_ring->entries()) {
+        if (m_use_write) {
+            write_sync(requests.front());
+            requests.pop_front();
+            continue;
+        }
+
+        io_uring_sqe *sqe = m_ring->next_sqe();
+        if (!sqe) {
+            break;
+        }
+
+        // The address of the request is the user data of the submission,
+        // it is deleted again when the completion is reaped.
+        auto *request = new request_type{requests.front()};
+        requests.pop_front();
+
+        // Only the initial buffers are registered.
+        bool const fixed =
+            m_registered && request->buffer.index < m_buffer_count;
+        sqe->opcode = fixed ? IORING_OP_WRITE_FIXED : IORING_OP_WRITE;
+        sqe->fd = request->fd;
+        sqe->off = request->file_offset;
+        sqe->addr = reinterpret_cast<std::uint64_t>(request->buffer.data +
+                                                    request->buffer_offset);
+        sqe->len = static_cast<std::uint32_t>(request->size);
+        if (fixed) {
+            sqe->buf_index = static_cast<std::uint16_t>(request->buffer.index);
+        }
+        sqe->user_data = reinterpret_cast<std::uint64_t>(request);
+
+        ++in_flight;
+    }
+}
+
+void UringWriter::write_sync(request_type const &request)
+{
+    char const *data = request.buffer.data + request.buffer_offset;
+    auto size = request.size;
+    auto offset = static_cast<off_t>(request.file_offset);
+    int error = 0;
+    while (size > 0) {
+        auto const result = ::pwrite(request.fd, data, size, offset);
+        if (result < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            error = errno;
+            break;
+        }
+        if (result == 0) {
+            error = EIO;
+            break;
+        }
+        data += result;
+        size -= static_cast<std::size_t>(result);
+        offset += result;
+    }
+
+    release(request, error);
+    m_cond.notify_all();
+}
+
+void UringWriter::complete(request_type const &request, int result,
+                           std::deque<request_type> &retries)
+{
+    if (result == -EINTR || result == -EAGAIN) {
+        retries.push_back(request);
+        return;
+    }
+
+    // Kernels before 5.6 don't know IORING_OP_WRITE(_FIXED), all writes
+    // are done with write() from now on.
+    if (result == -EINVAL && !m_use_write) {
+        m_use_write = true;
+        retries.push_back(request);
+        return;
+    }
+
+    // Retrying a write that didn't write anything would loop forever.
+    if (result == 0 && request.size > 0) {
+        release(request, EIO);
+        return;
+    }
+
+    if (result >= 0 && static_cast<std::size_t>(result) < request.size) {
+        // short write, write the rest
+        auto const written = static_cast<std::size_t>(result);
+        retries.push_back(request_type{
+            request.file, request.fd, request.buffer,
+            request.buffer_offset + written, request.size - written,
+            request.file_offset + written});
+        return;
+    }
+
+    release(request, result < 0 ? -result : 0);
+}
+
+void UringWriter::release(request_type const &request, int error)
+{
+    std::lock_guard<std::mutex> const lock{m_mutex};
+    if (error != 0 && !request.file->error) {
+        request.file->error = std::make_exception_ptr(
+            std::system_error{error, std::system_category(), "write error"});
+    }
+    m_free_buffers.push_back(request.buffer.index);
+    --request.file->pending;
+}
+
+void UringWriter::run()
+{
+    std::deque<request_type> requests;
+    std::size_t in_flight = 0;
+
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock{m_mutex};
+            if (in_flight == 0 && requests.empty()) {
+                m_cond.wait(lock,
+                            [this] { return m_stop || !m_requests.empty(); });
+                if (m_requests.empty()) {
+                    return;
+                }
+            }
+            requests.insert(requests.end(), m_requests.begin(),
+                            m_requests.end());
+            m_requests.clear();
+        }
+
+        submit_requests(requests, in_flight);
+
+        // Wait for at least one completion unless there is nothing in
+        // flight. New requests are picked up after each completion.
+        m_ring->submit_and_wait(in_flight > 0 ? 1 : 0);
+
+        bool completed = false;
+        m_ring->for_each_completion([&](std::uint64_t user_data, int result) {
+            std::unique_ptr<request_type> const request{
+                reinterpret_cast<request_type *>(user_data)};
+            complete(*request, result, requests);
+            --in_flight;
+            completed = true;
+        });
+
+        if (completed) {
+            m_cond.notify_all();
+        }
+    }
+}
+
+UringSink::UringSink(std::shared_ptr<UringWriter> writer, std::string filename)
+: m_writer(std::move(writer)), m_filename(std::move(filename))
+{
+    // NOLINTNEXTLINE(hicpp-signed-bitwise)
+    int const flags = O_WRONLY | O_CREAT | O_TRUNC;
+    if (m_writer->direct()) {
+        // NOLINTNEXTLINE(hicpp-signed-bitwise, hicpp-vararg)
+        m_file.fd = ::open(m_filename.c_str(), flags | O_DIRECT, 0666);
+    }
+    // Not all file systems support O_DIRECT, fall back to normal I/O.
+    if (m_file.fd < 0) {
+        // NOLINTNEXTLINE(hicpp-vararg)
+        m_file.fd = ::open(m_filename.c_str(), flags, 0666);
+    }
+    if (m_file.fd < 0) {
+        throw std::runtime_error{"can't open file: " + m_filename};
+    }
+
+    try {
+        m_writer->add_file();
+    } catch (...) {
+        ::close(std::exchange(m_file.fd, -1));
+        throw;
+    }
+}
+
+UringSink::~UringSink()
+{
+    try {
+        close();
+    } catch (...) {
+        // ignore exceptions in destructor
+    }
+}
+
+void UringSink::write(std::string_view data)
+{
+    auto const buffer_size = m_writer->buffer_size();
+    while (!data.empty()) {
+        if (m_fill == 0) {
+            m_buffer = m_writer->acquire_buffer();
+        }
+
+        auto const size = std::min(data.size(), buffer_size - m_fill);
+        std::memcpy(m_buffer.data + m_fill, data.data(), size);
+        m_fill += size;
+        data.remove_prefix(size);
+
+        if (m_fill == buffer_size) {
+            m_writer->submit(m_file, m_buffer, m_fill, m_offset);
+            m_offset += m_fill;
+            m_fill = 0;
+        }
+    }
+}
+
+void UringSink::close()
+{
+    if (m_file.fd < 0) {
+        return;
+    }
+
+    if (m_fill > 0) {
+        if (m_writer->direct()) {
+            // The last write isn't aligned, it has to be done without
+            // O_DIRECT.
+            m_writer->wait(m_file);
+            // NOLINTNEXTLINE(hicpp-vararg)
+            auto const flags = ::fcntl(m_file.fd, F_GETFL);
+            // NOLINTNEXTLINE(hicpp-signed-bitwise, hicpp-vararg)
+            ::fcntl(m_file.fd, F_SETFL, flags & ~O_DIRECT);
+        }
+        m_writer->submit(m_file, m_buffer, m_fill, m_offset);
+        m_offset += m_fill;
+        m_fill = 0;
+    }
+
+    auto const fd = std::exchange(m_file.fd, -1);
+    try {
+        m_writer->wait(m_file);
+    } catch (...) {
+        ::close(fd);
+        m_writer->remove_file();
+        throw;
+    }
+    m_writer->remove_file();
+
+    if (::close(fd) != 0) {
+        throw std::runtime_error{"error closing file: " + m_filename};
+    }
+}
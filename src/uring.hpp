@@ -0,0 +1,182 @@
+#pragma once
+
+#include "sink.hpp"
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+/**
+ * Writes data for many files through one io_uring. A single thread submits
+ * the writes for all files in batches and reaps the completions, so the
+ * device queue stays full without one blocking write() per file.
+ *
+ * Data is written from a pool of buffers owned by the writer. If possible
+ * the initial buffers are registered with the kernel. Every file keeps one
+ * buffer it is filling, so the pool grows with the number of open files to
+ * always have buffers left for writing. With direct I/O files are opened
+ * with O_DIRECT and all writes except the last one of each file are
+ * aligned.
+ *
+ * If the kernel doesn't support writes through io_uring, the writer thread
+ * falls back to plain write() calls.
+ */
+class UringWriter
+{
+
+public:
+    /// State of a file written through the UringWriter.
+    struct file_type
+    {
+        int fd = -1;
+        std::size_t pending = 0;
+        std::exception_ptr error{};
+    };
+
+    /// A buffer from the pool.
+    struct buffer_type
+    {
+        unsigned int index = 0;
+        char *data = nullptr;
+    };
+
+private:
+    struct request_type
+    {
+        file_type *file;
+        int fd;
+        buffer_type buffer;
+        std::size_t buffer_offset;
+        std::size_t size;
+        std::uint64_t file_offset;
+    };
+
+    class Ring;
+
+    std::unique_ptr<Ring> m_ring;
+
+    // Memory of the initial buffers, buffers added later are allocated
+    // one by one.
+    char *m_memory = nullptr;
+    std::size_t m_buffer_size;
+    unsigned int m_buffer_count;
+    bool m_registered = false;
+    bool m_direct;
+
+    // Only used by the writer thread
+    bool m_use_write = false;
+
+    std::mutex m_mutex;
+    std::condition_variable m_cond;
+    std::vector<char *> m_buffers;
+    std::vector<unsigned int> m_free_buffers;
+    std::deque<request_type> m_requests;
+    std::size_t m_files = 0;
+    bool m_stop = false;
+
+    std::thread m_thread;
+
+    void run();
+
+    void submit_requests(std::deque<request_type> &requests,
+                         std::size_t &in_flight);
+
+    void write_sync(request_type const &request);
+
+    void complete(request_type const &request, int result,
+                  std::deque<request_type> &retries);
+
+    void release(request_type const &request, int error);
+
+public:
+    UringWriter(std::size_t buffer_size, unsigned int buffer_count,
+                bool direct);
+
+    ~UringWriter();
+
+    UringWriter(UringWriter const &) = delete;
+    UringWriter &operator=(UringWriter const &) = delete;
+
+    UringWriter(UringWriter &&) = delete;
+    UringWriter &operator=(UringWriter &&) = delete;
+
+    /**
+     * Get the writer shared by all UringSinks, creating it if needed.
+     * Returns nullptr if io_uring is not available on this system.
+     */
+    static std::shared_ptr<UringWriter> shared(std::size_t buffer_size,
+                                               bool direct);
+
+    std::size_t buffer_size() const noexcept { return m_buffer_size; }
+
+    bool direct() const noexcept { return m_direct; }
+
+    /**
+     * Called for every file opened for writing through this writer, adds
+     * buffers to the pool if needed.
+     */
+    void add_file();
+
+    /// Called when a file added with add_file() is closed.
+    void remove_file();
+
+    /// Number of buffers in the pool.
+    std::size_t buffer_count();
+
+    /// Get a free buffer, blocks until one is available.
+    buffer_type acquire_buffer();
+
+    /**
+     * Write size bytes from the start of the buffer into the file at the
+     * given offset. The buffer is released once the data is written.
+     */
+    void submit(file_type &file, buffer_type buffer, std::size_t size,
+                std::uint64_t offset);
+
+    /**
+     * Wait until all writes to the file are done. Rethrows the error if
+     * any of them failed.
+     */
+    void wait(file_type &file);
+
+}; // class UringWriter
+
+/**
+ * Sink writing to a file through a (shared) UringWriter.
+ */
+class UringSink : public Sink
+{
+
+    std::shared_ptr<UringWriter> m_writer;
+    std::string m_filename;
+    UringWriter::file_type m_file;
+    std::uint64_t m_offset = 0;
+
+    // Buffer currently being filled, if m_fill is 0 there is no buffer.
+    UringWriter::buffer_type m_buffer;
+    std::size_t m_fill = 0;
+
+public:
+    UringSink(std::shared_ptr<UringWriter> writer, std::string filename);
+
+    ~UringSink() override;
+
+    UringSink(UringSink const &) = delete;
+    UringSink &operator=(UringSink const &) = delete;
+
+    UringSink(UringSink &&) = delete;
+    UringSink &operator=(UringSink &&) = delete;
+
+    void write(std::string_view data) override;
+
+    void close() override;
+
+}; // class UringSink
@@ -1,6 +1,16 @@
 
 #include "util.hpp"
 
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstdint>
+#include <cstring>
+
+#ifdef OPE_X86_SIMD
+#include <immintrin.h>
+#endif
+
 std::pair<std::string, std::string>
 split(std::string const &input, char delimiter, std::string const &default_2nd)
 {
@@ -38,22 +48,179 @@ void escape_char(std::string &buffer, char const c) noexcept
     }
 }
 
+// Characters that need escaping in COPY text format, NUL ends the string.
+constexpr auto special_chars = [] {
+    std::array<bool, 256> special{};
+    for (unsigned char const c : {'\0', '\\', '\n', '\r', '\t'}) {
+        special[c] = true;
+    }
+    return special;
+}();
+
+bool needs_escaping(char const c) noexcept
+{
+    return special_chars[static_cast<unsigned char>(c)];
+}
+
 } // anonymous namespace
 
-void append_pg_escaped(std::string &buffer, char const *str, std::size_t size)
+namespace detail {
+
+void append_pg_escaped_scalar(std::string &buffer, char const *str,
+                              std::size_t size)
 {
-    while (size-- > 0 && *str != '\0') {
-        escape_char(buffer, *str);
-        ++str;
+    char const *const end = str + size;
+    while (str != end) {
+        // Find the end of the run of characters not needing escaping
+        char const *run = str;
+        while (run != end && !needs_escaping(*run)) {
+            ++run;
+        }
+        buffer.append(str, run);
+        if (run == end || *run == '\0') {
+            return;
+        }
+        escape_char(buffer, *run);
+        str = run + 1;
     }
 }
 
-void append_pg_escaped(std::string &buffer, char const *str)
+#ifdef OPE_X86_SIMD
+
+namespace {
+
+// Copy the first n characters, then handle the special character following
+// them. Returns false if that was the end of the string.
+bool append_run(std::string &buffer, char const *&str, std::size_t &size,
+                unsigned int n)
+{
+    buffer.append(str, n);
+    str += n;
+    size -= n;
+    if (*str == '\0') {
+        return false;
+    }
+    escape_char(buffer, *str);
+    ++str;
+    --size;
+    return true;
+}
+
+// Can we read width bytes from str without crossing into the next page?
+// Reading past the end of the string is fine then, because memory
+// protection works on whole pages. The extra bytes are masked out.
+bool within_page(char const *str, std::size_t width) noexcept
+{
+    constexpr std::size_t page_size = 4096;
+    return (reinterpret_cast<std::uintptr_t>(str) % page_size) <=
+           page_size - width;
+}
+
+} // anonymous namespace
+
+// Reading past the end of the string (see within_page()) would upset the
+// address sanitizer.
+__attribute__((no_sanitize_address)) void
+append_pg_escaped_sse2(std::string &buffer, char const *str, std::size_t size)
 {
-    while (*str != '\0') {
-        escape_char(buffer, *str);
-        ++str;
+    __m128i const backslash = _mm_set1_epi8('\\');
+    __m128i const newline = _mm_set1_epi8('\n');
+    __m128i const carriage_return = _mm_set1_epi8('\r');
+    __m128i const tab = _mm_set1_epi8('\t');
+    __m128i const zero = _mm_setzero_si128();
+
+    while (size > 0 && (size >= 16 || within_page(str, 16))) {
+        __m128i const chunk =
+            _mm_loadu_si128(reinterpret_cast<__m128i const *>(str));
+        __m128i const special = _mm_or_si128(
+            _mm_or_si128(_mm_cmpeq_epi8(chunk, backslash),
+                         _mm_cmpeq_epi8(chunk, newline)),
+            _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(chunk, carriage_return),
+                                      _mm_cmpeq_epi8(chunk, tab)),
+                         _mm_cmpeq_epi8(chunk, zero)));
+        auto mask = static_cast<unsigned int>(_mm_movemask_epi8(special));
+        auto const n = std::min<std::size_t>(size, 16);
+        if (n < 16) {
+            mask &= (1U << n) - 1U;
+        }
+        if (mask == 0) {
+            buffer.append(str, n);
+            str += n;
+            size -= n;
+        } else if (!append_run(buffer, str, size, std::countr_zero(mask))) {
+            return;
+        }
     }
+
+    append_pg_escaped_scalar(buffer, str, size);
+}
+
+__attribute__((target("avx2"), no_sanitize_address)) void
+append_pg_escaped_avx2(std::string &buffer, char const *str, std::size_t size)
+{
+    __m256i const backslash = _mm256_set1_epi8('\\');
+    __m256i const newline = _mm256_set1_epi8('\n');
+    __m256i const carriage_return = _mm256_set1_epi8('\r');
+    __m256i const tab = _mm256_set1_epi8('\t');
+    __m256i const zero = _mm256_setzero_si256();
+
+    // Short strings are handled by the SSE2 version.
+    while (size >= 32) {
+        __m256i const chunk =
+            _mm256_loadu_si256(reinterpret_cast<__m256i const *>(str));
+        __m256i const special = _mm256_or_si256(
+            _mm256_or_si256(_mm256_cmpeq_epi8(chunk, backslash),
+                            _mm256_cmpeq_epi8(chunk, newline)),
+            _mm256_or_si256(
+                _mm256_or_si256(_mm256_cmpeq_epi8(chunk, carriage_return),
+                                _mm256_cmpeq_epi8(chunk, tab)),
+                _mm256_cmpeq_epi8(chunk, zero)));
+        auto const mask =
+            static_cast<unsigned int>(_mm256_movemask_epi8(special));
+        if (mask == 0) {
+            buffer.append(str, 32);
+            str += 32;
+            size -= 32;
+        } else if (!append_run(buffer, str, size, std::countr_zero(mask))) {
+            return;
+        }
+    }
+
+    append_pg_escaped_sse2(buffer, str, size);
+}
+
+#endif
+
+} // namespace detail
+
+namespace {
+
+using escape_func_type = void (*)(std::string &, char const *, std::size_t);
+
+escape_func_type select_escape_func() noexcept
+{
+#ifdef OPE_X86_SIMD
+    if (__builtin_cpu_supports("avx2")) {
+        return detail::append_pg_escaped_avx2;
+    }
+    return detail::append_pg_escaped_sse2;
+#else
+    return detail::append_pg_escaped_scalar;
+#endif
+}
+
+escape_func_type const escape_func = select_escape_func();
+
+} // anonymous namespace
+
+void append_pg_escaped(std::string &buffer, char const *str, std::size_t size)
+{
+    escape_func(buffer, str, size);
+}
+
+void append_pg_escaped(std::string &buffer, char const *str)
+{
+    escape_func(buffer, str, std::strlen(str));
 }
 
 std::string list_entities(osmium::osm_entity_bits::type const entities)
@@ -83,3 +250,23 @@ char const *yes_no(bool const choice) noexcept
 {
     return choice ? "yes\n" : "no\n";
 }
+
+std::uint64_t hilbert_index(std::uint32_t x, std::uint32_t y) noexcept
+{
+    std::uint64_t index = 0;
+    for (std::uint32_t s = 1U << 31U; s > 0; s >>= 1U) {
+        std::uint32_t const rx = (x & s) > 0 ? 1 : 0;
+        std::uint32_t const ry = (y & s) > 0 ? 1 : 0;
+        index += static_cast<std::uint64_t>(s) * s * ((3 * rx) ^ ry);
+
+        // Rotate the quadrant so the curve continues in the right direction.
+        if (ry == 0) {
+            if (rx == 1) {
+                x = ~x;
+                y = ~y;
+            }
+            std::swap(x, y);
+        }
+    }
+    return index;
+}
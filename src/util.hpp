@@ -3,6 +3,7 @@
 #include <osmium/osm/entity_bits.hpp>
 
 #include <cstddef>
+#include <cstdint>
 #include <limits>
 #include <string>
 #include <utility>
@@ -17,9 +18,41 @@ std::pair<std::string, std::string> split(std::string const &input,
                                           char delimiter,
                                           std::string const &default_2nd = "");
 
+/**
+ * Append str to buffer escaped for the PostgreSQL COPY text format. Stops
+ * after size characters or at the first NUL character. Uses SSE2 or AVX2
+ * (checked at runtime) on x86_64.
+ */
 void append_pg_escaped(std::string &buffer, char const *str, std::size_t size);
 void append_pg_escaped(std::string &buffer, char const *str);
 
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define OPE_X86_SIMD
+#endif
+
+// The different implementations of append_pg_escaped(), only exposed for
+// testing and benchmarking.
+namespace detail {
+
+void append_pg_escaped_scalar(std::string &buffer, char const *str,
+                              std::size_t size);
+
+#ifdef OPE_X86_SIMD
+void append_pg_escaped_sse2(std::string &buffer, char const *str,
+                            std::size_t size);
+
+void append_pg_escaped_avx2(std::string &buffer, char const *str,
+                            std::size_t size);
+#endif
+
+} // namespace detail
+
 std::string list_entities(osmium::osm_entity_bits::type entities);
 
 char const *yes_no(bool choice) noexcept;
+
+/**
+ * Position of the point (x, y) on the Hilbert curve filling the square of
+ * all 32 bit coordinates. Points close on the curve are close in space.
+ */
+std::uint64_t hilbert_index(std::uint32_t x, std::uint32_t y) noexcept;
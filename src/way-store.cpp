@@ -0,0 +1,102 @@
+#include "way-store.hpp"
+
+#include <osmium/io/any_input.hpp>
+#include <osmium/io/any_output.hpp>
+
+#include <algorithm>
+#include <filesystem>
+#include <utility>
+
+namespace {
+
+std::unique_ptr<osmium::io::Writer> open_store(std::string const &filename)
+{
+    osmium::io::Header header;
+    header.set("generator", "ope");
+
+    return std::make_unique<osmium::io::Writer>(
+        osmium::io::File{filename, "pbf"}, header,
+        osmium::io::overwrite::allow);
+}
+
+bool uses_any_node(osmium::Way const &way,
+                   std::vector<osmium::object_id_type> const &nodes)
+{
+    return std::any_of(way.nodes().cbegin(), way.nodes().cend(),
+                       [&nodes](osmium::NodeRef const &node_ref) {
+                           return std::binary_search(
+                               nodes.cbegin(), nodes.cend(), node_ref.ref());
+                       });
+}
+
+} // anonymous namespace
+
+std::string way_store_filename(std::string const &index_filename)
+{
+    return index_filename + ".ways";
+}
+
+WayStoreWriter::WayStoreWriter(std::string filename)
+: m_filename(std::move(filename)), m_writer(open_store(m_filename + ".tmp"))
+{
+}
+
+void WayStoreWriter::add(osmium::memory::Buffer const &buffer)
+{
+    for (auto const &way : buffer.select<osmium::Way>()) {
+        (*m_writer)(way);
+    }
+}
+
+void WayStoreWriter::close()
+{
+    m_writer->close();
+    std::filesystem::rename(m_filename + ".tmp", m_filename);
+}
+
+void update_way_store(std::string const &filename,
+                      std::vector<osmium::Way const *> const &changed_ways,
+                      std::vector<osmium::object_id_type> const &moved_nodes,
+                      moved_way_func const &moved)
+{
+    std::string const tmp_filename{filename + ".tmp"};
+    auto writer = open_store(tmp_filename);
+
+    // The changed ways replace the ways with the same id or are inserted
+    // in id order, deleted ways are left out.
+    auto next_changed = changed_ways.cbegin();
+    auto const write_changed = [&]() {
+        if ((*next_changed)->visible()) {
+            (*writer)(**next_changed);
+        }
+        ++next_changed;
+    };
+
+    osmium::io::Reader reader{osmium::io::File{filename, "pbf"},
+                              osmium::osm_entity_bits::way};
+    while (auto buffer = reader.read()) {
+        for (auto &way : buffer.select<osmium::Way>()) {
+            while (next_changed != changed_ways.cend() &&
+                   (*next_changed)->id() < way.id()) {
+                write_changed();
+            }
+            if (next_changed != changed_ways.cend() &&
+                (*next_changed)->id() == way.id()) {
+                write_changed();
+                continue;
+            }
+            (*writer)(way);
+            if (uses_any_node(way, moved_nodes)) {
+                moved(way);
+            }
+        }
+    }
+    reader.close();
+
+    while (next_changed != changed_ways.cend()) {
+        write_changed();
+    }
+
+    writer->close();
+    std::filesystem::rename(tmp_filename, filename);
+}
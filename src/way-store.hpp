@@ -0,0 +1,57 @@
+#pragma once
+
+#include <osmium/io/writer.hpp>
+#include <osmium/memory/buffer.hpp>
+#include <osmium/osm/types.hpp>
+#include <osmium/osm/way.hpp>
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+/**
+ * The ways of a run with a file-based location index are kept in an OSM
+ * file next to the index file. In update mode they are used to find the
+ * ways using nodes that moved. Those ways need new geometries even if they
+ * are not in the change file themselves.
+ */
+
+/// The file name of the way store for a location index file.
+std::string way_store_filename(std::string const &index_filename);
+
+/**
+ * Writes the way store in a full run. The ways must be added in the order
+ * of their ids, as they are in the input file. They are written to a
+ * temporary file first, so that an interrupted run doesn't leave an
+ * incomplete way store behind.
+ */
+class WayStoreWriter
+{
+public:
+    explicit WayStoreWriter(std::string filename);
+
+    /// Add the ways in the buffer, other objects are ignored.
+    void add(osmium::memory::Buffer const &buffer);
+
+    void close();
+
+private:
+    std::string m_filename;
+    std::unique_ptr<osmium::io::Writer> m_writer;
+
+}; // class WayStoreWriter
+
+using moved_way_func = std::function<void(osmium::Way &)>;
+
+/**
+ * Update the way store with the ways from a change file. changed_ways are
+ * the newest versions of the ways in the change file ordered by id,
+ * moved_nodes the sorted ids of the nodes with a new location. Calls moved
+ * for every way in the store that isn't in the change file and uses one of
+ * those nodes.
+ */
+void update_way_store(std::string const &filename,
+                      std::vector<osmium::Way const *> const &changed_ways,
+                      std::vector<osmium::object_id_type> const &moved_nodes,
+                      moved_way_func const &moved);
@@ -0,0 +1,211 @@
+#include <catch.hpp>
+
+#include "area-assembly.hpp"
+
+#include <osmium/builder/attr.hpp>
+#include <osmium/io/any_input.hpp>
+#include <osmium/visitor.hpp>
+
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+using namespace osmium::builder::attr;
+
+namespace {
+
+// A closed square way with the given id, each way at a different place.
+void add_square(osmium::memory::Buffer &buffer, osmium::object_id_type id,
+                bool tagged)
+{
+    auto const x = static_cast<double>(id % 100) / 10;
+    auto const y = static_cast<double>(id / 100) / 10;
+    auto const first = id * 10;
+    std::vector<osmium::NodeRef> const nodes{
+        {first, osmium::Location{x, y}},
+        {first + 1, osmium::Location{x + 0.05, y}},
+        {first + 2, osmium::Location{x + 0.05, y + 0.05}},
+        {first + 3, osmium::Location{x, y + 0.05}},
+        {first, osmium::Location{x, y}}};
+    if (tagged) {
+        osmium::builder::add_way(buffer, _id(id), _nodes(nodes),
+                                 _tag("building", "yes"));
+    } else {
+        osmium::builder::add_way(buffer, _id(id), _nodes(nodes));
+    }
+}
+
+void write_file(std::string const &filename, std::string const &content)
+{
+    std::ofstream file{filename};
+    file << content;
+}
+
+// Read the relations for the areas (from the cache if possible) and then
+// the ways. Returns whether the cache was used and the ids of the areas.
+std::pair<bool, std::vector<osmium::object_id_type>>
+assemble(std::string const &input, std::string const &cache)
+{
+    std::vector<osmium::object_id_type> area_ids;
+    osmium::area::Assembler::config_type const config;
+    AreaAssemblerPool pool{config, 2,
+                           [&area_ids](osmium::memory::Buffer &&buffer) {
+                               for (auto const &area :
+                                    buffer.select<osmium::Area>()) {
+                                   area_ids.push_back(area.id());
+                               }
+                           }};
+    ParallelMultipolygonManager manager{pool};
+
+    osmium::io::File const input_file{input};
+    bool const cached = read_area_relations(input_file, cache, manager);
+
+    osmium::io::Reader reader{input_file, osmium::osm_entity_bits::way};
+    while (auto buffer = reader.read()) {
+        osmium::apply(buffer, manager.handler());
+    }
+    reader.close();
+    pool.finish();
+
+    return {cached, area_ids};
+}
+
+} // anonymous namespace
+
+TEST_CASE("area assembler pool delivers areas in the order added")
+{
+    constexpr osmium::object_id_type count = 300;
+
+    // All objects are created first, buffers can't grow while they are
+    // referenced.
+    osmium::memory::Buffer ways{1024, osmium::memory::Buffer::auto_grow::yes};
+    osmium::memory::Buffer relations{1024,
+                                     osmium::memory::Buffer::auto_grow::yes};
+    for (osmium::object_id_type id = 1; id <= count; ++id) {
+        add_square(ways, id, true);
+        // member way of relation id
+        add_square(ways, count + id, false);
+        osmium::builder::add_relation(
+            relations, _id(id),
+            _member(osmium::item_type::way, count + id, "outer"),
+            _tag("type", "multipolygon"), _tag("landuse", "grass"));
+    }
+
+    std::vector<osmium::Way const *> way_ptrs;
+    for (auto const &way : ways.select<osmium::Way>()) {
+        way_ptrs.push_back(&way);
+    }
+    std::vector<osmium::Relation const *> relation_ptrs;
+    for (auto const &relation : relations.select<osmium::Relation>()) {
+        relation_ptrs.push_back(&relation);
+    }
+
+    std::vector<osmium::object_id_type> expected;
+    std::vector<osmium::object_id_type> area_ids;
+    {
+        osmium::area::Assembler::config_type const config;
+        AreaAssemblerPool pool{config, 4,
+                               [&area_ids](osmium::memory::Buffer &&buffer) {
+                                   for (auto const &area :
+                                        buffer.select<osmium::Area>()) {
+                                       area_ids.push_back(area.id());
+                                   }
+                               }};
+
+        // Alternate closed ways and relations, every relation is a piece
+        // of work of its own.
+        for (std::size_t n = 0; n < relation_ptrs.size(); ++n) {
+            auto const &way = *way_ptrs[n * 2];
+            pool.add_way(way);
+            expected.push_back(osmium::object_id_to_area_id(
+                way.id(), osmium::item_type::way));
+
+            auto const &relation = *relation_ptrs[n];
+            pool.add_relation(relation, {way_ptrs[(n * 2) + 1]});
+            expected.push_back(osmium::object_id_to_area_id(
+                relation.id(), osmium::item_type::relation));
+        }
+        pool.finish();
+    }
+
+    REQUIRE(area_ids == expected);
+}
+
+TEST_CASE("multipolygon manager needs relations with way members")
+{
+    osmium::memory::Buffer buffer{1024,
+                                  osmium::memory::Buffer::auto_grow::yes};
+    osmium::builder::add_relation(
+        buffer, _id(1), _member(osmium::item_type::way, 10, "outer"),
+        _tag("type", "multipolygon"));
+    osmium::builder::add_relation(
+        buffer, _id(2), _member(osmium::item_type::node, 10, ""),
+        _tag("type", "multipolygon"));
+    osmium::builder::add_relation(
+        buffer, _id(3), _member(osmium::item_type::way, 10, "outer"),
+        _tag("type", "boundary"));
+    osmium::builder::add_relation(
+        buffer, _id(4), _member(osmium::item_type::way, 10, "outer"),
+        _tag("type", "route"));
+    osmium::builder::add_relation(buffer, _id(5),
+                                  _tag("type", "multipolygon"));
+
+    osmium::area::Assembler::config_type const config;
+    AreaAssemblerPool pool{config, 1, [](osmium::memory::Buffer &&) {}};
+    ParallelMultipolygonManager const manager{pool};
+
+    std::vector<osmium::object_id_type> ids;
+    for (auto const &relation : buffer.select<osmium::Relation>()) {
+        if (manager.new_relation(relation)) {
+            ids.push_back(relation.id());
+        }
+    }
+    pool.finish();
+
+    REQUIRE(ids == std::vector<osmium::object_id_type>{1, 3});
+}
+
+TEST_CASE("relations cache is used on the next run with the same input")
+{
+    auto const dir = std::filesystem::temp_directory_path() /
+                     "ope-test-relations-cache";
+    std::filesystem::remove_all(dir);
+    std::filesystem::create_directories(dir);
+    auto const input = (dir / "input.opl").string();
+    auto const cache = (dir / "relations.osm.pbf").string();
+
+    // The ways have the node locations, so no location index is needed.
+    std::string const ways{"w10 Nn1x1y1,n2x2y1,n3x2y2,n4x1y2,n1x1y1\n"
+                           "w11 Nn5x3y1,n6x4y1,n7x4y2,n8x3y2,n5x3y1\n"};
+    std::string const relations{
+        "r1 Ttype=multipolygon,landuse=grass Mw10@outer\n"
+        "r2 Ttype=route Mw10@,w11@\n"};
+    write_file(input, ways + relations);
+
+    std::vector<osmium::object_id_type> const expected{3};
+
+    auto result = assemble(input, cache);
+    REQUIRE_FALSE(result.first);
+    REQUIRE(result.second == expected);
+    REQUIRE(std::filesystem::exists(cache));
+    REQUIRE(std::filesystem::exists(cache + ".id"));
+
+    result = assemble(input, cache);
+    REQUIRE(result.first);
+    REQUIRE(result.second == expected);
+
+    // A changed input file doesn't match any more.
+    write_file(input, ways + relations +
+                          "r3 Ttype=multipolygon,natural=water Mw11@outer\n");
+    result = assemble(input, cache);
+    REQUIRE_FALSE(result.first);
+    REQUIRE(result.second == std::vector<osmium::object_id_type>{3, 7});
+
+    result = assemble(input, cache);
+    REQUIRE(result.first);
+    REQUIRE(result.second == std::vector<osmium::object_id_type>{3, 7});
+
+    std::filesystem::remove_all(dir);
+}
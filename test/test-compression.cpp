@@ -0,0 +1,247 @@
+#include <catch.hpp>
+
+#include "compression.hpp"
+
+#include <zlib.h>
+
+#ifdef OPE_WITH_ZSTD
+#include <zstd.h>
+#endif
+
+#ifdef OPE_WITH_LZ4
+#include <lz4frame.h>
+#endif
+
+#include <algorithm>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+
+namespace {
+
+// Some rows, large enough to need several calls into the compressor.
+std::string test_data()
+{
+    std::string data;
+    for (int n = 0; n < 20000; ++n) {
+        data += std::to_string(n) + "\tsome text\t" + std::to_string(n * 7) +
+                "\n";
+    }
+    return data;
+}
+
+// Write the data in chunks to a file with the given suffix and return
+// the (compressed) contents of the file.
+std::string write_file(std::string const &suffix, std::string_view data)
+{
+    auto const filename = (std::filesystem::temp_directory_path() /
+                           ("ope-test-compression" + suffix))
+                              .string();
+
+    {
+        auto sink = create_file_sink(filename);
+        while (!data.empty()) {
+            auto const size = std::min<std::size_t>(data.size(), 10000);
+            sink->write(data.substr(0, size));
+            data.remove_prefix(size);
+        }
+        sink->close();
+    }
+
+    std::ifstream file{filename, std::ios::binary};
+    std::string content{std::istreambuf_iterator<char>{file},
+                        std::istreambuf_iterator<char>{}};
+    file.close();
+    std::remove(filename.c_str());
+    return content;
+}
+
+std::string gunzip(std::string const &data)
+{
+    z_stream stream{};
+    // window bits 15 + 32 means: detect gzip header
+    REQUIRE(inflateInit2(&stream, 15 + 32) == Z_OK);
+
+    // NOLINTNEXTLINE(cppcoreguidelines-pro-type-const-cast)
+    stream.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(data.data()));
+    stream.avail_in = static_cast<uInt>(data.size());
+
+    std::string out;
+    int result = Z_OK;
+    while (result == Z_OK) {
+        char buffer[4096];
+        stream.next_out = reinterpret_cast<Bytef *>(buffer);
+        stream.avail_out = sizeof(buffer);
+        result = inflate(&stream, Z_NO_FLUSH);
+        out.append(buffer, sizeof(buffer) - stream.avail_out);
+    }
+    inflateEnd(&stream);
+
+    REQUIRE(result == Z_STREAM_END);
+    REQUIRE(stream.avail_in == 0);
+    return out;
+}
+
+#ifdef OPE_WITH_ZSTD
+std::string unzstd(std::string const &data)
+{
+    ZSTD_DCtx *ctx = ZSTD_createDCtx();
+    ZSTD_inBuffer input{data.data(), data.size(), 0};
+
+    std::string out;
+    std::size_t result = 0;
+    while (input.pos < input.size) {
+        char buffer[4096];
+        ZSTD_outBuffer output{buffer, sizeof(buffer), 0};
+        result = ZSTD_decompressStream(ctx, &output, &input);
+        if (ZSTD_isError(result)) {
+            break;
+        }
+        out.append(buffer, output.pos);
+    }
+    ZSTD_freeDCtx(ctx);
+
+    REQUIRE_FALSE(ZSTD_isError(result));
+    REQUIRE(result == 0); // frame complete
+    return out;
+}
+#endif
+
+#ifdef OPE_WITH_LZ4
+std::string unlz4(std::string const &data)
+{
+    LZ4F_dctx *ctx = nullptr;
+    REQUIRE_FALSE(
+        LZ4F_isError(LZ4F_createDecompressionContext(&ctx, LZ4F_VERSION)));
+
+    std::string out;
+    char const *in = data.data();
+    std::size_t remaining = data.size();
+    std::size_t result = 0;
+    while (remaining > 0) {
+        char buffer[4096];
+        std::size_t out_size = sizeof(buffer);
+        std::size_t in_size = remaining;
+        result =
+            LZ4F_decompress(ctx, buffer, &out_size, in, &in_size, nullptr);
+        if (LZ4F_isError(result)) {
+            break;
+        }
+        out.append(buffer, out_size);
+        in += in_size;
+        remaining -= in_size;
+    }
+    LZ4F_freeDecompressionContext(ctx);
+
+    REQUIRE_FALSE(LZ4F_isError(result));
+    REQUIRE(result == 0); // frame complete
+    return out;
+}
+#endif
+
+// Compressor passing the data through unchanged.
+class CopyCompressor : public Compressor
+{
+public:
+    void compress(std::string_view data, std::string &out) override
+    {
+        out.append(data);
+    }
+
+    void finish(std::string & /*out*/) override {}
+
+}; // class CopyCompressor
+
+class FailingSink : public Sink
+{
+public:
+    void write(std::string_view /*data*/) override
+    {
+        throw std::runtime_error{"mock write error"};
+    }
+
+    void close() override {}
+
+}; // class FailingSink
+
+} // anonymous namespace
+
+TEST_CASE("gzip compressed file round trip")
+{
+    auto const data = test_data();
+    auto const compressed = write_file(".gz", data);
+
+    REQUIRE(compressed.size() < data.size());
+    REQUIRE(gunzip(compressed) == data);
+}
+
+TEST_CASE("gzip compressed empty file")
+{
+    REQUIRE(gunzip(write_file(".gz", "")).empty());
+}
+
+#ifdef OPE_WITH_ZSTD
+TEST_CASE("zstd compressed file round trip")
+{
+    auto const data = test_data();
+    auto const compressed = write_file(".zst", data);
+
+    REQUIRE(compressed.size() < data.size());
+    REQUIRE(unzstd(compressed) == data);
+}
+#endif
+
+#ifdef OPE_WITH_LZ4
+TEST_CASE("lz4 compressed file round trip")
+{
+    auto const data = test_data();
+    auto const compressed = write_file(".lz4", data);
+
+    REQUIRE(compressed.size() < data.size());
+    REQUIRE(unlz4(compressed) == data);
+}
+#endif
+
+TEST_CASE("uncompressed file is written as is")
+{
+    auto const data = test_data();
+    REQUIRE(write_file(".pgcopy", data) == data);
+}
+
+TEST_CASE("compressing sink rethrows error from background thread")
+{
+    CompressingSink sink{std::make_unique<CopyCompressor>(),
+                         std::make_unique<FailingSink>()};
+
+    sink.write("a");
+    REQUIRE_THROWS_WITH(sink.close(), "mock write error");
+}
+
+TEST_CASE("compressing sink stops accepting data after an error")
+{
+    CompressingSink sink{std::make_unique<CopyCompressor>(),
+                         std::make_unique<FailingSink>()};
+
+    // The queue holds a few buffers, once the background thread failed
+    // the next write throws.
+    REQUIRE_THROWS_WITH(
+        [&sink]() {
+            for (int n = 0; n < 1000; ++n) {
+                sink.write("a");
+            }
+        }(),
+        "mock write error");
+}
+
+TEST_CASE("decompress commands")
+{
+    REQUIRE(decompress_command("nodes.pgcopy.gz") == "zcat");
+    REQUIRE(decompress_command("nodes.pgcopy.zst") == "zstdcat");
+    REQUIRE(decompress_command("nodes.pgcopy.lz4") == "lz4cat");
+    REQUIRE(decompress_command("nodes.pgcopy").empty());
+}
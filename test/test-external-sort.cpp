@@ -0,0 +1,91 @@
+
+#include <catch.hpp>
+
+#include "external-sort.hpp"
+
+#include <filesystem>
+#include <string>
+#include <vector>
+
+namespace {
+
+std::string temp_prefix()
+{
+    return (std::filesystem::temp_directory_path() / "ope-test-sort")
+        .string();
+}
+
+std::vector<std::string> sorted(ExternalSorter &sorter)
+{
+    std::vector<std::string> records;
+    sorter.finish([&records](std::string_view record) {
+        records.emplace_back(record);
+    });
+    return records;
+}
+
+} // anonymous namespace
+
+TEST_CASE("sort in memory")
+{
+    ExternalSorter sorter{temp_prefix(), 1024 * 1024};
+    sorter.add({3}, "c");
+    sorter.add({1}, "a");
+    sorter.add({2}, "b");
+
+    REQUIRE(sorted(sorter) == std::vector<std::string>{"a", "b", "c"});
+    REQUIRE(sorter.num_runs() == 0);
+}
+
+TEST_CASE("sort with runs in temporary files")
+{
+    // Small enough for only a few records in memory
+    ExternalSorter sorter{temp_prefix(), 100};
+
+    std::vector<std::string> expected;
+    for (unsigned int n = 0; n < 100; ++n) {
+        expected.push_back("record " + std::to_string(n));
+    }
+    for (unsigned int n = 0; n < 100; ++n) {
+        auto const key = (n * 37) % 100;
+        sorter.add({key}, expected[key]);
+    }
+    REQUIRE(sorter.num_runs() > 1);
+
+    REQUIRE(sorted(sorter) == expected);
+    REQUIRE(sorter.num_runs() == 0);
+}
+
+TEST_CASE("records with the same key stay in order")
+{
+    ExternalSorter sorter{temp_prefix(), 64};
+    for (unsigned int n = 0; n < 50; ++n) {
+        sorter.add({n % 2}, std::to_string(n));
+    }
+
+    auto const records = sorted(sorter);
+    REQUIRE(records.size() == 50);
+    REQUIRE(records[0] == "0");
+    REQUIRE(records[1] == "2");
+    REQUIRE(records[24] == "48");
+    REQUIRE(records[25] == "1");
+    REQUIRE(records[49] == "49");
+}
+
+TEST_CASE("sort by primary and secondary key")
+{
+    ExternalSorter sorter{temp_prefix(), 1024 * 1024};
+    sorter.add({2, 1}, "2/1");
+    sorter.add({1, 2}, "1/2");
+    sorter.add({2, 0}, "2/0");
+    sorter.add({1, 1}, "1/1");
+
+    REQUIRE(sorted(sorter) ==
+            std::vector<std::string>{"1/1", "1/2", "2/0", "2/1"});
+}
+
+TEST_CASE("empty sort")
+{
+    ExternalSorter sorter{temp_prefix(), 64};
+    REQUIRE(sorted(sorter).empty());
+}
@@ -0,0 +1,87 @@
+
+#include <catch.hpp>
+
+#include "formatting.hpp"
+#include "json-writer.hpp"
+
+#include <cstdint>
+#include <format>
+#include <limits>
+#include <string>
+
+namespace {
+
+std::string int_str(std::int64_t value)
+{
+    std::string buffer{"x"};
+    add_int(buffer, value);
+    return buffer;
+}
+
+std::string coord_str(std::int32_t value)
+{
+    std::string buffer{"x"};
+    add_coordinate(buffer, value);
+    return buffer;
+}
+
+} // anonymous namespace
+
+TEST_CASE("add_int")
+{
+    REQUIRE(int_str(0) == "x0");
+    REQUIRE(int_str(7) == "x7");
+    REQUIRE(int_str(10) == "x10");
+    REQUIRE(int_str(99) == "x99");
+    REQUIRE(int_str(100) == "x100");
+    REQUIRE(int_str(12345) == "x12345");
+    REQUIRE(int_str(-1) == "x-1");
+    REQUIRE(int_str(-123456) == "x-123456");
+    REQUIRE(int_str(std::numeric_limits<std::int64_t>::max()) ==
+            "x9223372036854775807");
+    REQUIRE(int_str(std::numeric_limits<std::int64_t>::min()) ==
+            "x-9223372036854775808");
+}
+
+TEST_CASE("add_int is the same as std::format")
+{
+    for (std::int64_t n = -100000; n < 100000; n += 7) {
+        REQUIRE(int_str(n) == std::format("x{}", n));
+    }
+}
+
+TEST_CASE("add_coordinate")
+{
+    REQUIRE(coord_str(0) == "x0.0000000");
+    REQUIRE(coord_str(1) == "x0.0000001");
+    REQUIRE(coord_str(-1) == "x-0.0000001");
+    REQUIRE(coord_str(10000000) == "x1.0000000");
+    REQUIRE(coord_str(-1234567890) == "x-123.4567890");
+    REQUIRE(coord_str(1800000000) == "x180.0000000");
+    REQUIRE(coord_str(-1800000000) == "x-180.0000000");
+    REQUIRE(coord_str(900000001) == "x90.0000001");
+}
+
+TEST_CASE("json_writer writes into existing buffer")
+{
+    std::string buffer{"x\t"};
+    json_writer writer{buffer};
+    writer.start_object();
+    writer.key("a\\b");
+    writer.string("c\nd\"e");
+    writer.next();
+    writer.key("n");
+    writer.number(-42);
+    writer.end_object();
+    REQUIRE(buffer == R"(x	{"a\\b":"c\nd\"e","n":-42})");
+}
+
+TEST_CASE("json_writer with COPY escaping")
+{
+    std::string buffer;
+    json_writer writer{buffer, true};
+    writer.start_array();
+    writer.string("a\\b\tc\x01");
+    writer.end_array();
+    REQUIRE(buffer == R"(["a\\\\b\\tc\\u0001"])");
+}
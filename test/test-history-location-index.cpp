@@ -0,0 +1,40 @@
+
+#include <catch.hpp>
+
+#include "history-location-index.hpp"
+
+TEST_CASE("history location index finds version valid at a time")
+{
+    HistoryLocationIndex index;
+
+    index.set(1, osmium::Timestamp{100}, osmium::Location{10, 10});
+    index.set(1, osmium::Timestamp{200}, osmium::Location{20, 20});
+    index.set(1, osmium::Timestamp{300}, osmium::Location{});
+    index.set(2, osmium::Timestamp{150}, osmium::Location{30, 30});
+    index.sort();
+
+    REQUIRE(index.size() == 4);
+
+    REQUIRE(index.get(1, osmium::Timestamp{99}) == osmium::Location{});
+    REQUIRE(index.get(1, osmium::Timestamp{100}) == osmium::Location{10, 10});
+    REQUIRE(index.get(1, osmium::Timestamp{199}) == osmium::Location{10, 10});
+    REQUIRE(index.get(1, osmium::Timestamp{200}) == osmium::Location{20, 20});
+    REQUIRE(index.get(1, osmium::Timestamp{300}) == osmium::Location{});
+    REQUIRE(index.get(2, osmium::Timestamp{100}) == osmium::Location{});
+    REQUIRE(index.get(2, osmium::Timestamp{400}) == osmium::Location{30, 30});
+    REQUIRE(index.get(3, osmium::Timestamp{400}) == osmium::Location{});
+}
+
+TEST_CASE("history location index with versions out of order")
+{
+    HistoryLocationIndex index;
+
+    index.set(2, osmium::Timestamp{100}, osmium::Location{30, 30});
+    index.set(1, osmium::Timestamp{200}, osmium::Location{20, 20});
+    index.set(1, osmium::Timestamp{100}, osmium::Location{10, 10});
+    index.sort();
+
+    REQUIRE(index.get(1, osmium::Timestamp{150}) == osmium::Location{10, 10});
+    REQUIRE(index.get(1, osmium::Timestamp{250}) == osmium::Location{20, 20});
+    REQUIRE(index.get(2, osmium::Timestamp{150}) == osmium::Location{30, 30});
+}
@@ -0,0 +1,127 @@
+#include <catch.hpp>
+
+#include "location-store.hpp"
+
+#include <osmium/index/index.hpp>
+
+#include <cstdint>
+
+namespace {
+
+osmium::Location test_location(std::uint64_t id)
+{
+    auto const n = static_cast<std::int32_t>(id);
+    return osmium::Location{n * 37 - 1800000, 512345678 - n * 11};
+}
+
+} // anonymous namespace
+
+TEST_CASE("compact location store with ascending ids")
+{
+    CompactLocationStore store;
+
+    // several blocks with gaps between ids
+    for (std::uint64_t id = 10; id < 10000; id += 3) {
+        store.set(id, test_location(id));
+    }
+    store.sort();
+
+    REQUIRE(store.size() == 3330);
+    for (std::uint64_t id = 10; id < 10000; id += 3) {
+        REQUIRE(store.get(id) == test_location(id));
+    }
+
+    REQUIRE(store.get_noexcept(1) == osmium::Location{});
+    REQUIRE(store.get_noexcept(11) == osmium::Location{});
+    REQUIRE(store.get_noexcept(20000) == osmium::Location{});
+    REQUIRE_THROWS_AS(store.get(11), osmium::not_found);
+}
+
+TEST_CASE("compact location store before sort")
+{
+    CompactLocationStore store;
+
+    store.set(1, test_location(1));
+    store.set(2, test_location(2));
+
+    REQUIRE(store.get(1) == test_location(1));
+    REQUIRE(store.get(2) == test_location(2));
+    REQUIRE(store.get_noexcept(3) == osmium::Location{});
+}
+
+TEST_CASE("compact location store with ids out of order")
+{
+    CompactLocationStore store;
+
+    for (std::uint64_t id = 1000; id < 2000; ++id) {
+        store.set(id, test_location(id));
+    }
+    store.set(5, test_location(5));
+    store.set(1500, test_location(1));
+    store.set(1500, test_location(2));
+    store.sort();
+
+    REQUIRE(store.get(5) == test_location(5));
+    REQUIRE(store.get(1499) == test_location(1499));
+    REQUIRE(store.get(1500) == test_location(2));
+    REQUIRE(store.get(1999) == test_location(1999));
+}
+
+TEST_CASE("compact location store setting the last node of a full block again")
+{
+    CompactLocationStore store;
+
+    auto const last = CompactLocationStore::block_size;
+    for (std::uint64_t id = 1; id <= last; ++id) {
+        store.set(id, test_location(id));
+    }
+    store.set(last, test_location(1));
+    REQUIRE(store.size() == last);
+    REQUIRE(store.get(last) == test_location(1));
+
+    store.set(last + 1, test_location(last + 1));
+    store.sort();
+    REQUIRE(store.size() == last + 1);
+
+    // after sort() the last node is encoded already
+    store.set(last + 1, test_location(2));
+    store.sort();
+    REQUIRE(store.size() == last + 1);
+    REQUIRE(store.get(last) == test_location(1));
+    REQUIRE(store.get(last + 1) == test_location(2));
+}
+
+TEST_CASE("compact location store with invalid and extreme locations")
+{
+    CompactLocationStore store;
+
+    store.set(1, osmium::Location{-1800000000, -900000000});
+    store.set(2, osmium::Location{1800000000, 900000000});
+    store.set(3, osmium::Location{});
+    store.set(4, osmium::Location{0, 0});
+    store.sort();
+
+    REQUIRE(store.get(1) == osmium::Location{-1800000000, -900000000});
+    REQUIRE(store.get(2) == osmium::Location{1800000000, 900000000});
+    REQUIRE(store.get_noexcept(3) == osmium::Location{});
+    REQUIRE(store.get(4) == osmium::Location{0, 0});
+}
+
+TEST_CASE("compact location store lookups in more blocks than cached")
+{
+    CompactLocationStore store;
+
+    auto const num = CompactLocationStore::block_size *
+                     (CompactLocationStore::cache_size * 2);
+    for (std::uint64_t id = 1; id <= num; ++id) {
+        store.set(id, test_location(id));
+    }
+    store.sort();
+
+    // jump between blocks so the cache has to evict blocks
+    for (std::uint64_t id = 1; id <= num;
+         id += CompactLocationStore::block_size + 1) {
+        REQUIRE(store.get(id) == test_location(id));
+        REQUIRE(store.get(num + 1 - id) == test_location(num + 1 - id));
+    }
+}
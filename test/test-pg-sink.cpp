@@ -0,0 +1,243 @@
+#include <catch.hpp>
+
+#include "options.hpp"
+#include "pg-sink.hpp"
+#include "table.hpp"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+extern Options opts;
+
+namespace {
+
+/**
+ * Minimal server speaking the PostgreSQL frontend/backend protocol (v3) on
+ * localhost. It accepts the given number of connections one after the
+ * other, answers every query with success and records the queries and the
+ * COPY data it got.
+ */
+class StubServer
+{
+public:
+    struct connection_log
+    {
+        std::vector<std::string> queries;
+        std::string copy_data;
+    };
+
+    explicit StubServer(std::size_t num_connections)
+    {
+        m_socket = ::socket(AF_INET, SOCK_STREAM, 0);
+        sockaddr_in addr{};
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        socklen_t len = sizeof(addr);
+        // NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
+        auto *const sa = reinterpret_cast<sockaddr *>(&addr);
+        if (m_socket < 0 || ::bind(m_socket, sa, len) != 0 ||
+            ::listen(m_socket, 1) != 0 ||
+            ::getsockname(m_socket, sa, &len) != 0) {
+            throw std::runtime_error{"Can't create stub server socket"};
+        }
+        m_port = ntohs(addr.sin_port);
+
+        m_thread = std::thread{[this, num_connections]() {
+            for (std::size_t n = 0; n < num_connections; ++n) {
+                int const fd = ::accept(m_socket, nullptr, nullptr);
+                if (fd < 0) {
+                    return;
+                }
+                m_log.emplace_back();
+                serve(fd, m_log.back());
+                ::close(fd);
+            }
+        }};
+    }
+
+    ~StubServer()
+    {
+        if (m_thread.joinable()) {
+            m_thread.join();
+        }
+        ::close(m_socket);
+    }
+
+    StubServer(StubServer const &) = delete;
+    StubServer &operator=(StubServer const &) = delete;
+
+    StubServer(StubServer &&) = delete;
+    StubServer &operator=(StubServer &&) = delete;
+
+    std::string conninfo() const
+    {
+        return "host=127.0.0.1 port=" + std::to_string(m_port) +
+               " sslmode=disable gssencmode=disable";
+    }
+
+    /// Wait for all connections to finish and return what they sent.
+    std::vector<connection_log> const &log()
+    {
+        m_thread.join();
+        return m_log;
+    }
+
+private:
+    int m_socket = -1;
+    std::uint16_t m_port = 0;
+    std::thread m_thread;
+    std::vector<connection_log> m_log;
+
+    static bool read_all(int fd, char *data, std::size_t size)
+    {
+        while (size > 0) {
+            auto const n = ::read(fd, data, size);
+            if (n <= 0) {
+                return false;
+            }
+            data += n;
+            size -= static_cast<std::size_t>(n);
+        }
+        return true;
+    }
+
+    static std::uint32_t get_uint32(char const *data) noexcept
+    {
+        std::uint32_t value = 0;
+        for (std::size_t n = 0; n < 4; ++n) {
+            value = (value << 8U) | static_cast<unsigned char>(data[n]);
+        }
+        return value;
+    }
+
+    // Read the body of a message with its length as first 4 bytes.
+    static bool read_body(int fd, std::string &body)
+    {
+        char length[4];
+        if (!read_all(fd, length, sizeof(length))) {
+            return false;
+        }
+        body.resize(get_uint32(length) - 4);
+        return read_all(fd, body.data(), body.size());
+    }
+
+    static void send(int fd, char type, std::string const &body)
+    {
+        std::string message{type};
+        auto const length = static_cast<std::uint32_t>(body.size() + 4);
+        for (int shift = 24; shift >= 0; shift -= 8) {
+            message += static_cast<char>((length >> shift) & 0xffU);
+        }
+        message += body;
+        (void)::write(fd, message.data(), message.size());
+    }
+
+    static void serve(int fd, connection_log &log)
+    {
+        using namespace std::string_literals;
+
+        std::string body;
+        if (!read_body(fd, body)) { // startup message
+            return;
+        }
+        send(fd, 'R', "\0\0\0\0"s); // AuthenticationOk
+        send(fd, 'S', "client_encoding\0UTF8\0"s);
+        send(fd, 'S', "server_version\0" "16.0\0"s);
+        send(fd, 'S', "standard_conforming_strings\0on\0"s);
+        send(fd, 'K', "\0\0\0\1\0\0\0\2"s);
+        send(fd, 'Z', "I");
+
+        char type = 0;
+        while (read_all(fd, &type, 1) && read_body(fd, body)) {
+            if (type == 'X') {
+                return;
+            }
+            if (type == 'Q') {
+                body.pop_back(); // trailing \0
+                log.queries.push_back(body);
+                if (body.starts_with("COPY")) {
+                    send(fd, 'G', "\0\0\0"s); // CopyInResponse
+                    continue;
+                }
+                send(fd, 'C', "OK\0"s);
+                send(fd, 'Z', "I");
+            } else if (type == 'd') {
+                log.copy_data += body;
+            } else if (type == 'c') {
+                send(fd, 'C', "COPY 0\0"s);
+                send(fd, 'Z', "I");
+            }
+        }
+    }
+
+}; // class StubServer
+
+} // anonymous namespace
+
+TEST_CASE("pg_execute runs the SQL on one connection")
+{
+    StubServer server{1};
+    pg_execute(server.conninfo(), "CREATE TABLE a (); CREATE TABLE b ();");
+
+    auto const &log = server.log();
+    REQUIRE(log.size() == 1);
+    REQUIRE(log[0].queries ==
+            std::vector<std::string>{"CREATE TABLE a (); CREATE TABLE b ();"});
+}
+
+TEST_CASE("PgCopySink sends data and runs SQL after the COPY")
+{
+    StubServer server{1};
+    {
+        PgCopySink sink{server.conninfo(), "COPY \"t\" FROM STDIN",
+                        "ANALYZE \"t\";"};
+        sink.write("1\tfoo\n");
+        sink.write("2\tbar\n");
+        sink.close();
+    }
+
+    auto const &log = server.log();
+    REQUIRE(log.size() == 1);
+    REQUIRE(log[0].queries ==
+            std::vector<std::string>{"COPY \"t\" FROM STDIN", "ANALYZE \"t\";"});
+    REQUIRE(log[0].copy_data == "1\tfoo\n2\tbar\n");
+}
+
+TEST_CASE("Tables in database mode create real keys and indexes")
+{
+    StubServer server{2};
+    auto const old_opts = opts;
+    opts.database = server.conninfo();
+    opts.buffer_count = 1;
+
+    auto table = create_table(opts, "pgtest=n%I.v.T.Gp");
+    pg_execute(opts.database, table->sql_setup());
+    table->open();
+    table->close();
+    opts = old_opts;
+
+    auto const &log = server.log();
+    REQUIRE(log.size() == 2);
+
+    REQUIRE(log[0].queries.size() == 1);
+    REQUIRE(log[0].queries[0].find("CREATE TABLE \"pgtest\"") !=
+            std::string::npos);
+
+    REQUIRE(log[1].queries.size() == 2);
+    REQUIRE(log[1].queries[0] == "COPY \"pgtest\" FROM STDIN");
+    auto const &after = log[1].queries[1];
+    REQUIRE(after.find("ALTER TABLE \"pgtest\" ADD PRIMARY KEY") !=
+            std::string::npos);
+    REQUIRE(after.find("-- ALTER TABLE") == std::string::npos);
+    REQUIRE(after.find("CREATE INDEX \"pgtest_geom_idx\"") !=
+            std::string::npos);
+    REQUIRE(after.find("-- CREATE INDEX") == std::string::npos);
+}
@@ -0,0 +1,181 @@
+#include <catch.hpp>
+
+#include "options.hpp"
+#include "plan.hpp"
+#include "table.hpp"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace oeb = osmium::osm_entity_bits;
+
+namespace {
+
+std::vector<std::unique_ptr<Table>>
+create_tables(Options const &options, std::vector<std::string> const &streams)
+{
+    std::vector<std::unique_ptr<Table>> tables;
+    for (auto const &stream : streams) {
+        tables.push_back(
+            create_table(options, "ope-test-plan-" + stream + "=" + stream));
+    }
+    return tables;
+}
+
+} // anonymous namespace
+
+TEST_CASE("plan without areas has a single pass")
+{
+    Options options;
+    auto const tables = create_tables(options, {"n", "wN"});
+
+    auto const passes = plan_passes(tables, options);
+    REQUIRE(passes.size() == 1);
+    REQUIRE(passes[0].entities == (oeb::node | oeb::way));
+    REQUIRE(passes[0].tables ==
+            std::vector<Table *>{tables[0].get(), tables[1].get()});
+    REQUIRE(passes[0].objects);
+    REQUIRE_FALSE(passes[0].locations);
+    REQUIRE_FALSE(passes[0].area_relations);
+    REQUIRE_FALSE(passes[0].areas);
+}
+
+TEST_CASE("plan with node locations reads nodes")
+{
+    Options options;
+    options.use_location_handler = true;
+    auto const tables = create_tables(options, {"w"});
+
+    auto passes = plan_passes(tables, options);
+    REQUIRE(passes.size() == 1);
+    REQUIRE(passes[0].entities == (oeb::node | oeb::way));
+    REQUIRE(passes[0].locations);
+
+    // Locations are already in the index from an earlier run.
+    options.reuse_location_index = true;
+    passes = plan_passes(tables, options);
+    REQUIRE(passes[0].entities == oeb::way);
+    REQUIRE(passes[0].locations);
+
+    // Nodes in the change file update the index.
+    options.update = true;
+    passes = plan_passes(tables, options);
+    REQUIRE(passes[0].entities == (oeb::node | oeb::way));
+    REQUIRE(passes[0].locations);
+}
+
+TEST_CASE("plan with only a users table reads everything")
+{
+    Options options;
+    auto const tables = create_tables(options, {"u"});
+
+    auto const passes = plan_passes(tables, options);
+    REQUIRE(passes.size() == 1);
+    REQUIRE(passes[0].entities == oeb::all);
+}
+
+TEST_CASE("plan with areas and a relation-only table")
+{
+    Options options;
+    options.assemble_areas = true;
+    options.use_location_handler = true;
+    auto const tables = create_tables(options, {"a", "rT"});
+
+    auto const passes = plan_passes(tables, options);
+    REQUIRE(passes.size() == 2);
+
+    REQUIRE(passes[0].entities == oeb::relation);
+    REQUIRE(passes[0].area_relations);
+    REQUIRE(passes[0].tables == std::vector<Table *>{tables[1].get()});
+    REQUIRE(passes[0].objects);
+
+    REQUIRE(passes[1].entities == (oeb::node | oeb::way));
+    REQUIRE(passes[1].locations);
+    REQUIRE(passes[1].areas);
+    REQUIRE(passes[1].tables == std::vector<Table *>{tables[0].get()});
+    REQUIRE_FALSE(passes[1].objects);
+}
+
+TEST_CASE("plan with areas and other tables")
+{
+    Options options;
+    options.assemble_areas = true;
+    options.use_location_handler = true;
+    auto const tables = create_tables(options, {"a", "n"});
+
+    auto const passes = plan_passes(tables, options);
+    REQUIRE(passes.size() == 2);
+    REQUIRE(passes[0].tables.empty());
+    REQUIRE_FALSE(passes[0].objects);
+    REQUIRE(passes[1].entities == (oeb::node | oeb::way));
+    REQUIRE(passes[1].tables ==
+            std::vector<Table *>{tables[0].get(), tables[1].get()});
+    REQUIRE(passes[1].objects);
+}
+
+TEST_CASE("plan with areas and a region filter")
+{
+    Options options;
+    options.assemble_areas = true;
+    options.use_location_handler = true;
+    options.filter_region = true;
+    auto const tables = create_tables(options, {"a", "r"});
+
+    auto const passes = plan_passes(tables, options);
+    REQUIRE(passes.size() == 2);
+
+    // The relations need the ways and nodes to decide if they are in the
+    // region, so they are done in the second pass.
+    REQUIRE(passes[0].entities == oeb::relation);
+    REQUIRE(passes[0].tables.empty());
+    REQUIRE(passes[1].entities == (oeb::node | oeb::way | oeb::relation));
+    REQUIRE(passes[1].tables ==
+            std::vector<Table *>{tables[0].get(), tables[1].get()});
+    REQUIRE(passes[1].objects);
+}
+
+TEST_CASE("plan with region filter without areas")
+{
+    Options options;
+    options.filter_region = true;
+    auto const tables = create_tables(options, {"r"});
+
+    auto const passes = plan_passes(tables, options);
+    REQUIRE(passes.size() == 1);
+    REQUIRE(passes[0].entities == (oeb::node | oeb::way | oeb::relation));
+}
+
+TEST_CASE("users table follows the other tables with areas")
+{
+    Options options;
+    options.assemble_areas = true;
+    options.use_location_handler = true;
+
+    SECTION("only area tables")
+    {
+        auto const tables = create_tables(options, {"a", "u"});
+        auto const passes = plan_passes(tables, options);
+        REQUIRE(passes.size() == 2);
+        REQUIRE(passes[0].tables.empty());
+        REQUIRE(passes[1].tables ==
+                std::vector<Table *>{tables[0].get(), tables[1].get()});
+
+        // The users table only gets the areas, not the ways read for them.
+        REQUIRE_FALSE(passes[1].objects);
+        REQUIRE(passes[1].entities == (oeb::node | oeb::way));
+    }
+
+    SECTION("with a relation-only table")
+    {
+        auto const tables = create_tables(options, {"a", "u", "r"});
+        auto const passes = plan_passes(tables, options);
+        REQUIRE(passes.size() == 2);
+        REQUIRE(passes[0].tables ==
+                std::vector<Table *>{tables[2].get(), tables[1].get()});
+        REQUIRE(passes[0].objects);
+        REQUIRE(passes[1].tables ==
+                std::vector<Table *>{tables[0].get(), tables[1].get()});
+        REQUIRE_FALSE(passes[1].objects);
+    }
+}
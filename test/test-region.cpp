@@ -0,0 +1,86 @@
+
+#include <catch.hpp>
+
+#include "region.hpp"
+
+#include <osmium/builder/attr.hpp>
+
+#include <vector>
+
+TEST_CASE("bounding box region")
+{
+    auto const region = Region::from_bbox("1.0,2.0,3.0,4.0");
+
+    REQUIRE(region.contains(osmium::Location{2.0, 3.0}));
+    REQUIRE(region.contains(osmium::Location{1.5, 3.9}));
+    REQUIRE_FALSE(region.contains(osmium::Location{0.5, 3.0}));
+    REQUIRE_FALSE(region.contains(osmium::Location{2.0, 4.5}));
+    REQUIRE_FALSE(region.contains(osmium::Location{}));
+}
+
+TEST_CASE("invalid bounding boxes")
+{
+    REQUIRE_THROWS(Region::from_bbox("1.0,2.0,3.0"));
+    REQUIRE_THROWS(Region::from_bbox("1.0,2.0,3.0,4.0,5.0"));
+    REQUIRE_THROWS(Region::from_bbox("3.0,2.0,1.0,4.0"));
+    REQUIRE_THROWS(Region::from_bbox("foo"));
+}
+
+TEST_CASE("polygon region with hole")
+{
+    std::vector<Region::ring_type> const rings{
+        {osmium::Location{0.0, 0.0}, osmium::Location{10.0, 0.0},
+         osmium::Location{10.0, 10.0}, osmium::Location{0.0, 10.0}},
+        {osmium::Location{4.0, 4.0}, osmium::Location{6.0, 4.0},
+         osmium::Location{6.0, 6.0}, osmium::Location{4.0, 6.0}}};
+    Region const region{rings};
+
+    REQUIRE(region.contains(osmium::Location{1.0, 1.0}));
+    REQUIRE(region.contains(osmium::Location{9.0, 5.0}));
+    REQUIRE(region.contains(osmium::Location{3.99, 5.0}));
+    REQUIRE_FALSE(region.contains(osmium::Location{5.0, 5.0}));
+    REQUIRE_FALSE(region.contains(osmium::Location{4.01, 5.0}));
+    REQUIRE_FALSE(region.contains(osmium::Location{11.0, 5.0}));
+}
+
+TEST_CASE("triangle region")
+{
+    std::vector<Region::ring_type> const rings{
+        {osmium::Location{0.0, 0.0}, osmium::Location{10.0, 0.0},
+         osmium::Location{0.0, 10.0}, osmium::Location{0.0, 0.0}}};
+    Region const region{rings};
+
+    REQUIRE(region.contains(osmium::Location{1.0, 1.0}));
+    REQUIRE(region.contains(osmium::Location{4.9, 4.9}));
+    REQUIRE_FALSE(region.contains(osmium::Location{5.1, 5.1}));
+    REQUIRE_FALSE(region.contains(osmium::Location{9.0, 9.0}));
+}
+
+TEST_CASE("region filter keeps objects referencing nodes in the region")
+{
+    using namespace osmium::builder::attr;
+
+    osmium::memory::Buffer buffer{1024,
+                                  osmium::memory::Buffer::auto_grow::yes};
+    osmium::builder::add_node(buffer, _id(1), _location(1.5, 2.5));
+    osmium::builder::add_node(buffer, _id(2), _location(5.0, 5.0));
+    osmium::builder::add_node(buffer, _id(3), _location(6.0, 6.0));
+    osmium::builder::add_way(buffer, _id(10), _nodes({1, 2}));
+    osmium::builder::add_way(buffer, _id(11), _nodes({2, 3}));
+    osmium::builder::add_relation(buffer, _id(20),
+                                  _member(osmium::item_type::way, 10));
+    osmium::builder::add_relation(buffer, _id(21),
+                                  _member(osmium::item_type::way, 11));
+    osmium::builder::add_relation(buffer, _id(22),
+                                  _member(osmium::item_type::relation, 20));
+
+    RegionFilter filter{Region::from_bbox("1.0,2.0,3.0,4.0")};
+    filter(buffer);
+
+    std::vector<osmium::object_id_type> ids;
+    for (auto const &object : buffer.select<osmium::OSMObject>()) {
+        ids.push_back(object.id());
+    }
+
+    REQUIRE(ids == std::vector<osmium::object_id_type>{1, 10, 20, 22});
+}
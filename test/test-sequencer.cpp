@@ -0,0 +1,81 @@
+#include <catch.hpp>
+
+#include "sequencer.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+TEST_CASE("sequencer with results in order")
+{
+    std::vector<std::string> out;
+    Sequencer<std::string> sequencer{
+        [&out](std::string &&value) { out.push_back(std::move(value)); }};
+
+    sequencer.add(0, "a");
+    sequencer.add(1, "b");
+    sequencer.add(2, "c");
+
+    REQUIRE(out == std::vector<std::string>{"a", "b", "c"});
+    REQUIRE(sequencer.pending() == 0);
+}
+
+TEST_CASE("sequencer with results out of order")
+{
+    std::vector<std::string> out;
+    Sequencer<std::string> sequencer{
+        [&out](std::string &&value) { out.push_back(std::move(value)); }};
+
+    sequencer.add(2, "c");
+    sequencer.add(1, "b");
+    REQUIRE(out.empty());
+    REQUIRE(sequencer.pending() == 2);
+
+    sequencer.add(0, "a");
+    REQUIRE(out == std::vector<std::string>{"a", "b", "c"});
+    REQUIRE(sequencer.pending() == 0);
+
+    sequencer.add(4, "e");
+    sequencer.add(3, "d");
+    REQUIRE(out == std::vector<std::string>{"a", "b", "c", "d", "e"});
+}
+
+TEST_CASE("sequencer blocks results too far ahead")
+{
+    std::vector<std::string> out;
+    Sequencer<std::string> sequencer{
+        [&out](std::string &&value) { out.push_back(std::move(value)); }, 2};
+
+    sequencer.add(1, "b");
+
+    std::atomic<bool> added{false};
+    std::thread thread{[&]() {
+        sequencer.add(2, "c");
+        added = true;
+    }};
+
+    std::this_thread::sleep_for(std::chrono::milliseconds{50});
+    REQUIRE_FALSE(added);
+
+    sequencer.add(0, "a");
+    thread.join();
+
+    REQUIRE(added);
+    REQUIRE(out == std::vector<std::string>{"a", "b", "c"});
+}
+
+TEST_CASE("cancelled sequencer wakes up blocked results")
+{
+    std::vector<std::string> out;
+    Sequencer<std::string> sequencer{
+        [&out](std::string &&value) { out.push_back(std::move(value)); }, 1};
+
+    std::thread thread{[&]() { sequencer.add(3, "d"); }};
+    sequencer.cancel();
+    thread.join();
+
+    sequencer.add(0, "a");
+    REQUIRE(out.empty());
+}
@@ -0,0 +1,135 @@
+#include <catch.hpp>
+
+#include "sink.hpp"
+
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+
+namespace {
+
+struct mock_result
+{
+    std::string data;
+    std::size_t writes = 0;
+    bool closed = false;
+};
+
+/**
+ * Sink collecting the data in memory. It can be told to fail on the
+ * n-th write or on close.
+ */
+class MockSink : public Sink
+{
+
+    mock_result *m_result;
+    std::size_t m_fail_on_write;
+    bool m_fail_on_close;
+
+public:
+    explicit MockSink(mock_result *result, std::size_t fail_on_write = 0,
+                      bool fail_on_close = false)
+    : m_result(result), m_fail_on_write(fail_on_write),
+      m_fail_on_close(fail_on_close)
+    {
+    }
+
+    void write(std::string_view data) override
+    {
+        ++m_result->writes;
+        if (m_result->writes == m_fail_on_write) {
+            throw std::runtime_error{"mock write error"};
+        }
+        m_result->data.append(data);
+    }
+
+    void close() override
+    {
+        if (m_fail_on_close) {
+            throw std::runtime_error{"mock close error"};
+        }
+        m_result->closed = true;
+    }
+
+}; // class MockSink
+
+} // anonymous namespace
+
+TEST_CASE("async sink keeps the order of the buffers")
+{
+    mock_result result;
+    AsyncSink sink{std::make_unique<MockSink>(&result), 3, 16};
+
+    std::string expected;
+    for (int n = 0; n < 200; ++n) {
+        std::string buffer = "buffer " + std::to_string(n) + "\n";
+        expected += buffer;
+        if (n % 2 == 0) {
+            sink.write(buffer);
+        } else {
+            sink.write_buffer(buffer);
+            REQUIRE(buffer.empty());
+        }
+    }
+    sink.close();
+
+    REQUIRE(result.data == expected);
+    REQUIRE(result.writes == 200);
+    REQUIRE(result.closed);
+}
+
+TEST_CASE("async sink doesn't write empty buffers")
+{
+    mock_result result;
+    AsyncSink sink{std::make_unique<MockSink>(&result), 2, 16};
+
+    std::string buffer;
+    sink.write_buffer(buffer);
+    sink.write("");
+    sink.close();
+
+    REQUIRE(result.writes == 0);
+    REQUIRE(result.closed);
+}
+
+TEST_CASE("async sink rethrows write error from I/O thread in write")
+{
+    mock_result result;
+    AsyncSink sink{std::make_unique<MockSink>(&result, 1), 2, 16};
+
+    sink.write("a");
+
+    // With two buffers the second write waits for the first one to be
+    // written, so the error is seen at the latest by the third write.
+    REQUIRE_THROWS_WITH(
+        [&sink]() {
+            sink.write("b");
+            sink.write("c");
+        }(),
+        "mock write error");
+    REQUIRE_THROWS_WITH(sink.close(), "mock write error");
+    REQUIRE(result.data.empty());
+    REQUIRE_FALSE(result.closed);
+}
+
+TEST_CASE("async sink rethrows write error from I/O thread in close")
+{
+    mock_result result;
+    AsyncSink sink{std::make_unique<MockSink>(&result, 2), 4, 16};
+
+    sink.write("a");
+    sink.write("b");
+    REQUIRE_THROWS_WITH(sink.close(), "mock write error");
+    REQUIRE(result.data == "a");
+}
+
+TEST_CASE("async sink rethrows close error from I/O thread")
+{
+    mock_result result;
+    AsyncSink sink{std::make_unique<MockSink>(&result, 0, true), 2, 16};
+
+    sink.write("a");
+    REQUIRE_THROWS_WITH(sink.close(), "mock close error");
+    REQUIRE(result.data == "a");
+}
@@ -0,0 +1,93 @@
+#include <catch.hpp>
+
+#include "options.hpp"
+#include "table-workers.hpp"
+#include "table.hpp"
+
+#include <osmium/builder/attr.hpp>
+
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+using namespace osmium::builder::attr;
+
+Options opts;
+
+namespace {
+
+// Several buffers with nodes, ways, and relations with tags
+std::vector<osmium::memory::Buffer> create_buffers()
+{
+    std::vector<osmium::memory::Buffer> buffers;
+    osmium::object_id_type id = 1;
+    for (unsigned int n = 0; n < 20; ++n) {
+        osmium::memory::Buffer buffer{
+            1024, osmium::memory::Buffer::auto_grow::yes};
+        for (unsigned int m = 0; m < 30; ++m, ++id) {
+            osmium::builder::add_node(
+                buffer, _id(id), _version(1),
+                _location(static_cast<double>(m) / 10, 1.5),
+                _tag("name", "node\t" + std::to_string(id)));
+            osmium::builder::add_way(
+                buffer, _id(id), _version(2), _nodes({id, id + 1, id + 2}),
+                _tag("highway", "residential"),
+                _tag("name", "Straße " + std::to_string(id)));
+            osmium::builder::add_relation(
+                buffer, _id(id), _version(3),
+                _member(osmium::item_type::way, id, "outer"),
+                _tag("type", "multipolygon"));
+        }
+        buffers.push_back(std::move(buffer));
+    }
+    return buffers;
+}
+
+// Format all objects for the stream on the given number of threads and
+// return the contents of the output file.
+std::string format(std::string const &stream, unsigned int num_threads)
+{
+    auto const filename = (std::filesystem::temp_directory_path() /
+                           ("ope-test-lanes-" + stream + "-" +
+                            std::to_string(num_threads)))
+                              .string();
+
+    auto table = create_table(opts, filename + "=" + stream);
+    table->open();
+    {
+        TableWorkers workers{{table.get()}, num_threads};
+        for (auto &buffer : create_buffers()) {
+            workers(std::move(buffer));
+        }
+        workers.finish();
+    }
+    table->flush();
+    table->close();
+
+    std::ifstream file{table->filename(), std::ios::binary};
+    std::string data{std::istreambuf_iterator<char>{file},
+                     std::istreambuf_iterator<char>{}};
+    std::remove(table->filename().c_str());
+    return data;
+}
+
+} // anonymous namespace
+
+TEST_CASE("formatting on several lanes gives the same output as one lane")
+{
+    // Small buffers so the tables flush several times
+    opts.buffer_size = 1024;
+
+    for (char const *stream : {"o", "oT", "wN", "rM"}) {
+        auto const serial = format(stream, 1);
+        REQUIRE_FALSE(serial.empty());
+        REQUIRE(format(stream, 4) == serial);
+    }
+
+    opts.binary_format = true;
+    REQUIRE(format("wN", 4) == format("wN", 1));
+    opts.binary_format = false;
+}
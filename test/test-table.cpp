@@ -0,0 +1,137 @@
+#include <catch.hpp>
+
+#include "options.hpp"
+#include "table.hpp"
+
+#include <osmium/builder/attr.hpp>
+
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+extern Options opts;
+
+TEST_CASE("split by object type needs objects of all types")
+{
+    auto const old_opts = opts;
+    opts.shard_by = shard_method::objtype;
+
+    REQUIRE_NOTHROW(create_table(opts, "ope-test-objtype=o")->check_shards());
+    REQUIRE_NOTHROW(
+        create_table(opts, "ope-test-objtype=oT")->check_shards());
+    REQUIRE_THROWS_AS(create_table(opts, "ope-test-objtype=a")->check_shards(),
+                      std::runtime_error);
+    REQUIRE_THROWS_AS(create_table(opts, "ope-test-objtype=u")->check_shards(),
+                      std::runtime_error);
+    REQUIRE_THROWS_AS(create_table(opts, "ope-test-objtype=n")->check_shards(),
+                      std::runtime_error);
+
+    opts = old_opts;
+}
+
+TEST_CASE("other shard methods work with all tables")
+{
+    auto const old_opts = opts;
+    opts.shards = 4;
+
+    opts.shard_by = shard_method::hash;
+    REQUIRE_NOTHROW(create_table(opts, "ope-test-shards=a")->check_shards());
+    opts.shard_by = shard_method::range;
+    opts.shard_range = 1000;
+    REQUIRE_NOTHROW(create_table(opts, "ope-test-shards=u")->check_shards());
+
+    opts = old_opts;
+}
+
+TEST_CASE("update mode needs tables with keys")
+{
+    auto const old_opts = opts;
+    opts.update = true;
+
+    REQUIRE_NOTHROW(create_table(opts, "ope-test-update=w")->check_update());
+    REQUIRE_NOTHROW(
+        create_table(opts, "ope-test-update=n%I.v.Gp")->check_update());
+    REQUIRE_NOTHROW(
+        create_table(opts, "ope-test-update=w%I.v.Gl")->check_update());
+    REQUIRE_THROWS_AS(
+        create_table(opts, "ope-test-update=w%v.Gl")->check_update(),
+        std::runtime_error);
+
+    opts = old_opts;
+}
+
+TEST_CASE("tables sorted by id or changeset get a BRIN index")
+{
+    auto const old_opts = opts;
+
+    opts.sort_by = sort_method::id;
+    REQUIRE_THAT(create_table(opts, "ope-test-sort=n")->sql_finish(true),
+                 Catch::Contains("\"ope-test-sort_id_brin\""));
+    REQUIRE_THAT(create_table(opts, "ope-test-sort=c")->sql_finish(true),
+                 Catch::Contains("\"ope-test-sort_changeset_id_brin\""));
+    REQUIRE_THAT(create_table(opts, "ope-test-sort=cT")->sql_finish(true),
+                 Catch::Contains("\"ope-test-sort_id_brin\""));
+
+    opts.sort_by = sort_method::changeset;
+    REQUIRE_THAT(create_table(opts, "ope-test-sort=n")->sql_finish(true),
+                 Catch::Contains("\"ope-test-sort_changeset_id_brin\""));
+    REQUIRE_THAT(create_table(opts, "ope-test-sort=c")->sql_finish(true),
+                 Catch::Contains("\"ope-test-sort_changeset_id_brin\""));
+    REQUIRE_THAT(create_table(opts, "ope-test-sort=cT")->sql_finish(true),
+                 Catch::Contains("\"ope-test-sort_id_brin\""));
+
+    opts.sort_by = sort_method::none;
+    REQUIRE_THAT(create_table(opts, "ope-test-sort=c")->sql_finish(true),
+                 Catch::Not(Catch::Contains("_brin")));
+
+    opts = old_opts;
+}
+
+TEST_CASE("changesets go into the default partition with tile partitions")
+{
+    using namespace osmium::builder::attr;
+
+    auto const old_opts = opts;
+    opts.shards = 2;
+    opts.shard_by = shard_method::tile;
+    opts.partition = true;
+
+    auto const filename = (std::filesystem::temp_directory_path() /
+                           "ope-test-partition.pgcopy")
+                              .string();
+    auto table = create_table(opts, filename + "=c%c.q.");
+    table->check_partition();
+    table->open();
+
+    osmium::memory::Buffer buffer{1024,
+                                  osmium::memory::Buffer::auto_grow::yes};
+    for (osmium::changeset_id_type id = 1; id <= 10; ++id) {
+        osmium::builder::add_changeset(buffer, _cid(id));
+    }
+    for (auto const &changeset : buffer.select<osmium::Changeset>()) {
+        table->select_shard_for(changeset);
+        table->add_changeset_row(changeset);
+    }
+    table->close();
+    opts = old_opts;
+
+    auto const filenames = table->output_filenames();
+    REQUIRE(filenames.size() == 3);
+    std::vector<std::string> contents;
+    for (auto const &name : filenames) {
+        std::ifstream file{name, std::ios::binary};
+        contents.emplace_back(std::istreambuf_iterator<char>{file},
+                              std::istreambuf_iterator<char>{});
+        file.close();
+        std::remove(name.c_str());
+    }
+
+    REQUIRE(contents[0].empty());
+    REQUIRE(contents[1].empty());
+    REQUIRE(contents[2] == "1\t\\N\n2\t\\N\n3\t\\N\n4\t\\N\n5\t\\N\n"
+                           "6\t\\N\n7\t\\N\n8\t\\N\n9\t\\N\n10\t\\N\n");
+}
@@ -0,0 +1,93 @@
+
+#include <catch.hpp>
+
+#include "tag-filter.hpp"
+
+#include <osmium/builder/attr.hpp>
+
+#include <stdexcept>
+
+using namespace osmium::builder::attr;
+
+namespace {
+
+osmium::OSMObject const &
+add_object(osmium::memory::Buffer &buffer, osmium::item_type type,
+           char const *key, char const *value)
+{
+    std::size_t offset = 0;
+    switch (type) {
+    case osmium::item_type::node:
+        offset = osmium::builder::add_node(buffer, _id(1), _tag(key, value));
+        break;
+    case osmium::item_type::way:
+        offset = osmium::builder::add_way(buffer, _id(1), _tag(key, value));
+        break;
+    default:
+        offset =
+            osmium::builder::add_relation(buffer, _id(1), _tag(key, value));
+        break;
+    }
+    return buffer.get<osmium::OSMObject>(offset);
+}
+
+} // anonymous namespace
+
+TEST_CASE("tag filter on key only")
+{
+    osmium::memory::Buffer buffer{1024,
+                                  osmium::memory::Buffer::auto_grow::yes};
+    TagFilter filter;
+    filter.add("amenity");
+
+    REQUIRE(filter.matches(
+        add_object(buffer, osmium::item_type::node, "amenity", "cafe")));
+    REQUIRE(filter.matches(
+        add_object(buffer, osmium::item_type::way, "amenity", "school")));
+    REQUIRE_FALSE(filter.matches(
+        add_object(buffer, osmium::item_type::node, "shop", "bakery")));
+}
+
+TEST_CASE("tag filter on values and types")
+{
+    osmium::memory::Buffer buffer{1024,
+                                  osmium::memory::Buffer::auto_grow::yes};
+    TagFilter filter;
+    filter.add("w/highway=primary,secondary");
+    filter.add("n/highway=traffic_signals");
+
+    REQUIRE(filter.matches(
+        add_object(buffer, osmium::item_type::way, "highway", "primary")));
+    REQUIRE(filter.matches(
+        add_object(buffer, osmium::item_type::way, "highway", "secondary")));
+    REQUIRE_FALSE(filter.matches(
+        add_object(buffer, osmium::item_type::way, "highway", "tertiary")));
+    REQUIRE_FALSE(filter.matches(
+        add_object(buffer, osmium::item_type::node, "highway", "primary")));
+    REQUIRE(filter.matches(add_object(buffer, osmium::item_type::node,
+                                      "highway", "traffic_signals")));
+    REQUIRE_FALSE(filter.matches(
+        add_object(buffer, osmium::item_type::relation, "highway", "primary")));
+}
+
+TEST_CASE("object without tags doesn't match")
+{
+    osmium::memory::Buffer buffer{1024,
+                                  osmium::memory::Buffer::auto_grow::yes};
+    TagFilter filter;
+    filter.add("building");
+
+    auto const offset = osmium::builder::add_way(buffer, _id(1));
+    REQUIRE_FALSE(filter.matches(buffer.get<osmium::OSMObject>(offset)));
+}
+
+TEST_CASE("invalid tag filter expressions")
+{
+    TagFilter filter;
+    REQUIRE_THROWS_AS(filter.add("w/"), std::runtime_error);
+    REQUIRE_THROWS_AS(filter.add("=foo"), std::runtime_error);
+    REQUIRE_THROWS_AS(filter.add("highway="), std::runtime_error);
+    REQUIRE_THROWS_AS(filter.add("highway=primary,,secondary"),
+                      std::runtime_error);
+    REQUIRE(filter.empty());
+}
@@ -0,0 +1,55 @@
+#include <catch.hpp>
+
+#include "uring.hpp"
+
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include <string>
+#include <vector>
+
+TEST_CASE("io_uring writer with more files than initial buffers")
+{
+    auto writer = UringWriter::shared(4096, false);
+    if (!writer) {
+        WARN("io_uring not available, skipping test");
+        return;
+    }
+
+    auto const initial_buffers = writer->buffer_count();
+    auto const num_files = initial_buffers + 8;
+    auto const dir = std::filesystem::temp_directory_path();
+
+    std::vector<std::string> filenames;
+    std::vector<std::unique_ptr<UringSink>> sinks;
+    for (std::size_t n = 0; n < num_files; ++n) {
+        filenames.push_back(
+            (dir / ("ope-test-uring-" + std::to_string(n))).string());
+        sinks.push_back(std::make_unique<UringSink>(writer, filenames.back()));
+    }
+    REQUIRE(writer->buffer_count() >= num_files * 2);
+
+    // Every file keeps a partially filled buffer, then more data than
+    // fits into one buffer is written to each.
+    std::string const start{"start\n"};
+    std::string const more(10000, 'x');
+    for (auto &sink : sinks) {
+        sink->write(start);
+    }
+    for (auto &sink : sinks) {
+        sink->write(more);
+    }
+    for (auto &sink : sinks) {
+        sink->close();
+    }
+
+    for (auto const &filename : filenames) {
+        std::ifstream file{filename, std::ios::binary};
+        std::string const data{std::istreambuf_iterator<char>{file},
+                               std::istreambuf_iterator<char>{}};
+        REQUIRE(data == start + more);
+        std::remove(filename.c_str());
+    }
+}
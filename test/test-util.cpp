@@ -4,6 +4,8 @@
 #include "util.hpp"
 
 #include <cstring>
+#include <random>
+#include <string>
 
 TEST_CASE("split with delimiter")
 {
@@ -32,3 +34,114 @@ TEST_CASE("yesno")
     REQUIRE_FALSE(std::strcmp(yes_no(true), "yes\n"));
     REQUIRE_FALSE(std::strcmp(yes_no(false), "no\n"));
 }
+
+TEST_CASE("append_pg_escaped")
+{
+    std::string buffer{"x"};
+    append_pg_escaped(buffer, "a\\b\nc\rd\te");
+    REQUIRE(buffer == "xa\\\\b\\nc\\rd\\te");
+}
+
+TEST_CASE("append_pg_escaped with size stops at size or NUL")
+{
+    std::string buffer;
+    append_pg_escaped(buffer, "abc\tdef", 4);
+    REQUIRE(buffer == "abc\\t");
+
+    buffer.clear();
+    std::string const str{"01234567890123456789\0abc", 24};
+    append_pg_escaped(buffer, str.data(), str.size());
+    REQUIRE(buffer == "01234567890123456789");
+}
+
+namespace {
+
+// Simple reference implementation escaping one character at a time
+std::string pg_escaped(std::string const &str)
+{
+    std::string result;
+    for (char const c : str) {
+        switch (c) {
+        case '\0':
+            return result;
+        case '\\':
+            result += "\\\\";
+            break;
+        case '\n':
+            result += "\\n";
+            break;
+        case '\r':
+            result += "\\r";
+            break;
+        case '\t':
+            result += "\\t";
+            break;
+        default:
+            result += c;
+        }
+    }
+    return result;
+}
+
+} // anonymous namespace
+
+TEST_CASE("all append_pg_escaped implementations escape the same way")
+{
+    std::mt19937 gen{42}; // NOLINT(cert-msc32-c,cert-msc51-cpp)
+    std::uniform_int_distribution<int> length_dist{0, 100};
+    std::uniform_int_distribution<int> char_dist{0, 99};
+
+    // Mostly normal characters, some special ones
+    auto const random_char = [&]() -> char {
+        auto const n = char_dist(gen);
+        if (n < 90) {
+            return static_cast<char>('a' + (n % 26));
+        }
+        return "\\\n\r\t\0\x80\xff,\"\x01"[n - 90];
+    };
+
+    for (int i = 0; i < 10000; ++i) {
+        std::string str;
+        auto const length = length_dist(gen);
+        for (int n = 0; n < length; ++n) {
+            str += random_char();
+        }
+
+        auto const expected = pg_escaped(str);
+
+        std::string result;
+        append_pg_escaped(result, str.data(), str.size());
+        REQUIRE(result == expected);
+
+        result.clear();
+        detail::append_pg_escaped_scalar(result, str.data(), str.size());
+        REQUIRE(result == expected);
+
+#ifdef OPE_X86_SIMD
+        result.clear();
+        detail::append_pg_escaped_sse2(result, str.data(), str.size());
+        REQUIRE(result == expected);
+
+        if (__builtin_cpu_supports("avx2")) {
+            result.clear();
+            detail::append_pg_escaped_avx2(result, str.data(), str.size());
+            REQUIRE(result == expected);
+        }
+#endif
+    }
+}
+
+TEST_CASE("hilbert_index starts and ends in the bottom corners")
+{
+    REQUIRE(hilbert_index(0, 0) == 0);
+    REQUIRE(hilbert_index(0xffffffffU, 0) == 0xffffffffffffffffULL);
+}
+
+TEST_CASE("hilbert_index visits the quadrants in order")
+{
+    constexpr std::uint32_t low = 0x40000000U;
+    constexpr std::uint32_t high = 0xc0000000U;
+    REQUIRE(hilbert_index(low, low) < hilbert_index(low, high));
+    REQUIRE(hilbert_index(low, high) < hilbert_index(high, high));
+    REQUIRE(hilbert_index(high, high) < hilbert_index(high, low));
+}
@@ -0,0 +1,87 @@
+#include <catch.hpp>
+
+#include "way-store.hpp"
+
+#include <osmium/builder/attr.hpp>
+#include <osmium/io/any_input.hpp>
+
+#include <filesystem>
+#include <string>
+#include <vector>
+
+using namespace osmium::builder::attr;
+
+namespace {
+
+std::vector<osmium::Way const *> ways_in(osmium::memory::Buffer const &buffer)
+{
+    std::vector<osmium::Way const *> ways;
+    for (auto const &way : buffer.select<osmium::Way>()) {
+        ways.push_back(&way);
+    }
+    return ways;
+}
+
+} // anonymous namespace
+
+TEST_CASE("way store finds ways with moved nodes and is updated")
+{
+    auto const dir =
+        std::filesystem::temp_directory_path() / "ope-test-way-store";
+    std::filesystem::remove_all(dir);
+    std::filesystem::create_directories(dir);
+    auto const filename = way_store_filename((dir / "index").string());
+    REQUIRE(filename == (dir / "index.ways").string());
+
+    {
+        osmium::memory::Buffer buffer{1024,
+                                      osmium::memory::Buffer::auto_grow::yes};
+        osmium::builder::add_node(buffer, _id(10));
+        osmium::builder::add_way(buffer, _id(1), _version(1),
+                                 _nodes({10, 11}));
+        osmium::builder::add_way(buffer, _id(2), _version(1),
+                                 _nodes({10, 20}));
+        osmium::builder::add_way(buffer, _id(3), _version(1),
+                                 _nodes({30, 31, 32}));
+        osmium::builder::add_way(buffer, _id(4), _version(1),
+                                 _nodes({31, 40}));
+        osmium::builder::add_way(buffer, _id(5), _version(1),
+                                 _nodes({50, 51}));
+
+        WayStoreWriter writer{filename};
+        writer.add(buffer);
+        writer.close();
+    }
+    REQUIRE(std::filesystem::exists(filename));
+    REQUIRE_FALSE(std::filesystem::exists(filename + ".tmp"));
+
+    // Way 2 changed, way 4 is deleted and way 6 is new.
+    osmium::memory::Buffer changes{1024,
+                                   osmium::memory::Buffer::auto_grow::yes};
+    osmium::builder::add_way(changes, _id(2), _version(2), _nodes({20, 21}));
+    osmium::builder::add_way(changes, _id(4), _version(2), _deleted());
+    osmium::builder::add_way(changes, _id(6), _version(1), _nodes({10, 60}));
+
+    std::vector<osmium::object_id_type> moved;
+    update_way_store(filename, ways_in(changes), {10, 31},
+                     [&moved](osmium::Way &way) {
+                         moved.push_back(way.id());
+                     });
+
+    // Ways in the change file already get new rows.
+    REQUIRE(moved == std::vector<osmium::object_id_type>{1, 3});
+
+    auto const buffer =
+        osmium::io::read_file(osmium::io::File{filename, "pbf"});
+    std::vector<osmium::object_id_type> ids;
+    std::vector<osmium::object_version_type> versions;
+    for (auto const &way : buffer.select<osmium::Way>()) {
+        ids.push_back(way.id());
+        versions.push_back(way.version());
+    }
+    REQUIRE(ids == std::vector<osmium::object_id_type>{1, 2, 3, 5, 6});
+    REQUIRE(versions ==
+            std::vector<osmium::object_version_type>{1, 2, 1, 1, 1});
+
+    std::filesystem::remove_all(dir);
+}